@@ -0,0 +1,846 @@
+/*  Benchmark of the solver over the testing_latest scenarios and synthetic activity sets.
+    Every scenario is solved several times with fixed seeds and initial SOC, the results are
+    written as JSON on stdout (see `make bench`).
+
+    usage: bench [-r runs] [-R synthetic_runs] [-s initial_soc] [-e error_std_dev] [-S seed] [-g sizes]
+                 [-c factor,corridor] [-b beam_width,max_live_labels,deadline] [csv files or directories...]
+    -g gives the sizes of the synthetic scenarios, comma separated (default 50,100,200, 0 for none).
+    The synthetic scenarios are much slower, they get their own number of runs (default 5).
+    -c also solves every run coarse to fine (see solve_coarse_to_fine) and reports its latency and its
+    utility gap to the full solve. -b solves under that budget (see set_budget, deadline in seconds) and
+    counts the runs it cut.
+
+    Regression gate (`make perf-check`): bench -G golden [-t tolerance] [csv files or directories...]
+    solves every CSV with the runs, seed, initial SOC and error std dev recorded in the golden file and
+    compares the feasible runs, labels created, labels dominated, DSSR iterations and mean utility to it.
+    Labels created or DSSR iterations above golden * (1 + tolerance) (default 0.02), a share of dominated
+    labels (dominated / created) below the golden share * (1 - tolerance), another utility or feasible run
+    count, or a scenario missing on either side fails the gate (exit status 1). Every run is also solved with
+    bounding, with the initial SOC of the golden file and drawn: a run bounding changes fails the gate too.
+    -W golden records the file instead.
+    Synthetic scenarios are not part of the gate */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include "scheduling.h"
+#include "activity_csv.h"
+
+// Model parameters of testing_latest/testing_check.py
+#define BENCH_HORIZON 288
+#define BENCH_TIME_INTERVAL 5
+#define BENCH_SPEED (20.4 * 1.60934 * 16.667) // m/min
+#define BENCH_TRAVEL_TIME_PENALTY -0.1
+
+static double asc[9] = {0, 10.6, 16.1, 11.3, 17.4, 12, 16.1, 6.76, 0};
+static double early[9] = {0, -1.37, -1.73, -2.51, -2.56, -0.031, -1.73, -2.55, 0};
+static double late[9] = {0, -0.79, -3.42, -0.993, -1.54, -1.58, -3.42, -0.578, -0.61};
+static double longp[9] = {0, -0.201, -0.597, -0.133, -0.0783, -0.209, -0.597, -0.0267, -0.24};
+static double shortp[9] = {0, -4.78, -5.63, 0.528, -0.783, -0.00764, -5.63, 0.134, -0.61};
+
+typedef struct BenchOptions
+{
+    int runs;
+    int synthetic_runs;
+    double initial_soc;
+    double error_std_dev;
+    unsigned int seed;
+    int coarse_factor; // 0 when coarse to fine is not benchmarked
+    int corridor;
+    int beam_width; // budget of every solve, 0 for no limit
+    long max_live_labels;
+    double deadline;
+    struct Gate *gate; // regression gate instead of the benchmark, or NULL
+} BenchOptions;
+
+// Totals of the runs of a scenario, what the regression gate compares
+typedef struct GateCounts
+{
+    int feasible_runs;
+    long labels_created;
+    long labels_dominated; // incoming, evicted and earlier (see SolverStats)
+    long dssr_iterations;
+    double mean_utility; // over the feasible runs
+} GateCounts;
+
+typedef struct GoldenEntry
+{
+    char *path;
+    GateCounts counts;
+    int seen;
+} GoldenEntry;
+
+typedef struct Gate
+{
+    const char *file;
+    int write; // record the golden file instead of checking it
+    double tolerance;
+    GoldenEntry *entries;
+    int n_entries;
+    int cap_entries;
+    int n_checked;
+    int n_failed;
+} Gate;
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////// SCENARIOS /////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*  Synthetic person with n_candidates activities between dawn and dusk, drawn with a fixed seed.
+    Candidates are places within 8 km of home with the time windows and durations of the testing_latest
+    files; one in four is a charging copy of the one before and one in eight is a home stay */
+static Activity *synthetic_activities(int n_candidates, unsigned int seed, int *n_out)
+{
+    int n = n_candidates + 2;
+    Activity *acts = (Activity *)calloc((size_t)n, sizeof(Activity));
+    if (acts == NULL)
+    {
+        return NULL;
+    }
+    unsigned short state[3] = {0x330E, (unsigned short)(seed & 0xFFFF), (unsigned short)(seed >> 16)};
+    const double home_x = 451322.0, home_y = 396724.0;
+
+    // dawn and dusk as in the testing_latest files
+    acts[0] = (Activity){.id = 0, .x = home_x, .y = home_y, .group = 0, .earliest_start = 0, .latest_start = 0,
+                         .min_duration = 1, .max_duration = 286};
+    acts[n - 1] = (Activity){.id = n - 1, .x = home_x, .y = home_y, .group = 0, .earliest_start = 0,
+                             .latest_start = 286, .min_duration = 1, .max_duration = 286};
+
+    for (int i = 1; i < n - 1; i++)
+    {
+        Activity *a = &acts[i];
+        if (i % 4 == 0 && i > 1 && acts[i - 1].group != 0)
+        { // charging copy of the previous place
+            *a = acts[i - 1];
+            a->id = i;
+            a->charge_mode = 1 + (int)(erand48(state) * 2.0); // slow or fast
+            a->is_charging = 1;
+            continue;
+        }
+        a->id = i;
+        if (i % 8 == 7)
+        {
+            *a = (Activity){.id = i, .x = home_x, .y = home_y, .group = 0, .earliest_start = 0, .latest_start = 288,
+                            .min_duration = 2, .max_duration = 288, .des_duration = 12};
+            continue;
+        }
+        double r = 8000.0 * sqrt(erand48(state));
+        double angle = 2.0 * M_PI * erand48(state);
+        a->x = home_x + r * cos(angle);
+        a->y = home_y + r * sin(angle);
+        // groups 1..7 after the shift (0 is home), each with its own 2 hour slot of the day
+        a->group = 1 + (int)(erand48(state) * 7.0);
+        a->earliest_start = 72 + 24 * (a->group - 1) + (int)(erand48(state) * 24.0);
+        a->latest_start = a->earliest_start + 6 + (int)(erand48(state) * 18.0);
+        a->min_duration = 6 + (int)(erand48(state) * 7.0);
+        a->max_duration = a->min_duration + 6 + (int)(erand48(state) * 30.0);
+        a->des_start_time = (a->earliest_start + a->latest_start) / 2;
+        a->des_duration = a->min_duration + (a->max_duration - a->min_duration) / 3;
+    }
+    *n_out = n;
+    return acts;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////// MEASURES ///////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static double wall_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+static long peak_rss_kb(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss; // kilobytes on Linux
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// nearest rank percentile of n sorted values
+static double percentile(const double *sorted, int n, double p)
+{
+    int rank = (int)ceil(p * n);
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+    return sorted[rank - 1];
+}
+
+static void print_json_string(const char *s)
+{
+    putchar('"');
+    for (; *s != '\0'; s++)
+    {
+        if (*s == '"' || *s == '\\')
+        {
+            putchar('\\');
+        }
+        if ((unsigned char)*s >= 0x20)
+        {
+            putchar(*s);
+        }
+    }
+    putchar('"');
+}
+
+/*  Solves one scenario `runs` times, run r with seed opt->seed + r, and prints its JSON object.
+    The context is kept across runs, as when a worker solves a batch */
+static void bench_scenario(const char *name, const char *source, const Activity *acts, int n,
+                           const BenchOptions *opt, int runs, int first)
+{
+    SolverContext *ctx = ctx_create();
+    SolverContext *coarse = opt->coarse_factor > 0 ? ctx_create() : NULL;
+    double *latency = (double *)malloc((size_t)runs * sizeof(double));
+    if (ctx == NULL || latency == NULL || ctx_set_activities(ctx, acts, n) != 0 ||
+        (opt->coarse_factor > 0 && (coarse == NULL || ctx_set_activities(coarse, acts, n) != 0)))
+    {
+        fprintf(stderr, "bench: out of memory for %s\n", name);
+        free(latency);
+        ctx_destroy(ctx);
+        ctx_destroy(coarse);
+        return;
+    }
+    ctx_set_fixed_initial_soc(ctx, opt->initial_soc);
+    ctx_set_utility_error_std_dev(ctx, opt->error_std_dev);
+    ctx_set_budget(ctx, opt->beam_width, opt->max_live_labels, opt->deadline);
+    if (coarse != NULL)
+    {
+        ctx_set_fixed_initial_soc(coarse, opt->initial_soc);
+        ctx_set_utility_error_std_dev(coarse, opt->error_std_dev);
+        ctx_set_budget(coarse, opt->beam_width, opt->max_live_labels, opt->deadline);
+    }
+    // coarse to fine runs, compared only where both solves are feasible
+    int coarse_feasible = 0, gap_runs = 0;
+    double coarse_time = 0.0, coarse_utility = 0.0, coarse_labels = 0.0, gap_total = 0.0, gap_max = 0.0;
+
+    int feasible = 0, dssr_max = 0, cut = 0;
+    long dssr_total = 0, peak_live = 0;
+    int max_occupancy = 0;
+    double labels_total = 0.0, time_total = 0.0, utility_total = 0.0;
+    size_t bytes = 0;
+    for (int r = 0; r < runs; r++)
+    {
+        ctx_set_random_seed(ctx, opt->seed + (unsigned int)r);
+        double start = wall_seconds();
+        int status = ctx_solve(ctx);
+        latency[r] = wall_seconds() - start;
+
+        SolverStats st;
+        ctx_get_solver_stats(ctx, &st);
+        if (status == 0)
+        {
+            feasible++;
+            utility_total += ctx_get_final_schedule(ctx)->utility;
+        }
+        cut += ctx_get_solve_status(ctx) != SOLVE_OPTIMAL;
+        dssr_total += st.dssr_iterations;
+        dssr_max = st.dssr_iterations > dssr_max ? st.dssr_iterations : dssr_max;
+        peak_live = st.peak_live_labels > peak_live ? st.peak_live_labels : peak_live;
+        max_occupancy = st.max_cell_occupancy > max_occupancy ? st.max_cell_occupancy : max_occupancy;
+        bytes = st.bytes_allocated > bytes ? st.bytes_allocated : bytes;
+        labels_total += (double)st.labels_created;
+        time_total += latency[r];
+
+        if (coarse != NULL)
+        {
+            ctx_set_random_seed(coarse, opt->seed + (unsigned int)r);
+            start = wall_seconds();
+            int coarse_status = ctx_solve_coarse_to_fine(coarse, opt->coarse_factor, opt->corridor);
+            coarse_time += wall_seconds() - start;
+            ctx_get_solver_stats(coarse, &st);
+            coarse_labels += (double)st.labels_created;
+            if (coarse_status == 0)
+            {
+                double u = ctx_get_final_schedule(coarse)->utility;
+                coarse_feasible++;
+                coarse_utility += u;
+                if (status == 0)
+                {
+                    double gap = ctx_get_final_schedule(ctx)->utility - u;
+                    gap_runs++;
+                    gap_total += gap;
+                    gap_max = gap > gap_max ? gap : gap_max;
+                }
+            }
+        }
+    }
+    qsort(latency, (size_t)runs, sizeof(double), compare_double);
+
+    printf("%s\n    {\"name\": ", first ? "" : ",");
+    print_json_string(name);
+    printf(", \"source\": \"%s\", \"n_activities\": %d, \"runs\": %d, \"feasible_runs\": %d, \"budget_cut_runs\": %d,\n",
+           source, n, runs, feasible, cut);
+    printf("     \"latency_ms\": {\"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"mean\": %.4f},\n",
+           1e3 * percentile(latency, runs, 0.50), 1e3 * percentile(latency, runs, 0.95),
+           1e3 * percentile(latency, runs, 0.99), 1e3 * time_total / runs);
+    printf("     \"labels_created_per_run\": %.1f, \"labels_created_per_s\": %.1f,\n",
+           labels_total / runs, time_total > 0.0 ? labels_total / time_total : 0.0);
+    printf("     \"dssr_iterations\": {\"mean\": %.3f, \"max\": %d}, \"mean_utility\": %.6f,\n",
+           (double)dssr_total / runs, dssr_max, feasible > 0 ? utility_total / feasible : 0.0);
+    printf("     \"peak_live_labels\": %ld, \"max_cell_occupancy\": %d, \"bytes_allocated\": %zu, \"peak_rss_kb\": %ld",
+           peak_live, max_occupancy, bytes, peak_rss_kb());
+    if (coarse != NULL)
+    {
+        printf(",\n     \"coarse_to_fine\": {\"factor\": %d, \"corridor\": %d, \"feasible_runs\": %d, \"mean_latency_ms\": %.4f,\n",
+               opt->coarse_factor, opt->corridor, coarse_feasible, 1e3 * coarse_time / runs);
+        printf("                        \"labels_created_per_run\": %.1f, \"mean_utility\": %.6f, \"utility_gap\": {\"mean\": %.6f, \"max\": %.6f}}",
+               coarse_labels / runs, coarse_feasible > 0 ? coarse_utility / coarse_feasible : 0.0,
+               gap_runs > 0 ? gap_total / gap_runs : 0.0, gap_max);
+    }
+    printf("}");
+    fflush(stdout);
+
+    free(latency);
+    ctx_destroy(ctx);
+    ctx_destroy(coarse);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////// REGRESSION GATE ////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*  Solves the scenario opt->runs times as bench_scenario() does and adds up its counts, -1 if out of memory
+    or the solver counts nothing */
+static int count_scenario(const Activity *acts, int n, const BenchOptions *opt, GateCounts *c)
+{
+    memset(c, 0, sizeof(*c));
+    SolverContext *ctx = ctx_create();
+    if (ctx == NULL || ctx_set_activities(ctx, acts, n) != 0)
+    {
+        ctx_destroy(ctx);
+        return -1;
+    }
+    ctx_set_fixed_initial_soc(ctx, opt->initial_soc);
+    ctx_set_utility_error_std_dev(ctx, opt->error_std_dev);
+    double utility_total = 0.0;
+    for (int r = 0; r < opt->runs; r++)
+    {
+        ctx_set_random_seed(ctx, opt->seed + (unsigned int)r);
+        if (ctx_solve(ctx) == 0)
+        {
+            c->feasible_runs++;
+            utility_total += ctx_get_final_schedule(ctx)->utility;
+        }
+        SolverStats st;
+        ctx_get_solver_stats(ctx, &st);
+        if (!st.enabled)
+        {
+            fprintf(stderr, "bench: the gate needs the solver counters, built with SOLVER_STATS=0\n");
+            ctx_destroy(ctx);
+            return -1;
+        }
+        c->labels_created += st.labels_created;
+        c->labels_dominated += st.labels_dominated_incoming + st.labels_dominated_evicted + st.labels_dominated_earlier;
+        c->dssr_iterations += st.dssr_iterations;
+    }
+    c->mean_utility = c->feasible_runs > 0 ? utility_total / c->feasible_runs : 0.0;
+    ctx_destroy(ctx);
+    return 0;
+}
+
+/*  The runs of the gate solved with and without bounding (set_bounding), with the initial SOC of the gate and
+    drawn. A below-bound label still dominates in its cell, so bounding must not change any schedule.
+    Returns the runs whose status, utility, initial SOC or DSSR count differ, -1 if out of memory */
+static int bounding_changes(const Activity *acts, int n, const BenchOptions *opt)
+{
+    SolverContext *ctx[2] = {ctx_create(), ctx_create()};
+    int ret = ctx[0] != NULL && ctx[1] != NULL ? 0 : -1;
+    for (int b = 0; ret == 0 && b < 2; b++)
+    {
+        ctx_set_utility_error_std_dev(ctx[b], opt->error_std_dev);
+        ctx_set_bounding(ctx[b], b);
+    }
+    for (int drawn = 0; ret >= 0 && drawn < 2; drawn++)
+    {
+        for (int r = 0; ret >= 0 && r < opt->runs; r++)
+        {
+            int status[2];
+            for (int b = 0; b < 2; b++)
+            {
+                // each run from the DSSR memory of the file, as a fresh solve of the person
+                if (ctx_set_activities(ctx[b], acts, n) != 0)
+                {
+                    ret = -1;
+                    break;
+                }
+                if (drawn)
+                {
+                    ctx_clear_fixed_initial_soc(ctx[b]);
+                }
+                else
+                {
+                    ctx_set_fixed_initial_soc(ctx[b], opt->initial_soc);
+                }
+                ctx_set_random_seed(ctx[b], opt->seed + (unsigned int)r);
+                status[b] = ctx_solve(ctx[b]);
+            }
+            if (ret < 0)
+            {
+                break;
+            }
+            int same = status[0] == status[1] && ctx_get_count(ctx[0]) == ctx_get_count(ctx[1]) &&
+                       ctx_get_initial_soc(ctx[0]) == ctx_get_initial_soc(ctx[1]) &&
+                       (status[0] != 0 ||
+                        ctx_get_final_schedule(ctx[0])->utility == ctx_get_final_schedule(ctx[1])->utility);
+            ret += !same;
+        }
+    }
+    ctx_destroy(ctx[0]);
+    ctx_destroy(ctx[1]);
+    return ret;
+}
+
+static GoldenEntry *add_golden_entry(Gate *g, const char *path, const GateCounts *c)
+{
+    if (g->n_entries == g->cap_entries)
+    {
+        int cap = g->cap_entries > 0 ? 2 * g->cap_entries : 16;
+        GoldenEntry *grown = (GoldenEntry *)realloc(g->entries, (size_t)cap * sizeof(GoldenEntry));
+        if (grown == NULL)
+        {
+            return NULL;
+        }
+        g->entries = grown;
+        g->cap_entries = cap;
+    }
+    GoldenEntry *e = &g->entries[g->n_entries];
+    e->path = strdup(path);
+    if (e->path == NULL)
+    {
+        return NULL;
+    }
+    e->counts = *c;
+    e->seen = 0;
+    g->n_entries++;
+    return e;
+}
+
+/*  Reads the golden file of g, its settings line overriding the runs, seed, initial SOC and error std dev
+    of opt. Lines: "settings runs seed initial_soc error_std_dev", then per scenario
+    "feasible_runs labels_created labels_dominated dssr_iterations mean_utility path", # for comments */
+static int load_golden(Gate *g, BenchOptions *opt)
+{
+    FILE *fp = fopen(g->file, "r");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "bench: cannot open golden file %s\n", g->file);
+        return -1;
+    }
+    char line[4096];
+    int line_no = 0, ret = 0;
+    while (ret == 0 && fgets(line, sizeof(line), fp) != NULL)
+    {
+        line_no++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '#' || line[0] == '\0')
+        {
+            continue;
+        }
+        GateCounts c;
+        int path_at = 0;
+        if (strncmp(line, "settings ", 9) == 0)
+        {
+            if (sscanf(line + 9, "%d %u %lf %lf", &opt->runs, &opt->seed, &opt->initial_soc, &opt->error_std_dev) != 4)
+            {
+                ret = -1;
+            }
+        }
+        else if (sscanf(line, "%d %ld %ld %ld %lf %n", &c.feasible_runs, &c.labels_created, &c.labels_dominated,
+                        &c.dssr_iterations, &c.mean_utility, &path_at) < 5 ||
+                 path_at == 0 || line[path_at] == '\0')
+        {
+            ret = -1;
+        }
+        else if (add_golden_entry(g, line + path_at, &c) == NULL)
+        {
+            fprintf(stderr, "bench: out of memory\n");
+            ret = -2;
+        }
+        if (ret == -1)
+        {
+            fprintf(stderr, "bench: %s:%d: malformed line\n", g->file, line_no);
+        }
+    }
+    fclose(fp);
+    return ret == 0 ? 0 : -1;
+}
+
+static int write_golden(const Gate *g, const BenchOptions *opt)
+{
+    FILE *fp = fopen(g->file, "w");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "bench: cannot write golden file %s\n", g->file);
+        return -1;
+    }
+    fprintf(fp, "# Golden solver counts of the regression gate (make perf-check), recorded by make perf-golden.\n");
+    fprintf(fp, "# Counts are totals over the runs, run r solved with seed + r.\n");
+    fprintf(fp, "# settings runs seed initial_soc error_std_dev\n");
+    fprintf(fp, "settings %d %u %.17g %.17g\n", opt->runs, opt->seed, opt->initial_soc, opt->error_std_dev);
+    fprintf(fp, "# feasible_runs labels_created labels_dominated dssr_iterations mean_utility path\n");
+    for (int i = 0; i < g->n_entries; i++)
+    {
+        const GateCounts *c = &g->entries[i].counts;
+        fprintf(fp, "%d %ld %ld %ld %.9f %s\n", c->feasible_runs, c->labels_created, c->labels_dominated,
+                c->dssr_iterations, c->mean_utility, g->entries[i].path);
+    }
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+static int count_regressed(long value, long golden, double tolerance)
+{
+    return (double)value > (double)golden * (1.0 + tolerance);
+}
+
+static void print_count(const char *what, long value, long golden, double tolerance)
+{
+    double change = golden > 0 ? (double)(value - golden) / (double)golden : (value > 0 ? 1.0 : 0.0);
+    const char *note = "";
+    if (count_regressed(value, golden, tolerance))
+    {
+        note = "  REGRESSION";
+    }
+    else if (change < -tolerance)
+    {
+        note = "  better, re-record with make perf-golden";
+    }
+    printf("    %-16s %10ld  golden %10ld  %+6.1f%%%s\n", what, value, golden, 100.0 * change, note);
+}
+
+// share of the created labels that were dominated, fewer labels created can mean fewer dominated
+static double dominated_share(const GateCounts *c)
+{
+    return c->labels_created > 0 ? (double)c->labels_dominated / (double)c->labels_created : 0.0;
+}
+
+// a lower share means dominance prunes less
+static int share_regressed(double share, double golden, double tolerance)
+{
+    return share < golden * (1.0 - tolerance);
+}
+
+static void print_share(long dominated, double share, long golden_dominated, double golden_share, double tolerance)
+{
+    const char *note = "";
+    if (share_regressed(share, golden_share, tolerance))
+    {
+        note = "  REGRESSION";
+    }
+    else if (share > golden_share * (1.0 + tolerance))
+    {
+        note = "  better, re-record with make perf-golden";
+    }
+    printf("    %-16s %10ld  golden %10ld  share %5.1f%%, golden %5.1f%%%s\n", "labels_dominated", dominated,
+           golden_dominated, 100.0 * share, 100.0 * golden_share, note);
+}
+
+/* Checks (or records) the counts of one scenario against the golden file */
+static void gate_scenario(const char *path, const Activity *acts, int n, const BenchOptions *opt)
+{
+    Gate *g = opt->gate;
+    GateCounts c;
+    if (count_scenario(acts, n, opt, &c) != 0)
+    {
+        fprintf(stderr, "bench: %s not solved\n", path);
+        g->n_failed++;
+        return;
+    }
+    g->n_checked++;
+    if (g->write)
+    {
+        if (add_golden_entry(g, path, &c) == NULL)
+        {
+            fprintf(stderr, "bench: out of memory\n");
+            g->n_failed++;
+        }
+        printf("recorded %s\n", path);
+        return;
+    }
+
+    GoldenEntry *e = NULL;
+    for (int i = 0; i < g->n_entries && e == NULL; i++)
+    {
+        e = strcmp(g->entries[i].path, path) == 0 ? &g->entries[i] : NULL;
+    }
+    if (e == NULL)
+    {
+        printf("FAIL %s: not in %s\n", path, g->file);
+        g->n_failed++;
+        return;
+    }
+    e->seen = 1;
+
+    // the utility is that of the optimum: a change means other schedules, whatever the counts
+    const GateCounts *gc = &e->counts;
+    double scale = fabs(gc->mean_utility) > 1.0 ? fabs(gc->mean_utility) : 1.0;
+    int changed = c.feasible_runs != gc->feasible_runs || fabs(c.mean_utility - gc->mean_utility) > 1e-6 * scale;
+    double share = dominated_share(&c);
+    double golden_share = dominated_share(gc);
+    int bounded = bounding_changes(acts, n, opt);
+    int failed = changed || bounded != 0 || count_regressed(c.labels_created, gc->labels_created, g->tolerance) ||
+                 share_regressed(share, golden_share, g->tolerance) ||
+                 count_regressed(c.dssr_iterations, gc->dssr_iterations, g->tolerance);
+    g->n_failed += failed;
+
+    printf("%s %s\n", failed ? "FAIL" : "ok  ", path);
+    print_count("labels_created", c.labels_created, gc->labels_created, g->tolerance);
+    print_share(c.labels_dominated, share, gc->labels_dominated, golden_share, g->tolerance);
+    print_count("dssr_iterations", c.dssr_iterations, gc->dssr_iterations, g->tolerance);
+    printf("    %-16s %10d  golden %10d\n", "feasible_runs", c.feasible_runs, gc->feasible_runs);
+    printf("    %-16s %10.6f  golden %10.6f%s\n", "mean_utility", c.mean_utility, gc->mean_utility,
+           changed ? "  CHANGED" : "");
+    if (bounded < 0)
+    {
+        printf("    %-16s out of memory\n", "bounding");
+    }
+    else
+    {
+        printf("    %-16s %10d  of %d runs changed by it%s\n", "bounding", bounded, 2 * opt->runs,
+               bounded > 0 ? "  CHANGED" : "");
+    }
+}
+
+/*  Ends the gate: writes the golden file, or reports the golden scenarios that were not solved (a gate
+    over fewer files than recorded fails too). Returns the exit status */
+static int finish_gate(Gate *g, const BenchOptions *opt)
+{
+    int status = 0;
+    if (g->write)
+    {
+        if (g->n_failed > 0 || write_golden(g, opt) != 0)
+        {
+            status = 1;
+        }
+        else
+        {
+            printf("%d scenarios recorded in %s\n", g->n_entries, g->file);
+        }
+    }
+    else
+    {
+        for (int i = 0; i < g->n_entries; i++)
+        {
+            if (!g->entries[i].seen)
+            {
+                printf("FAIL %s: recorded in %s but not solved\n", g->entries[i].path, g->file);
+                g->n_failed++;
+            }
+        }
+        printf("%d scenarios checked against %s (tolerance %.1f%%), %d failed\n", g->n_checked, g->file,
+               100.0 * g->tolerance, g->n_failed);
+        status = g->n_failed > 0 || g->n_checked == 0;
+    }
+    for (int i = 0; i < g->n_entries; i++)
+    {
+        free(g->entries[i].path);
+    }
+    free(g->entries);
+    return status;
+}
+
+static int has_csv_suffix(const char *name)
+{
+    size_t len = strlen(name);
+    return len > 4 && strcmp(name + len - 4, ".csv") == 0;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void bench_file(const char *path, const BenchOptions *opt, int *first)
+{
+    ActivityTable table;
+    if (load_activity_csv(path, &table) != 0)
+    {
+        return;
+    }
+    if (opt->gate != NULL)
+    {
+        gate_scenario(path, table.activities, table.n_activities, opt);
+    }
+    else
+    {
+        bench_scenario(path, "csv", table.activities, table.n_activities, opt, opt->runs, *first);
+        *first = 0;
+    }
+    free_activity_table(&table);
+}
+
+// benchmarks a CSV file, or every CSV file of a directory in name order
+static void bench_path(const char *path, const BenchOptions *opt, int *first)
+{
+    struct stat sb;
+    if (stat(path, &sb) != 0 || !S_ISDIR(sb.st_mode))
+    {
+        bench_file(path, opt, first);
+        return;
+    }
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+    {
+        fprintf(stderr, "bench: cannot open %s\n", path);
+        return;
+    }
+    char **names = NULL;
+    int n = 0, cap = 0;
+    struct dirent *e;
+    while ((e = readdir(dir)) != NULL)
+    {
+        if (!has_csv_suffix(e->d_name))
+        {
+            continue;
+        }
+        if (n == cap)
+        {
+            cap = cap > 0 ? 2 * cap : 16;
+            char **grown = (char **)realloc(names, (size_t)cap * sizeof(char *));
+            if (grown == NULL)
+            {
+                break;
+            }
+            names = grown;
+        }
+        size_t len = strlen(path) + strlen(e->d_name) + 2;
+        names[n] = (char *)malloc(len);
+        if (names[n] != NULL)
+        {
+            snprintf(names[n++], len, "%s/%s", path, e->d_name);
+        }
+    }
+    closedir(dir);
+    qsort(names, (size_t)n, sizeof(char *), compare_names);
+    for (int i = 0; i < n; i++)
+    {
+        bench_file(names[i], opt, first);
+        free(names[i]);
+    }
+    free(names);
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions opt = {.runs = 20, .synthetic_runs = 5, .initial_soc = 0.5, .error_std_dev = 1.0, .seed = 42};
+    const char *sizes = "50,100,200";
+    Gate gate = {.tolerance = 0.02};
+    int c;
+    while ((c = getopt(argc, argv, "r:R:s:e:S:g:c:b:G:W:t:")) != -1)
+    {
+        switch (c)
+        {
+        case 'r':
+            opt.runs = atoi(optarg);
+            break;
+        case 'R':
+            opt.synthetic_runs = atoi(optarg);
+            break;
+        case 's':
+            opt.initial_soc = atof(optarg);
+            break;
+        case 'e':
+            opt.error_std_dev = atof(optarg);
+            break;
+        case 'S':
+            opt.seed = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+        case 'g':
+            sizes = optarg;
+            break;
+        case 'c':
+            if (sscanf(optarg, "%d,%d", &opt.coarse_factor, &opt.corridor) < 1)
+            {
+                opt.coarse_factor = 0;
+            }
+            break;
+        case 'b':
+            sscanf(optarg, "%d,%ld,%lf", &opt.beam_width, &opt.max_live_labels, &opt.deadline);
+            break;
+        case 'G':
+        case 'W':
+            gate.file = optarg;
+            gate.write = c == 'W';
+            opt.gate = &gate;
+            break;
+        case 't':
+            gate.tolerance = atof(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-r runs] [-R synthetic_runs] [-s initial_soc] [-e error_std_dev] [-S seed] [-g sizes] [-c factor,corridor] [-b beam_width,max_live_labels,deadline] [csv files or directories...]\n", argv[0]);
+            fprintf(stderr, "       %s -G golden_file | -W golden_file [-t tolerance] [-r runs] [-s initial_soc] [-e error_std_dev] [-S seed] [csv files or directories...]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (opt.runs < 1)
+    {
+        opt.runs = 1;
+    }
+    if (opt.synthetic_runs < 1)
+    {
+        opt.synthetic_runs = 1;
+    }
+
+    set_general_parameters(BENCH_HORIZON, BENCH_SPEED, BENCH_TRAVEL_TIME_PENALTY, BENCH_TIME_INTERVAL,
+                           asc, early, late, longp, shortp);
+
+    if (opt.gate != NULL)
+    {
+        if (!gate.write && load_golden(&gate, &opt) != 0)
+        {
+            return 2;
+        }
+        int first = 1;
+        for (int i = optind; i < argc; i++)
+        {
+            bench_path(argv[i], &opt, &first);
+        }
+        return finish_gate(&gate, &opt);
+    }
+
+    printf("{\"runs_per_scenario\": %d, \"runs_per_synthetic_scenario\": %d, \"seed\": %u, \"initial_soc\": %.3f, \"utility_error_std_dev\": %.3f,\n",
+           opt.runs, opt.synthetic_runs, opt.seed, opt.initial_soc, opt.error_std_dev);
+    printf(" \"scenarios\": [");
+    int first = 1;
+    for (int i = optind; i < argc; i++)
+    {
+        bench_path(argv[i], &opt, &first);
+    }
+
+    for (const char *s = sizes; *s != '\0';)
+    {
+        int n_candidates = atoi(s);
+        if (n_candidates > 0)
+        {
+            int n = 0;
+            Activity *acts = synthetic_activities(n_candidates, opt.seed, &n);
+            if (acts != NULL)
+            {
+                char name[32];
+                snprintf(name, sizeof(name), "synthetic_%d", n_candidates);
+                bench_scenario(name, "synthetic", acts, n, &opt, opt.synthetic_runs, first);
+                first = 0;
+                free(acts);
+            }
+        }
+        s += strcspn(s, ",");
+        s += *s == ',';
+    }
+    printf("\n ],\n \"peak_rss_kb\": %ld}\n", peak_rss_kb());
+    return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef ACTIVITY_CSV_H
+#define ACTIVITY_CSV_H
+
+#include <stddef.h>
+#include "scheduling.h"
+
+/////////////////////////////////////////////////////////////
+/////////////////////// ACTIVITY FILES ///////////////////////
+/////////////////////////////////////////////////////////////
+
+// Activities read from a CSV of testing_latest: one row per activity, columns named after the
+// Activity fields plus act_type, in any order. The file is mapped, not copied: the act_type of
+// each row points into the mapping and stays valid until free_activity_table().
+typedef struct ActivityTable
+{
+    Activity *activities; // indexed by id, dawn first and dusk last, ready for set_activities()
+    int n_activities;
+    const char **act_type; // act_type of activity i, NOT nul terminated, act_type_len[i] bytes
+    int *act_type_len;
+
+    void *map; // the mapped file
+    size_t map_size;
+} ActivityTable;
+
+int load_activity_csv(const char *path, ActivityTable *table);
+void free_activity_table(ActivityTable *table);
+
+#endif // ACTIVITY_CSV_H
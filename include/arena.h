@@ -0,0 +1,33 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/////////////////////////////////////////////////////////////
+///////////////////////// SLAB POOLS /////////////////////////
+/////////////////////////////////////////////////////////////
+
+// Fixed-size object pool used for labels.
+// Objects are bump-allocated out of large slabs. Released objects go on a free list and are
+// handed out again before the pool bumps further. pool_reset() forgets every object in O(1)
+// but keeps the slabs, so the next DSSR pass (or the next person) reuses the same memory.
+typedef struct Pool Pool;
+struct Pool
+{
+    size_t elem_size; // bytes per object, rounded up to pointer alignment
+    size_t per_slab;  // objects per slab
+    char **slabs;     // slabs allocated so far, kept across resets
+    int n_slabs;
+    int cap_slabs;
+    int current;      // slab currently being bumped
+    size_t used;      // objects handed out from the current slab
+    void *free_list;  // released objects, reused first
+};
+
+void pool_init(Pool *p, size_t elem_size, size_t per_slab);
+void *pool_alloc(Pool *p);
+void pool_release(Pool *p, void *elem);
+void pool_reset(Pool *p);
+void pool_destroy(Pool *p);
+
+#endif // ARENA_H
@@ -0,0 +1,7 @@
+#ifndef CLI_H
+#define CLI_H
+
+// Command line driver of bin/scheduling, see cli.c. Returns the process exit status
+int cli_main(int argc, char *argv[]);
+
+#endif // CLI_H
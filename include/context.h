@@ -0,0 +1,234 @@
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#include <stdint.h>
+#include "scheduling.h"
+#include "arena.h"
+
+// Solver counters (see SolverStats), on unless built with -DSOLVER_STATS=0
+#ifndef SOLVER_STATS
+#define SOLVER_STATS 1
+#endif
+
+#if SOLVER_STATS
+#define STAT_ADD(ctx, field, n) ((ctx)->stats.field += (n))
+#else
+#define STAT_ADD(ctx, field, n) ((void)0)
+#endif
+
+// Reasons a move is left out of the successor lists, see static_rejection() in scheduling.c
+enum
+{
+    STATIC_FEASIBLE = 0,
+    STATIC_REJECT_TIME_WINDOW,
+    STATIC_REJECT_HORIZON,
+    STATIC_REJECT_OTHER,
+    N_STATIC_REJECT = STATIC_REJECT_OTHER
+};
+
+// charge modes: 0 none, 1 slow, 2 fast, 3 rapid, 4 to 6 free slow, fast and rapid
+#define N_CHARGE_MODES 7
+
+// Labels that entered one activity at the intervals walked so far by the DP pass, as a Pareto set
+// by decreasing utility (DOMINANCE_ACROSS_TIME). Only utility, memory and resource keys are kept
+typedef struct ArrivalFrontier
+{
+    int n;
+    int cap;
+    double *utility;
+    Group_set *mem;
+    double *soc_key;
+    double *cost_key;
+} ArrivalFrontier;
+
+// A successor of a bucket row not inserted yet, see expand_row(): a stay when moved is NULL, its state in next,
+// else the label of a move to another activity
+typedef struct Candidate
+{
+    Label next;
+    Label *moved;
+} Candidate;
+
+/////////////////////////////////////////////////////////////
+/////////////////////// SOLVER CONTEXT ///////////////////////
+/////////////////////////////////////////////////////////////
+
+// Everything one solve reads or writes. Callers only see the opaque typedef in scheduling.h,
+// this definition is shared by the library sources. Two contexts never share mutable state,
+// so different threads can each solve with their own context.
+struct SolverContext
+{
+    SolverParams p; // model parameters, as given to ctx_set_params()
+
+    // derived from the parameters (see initialize_charge_rates/initialise_tou_times_intervals)
+    double slow_charge_rate; // fraction of battery charged per time interval
+    double fast_charge_rate;
+    double rapid_charge_rate;
+    int peak_start_interval;
+    int peak_end_interval;
+    int midpeak1_start_interval;
+    int midpeak1_end_interval;
+    int midpeak2_start_interval;
+    int midpeak2_end_interval;
+
+    // charging per charge mode, see build_charge_tables()
+    double charge_rate_by_mode[N_CHARGE_MODES]; // fraction of battery charged per interval
+    double *charge_price; // [mode * charge_horizon + t]: price per kWh when the charging activity starts in interval t, TOU factor included
+    int charge_horizon;
+    double *charge_tariff; // [mode * charge_horizon + t], price per kWh loaded by ctx_set_charge_tariff() for the modes in tariff_modes
+    unsigned int tariff_modes; // bit m set: mode m uses charge_tariff instead of its flat price x TOU factor
+
+    // activities, copied so that DSSR can write the group memory without touching the caller's array
+    Activity *activities;
+    int max_num_activities;
+    int activities_cap;
+
+    // travel tables [from * travel_n + to] between locations: travel time in intervals and SOC consumed.
+    // The variants of a place (charge mode, charging or not) share its location, see build_locations()
+    int *travel_intervals;
+    double *travel_soc;
+    int travel_n;  // locations
+    int *location; // [activity id]: row and column of the activity in the travel tables, owned by each context
+    int location_cap;
+    int travel_skim_loaded; // 1 if the tables come from ctx_set_travel_skim()
+
+    // successor lists per (activity, time interval), see build_successor_lists()
+    int *succ_offsets;
+    int *succ_list;
+    int succ_cap;
+    int succ_valid; // 0 once the activities, travel tables or horizon change
+    int *succ_rejects; // SOLVER_STATS: per (activity, time interval), moves the list leaves out, by STATIC_REJECT_* reason
+    int shared_tables; // 1 if the travel tables and successor lists belong to another context (ctx_create_sharing)
+
+    // label storage
+    L_list **bucket;
+    int bucket_rows;
+    int bucket_cols;
+    int bucket_window;  // 0: one row per time interval, else the rows are a ring of that many times and a dusk row (see bucket_row)
+    int sliding_bucket; // ctx_set_sliding_bucket()
+    uint64_t *active;  // [row * active_words + act / 64]: bit act % 64 set if the cell may hold rows, clear if it is empty
+    int active_words;  // words per time row
+    Pool label_pool;
+    long live_labels; // labels handed out by label_pool and not released, counted without SOLVER_STATS too
+
+    // utility error terms, drawn at the start of each DP() run (see draw_utility_error_terms_for_dp)
+    // unless reuse_draws is set: then the error terms and the initial SOC of the previous pass are kept
+    double utility_error_std_dev;
+    double *eps_participation;
+    double *eps_start_time;
+    double *eps_duration;
+    double *eps_travel;
+    double *eps_charging;
+    int eps_n;
+    int reuse_draws;
+
+    // initial SOC and random numbers
+    int fixed_initial_soc_enabled;
+    double fixed_initial_soc_value;
+    double initial_soc;
+    unsigned int seed;
+    int rng_seeded;
+    unsigned short rng_state[3]; // erand48() state, same sequence as srand48(seed)/drand48()
+    int rng;                     // RNG_* (ctx_set_rng)
+    unsigned int random_stream;  // RNG_PHILOX: second word of the key, the person
+    unsigned int draw_id;        // RNG_PHILOX: DP passes that drew since the seed or stream was set
+
+    // DSSR: in incremental mode each pass only rebuilds the cells from dirty_from on (see dp_from)
+    int incremental_dssr;
+    int dirty_from; // earliest time a label can enter an activity whose memory changed, horizon if none
+
+    // completion bounds (see build_completion_bounds): labels whose utility plus the bound of their cell cannot
+    // reach the incumbent are not inserted
+    int bounding;
+    double *completion_bound; // [act * horizon + h]: most utility a label at (act, h) can still gain, -INFINITY if dusk is out of reach
+    size_t bound_cap;
+    int bounds_ready; // completion_bound holds for the current solve and error terms
+    double incumbent; // best utility of a dusk label of the current DP pass, -INFINITY if none yet
+
+    // dominance resources besides utility and group memory (see ctx_set_dominance), DOMINANCE_* flags
+    int dominance;
+    double soc_epsilon;  // SOC compared on a grid of this step, exactly if 0
+    double cost_epsilon; // same for the cumulative charging cost
+    ArrivalFrontier *frontier; // per activity, DOMINANCE_ACROSS_TIME only
+    int frontier_n;            // frontiers allocated
+
+    // expansion of the rows of one time interval (see ctx_set_expansion_threads)
+    int expansion_threads;
+    Candidate *candidates; // successors of the row being expanded serially
+    int candidates_cap;
+    Pool *expand_pools;    // labels made by the expansion threads, reset and freed with label_pool
+    int n_expand_pools;
+
+    // budgets of a solve (see ctx_set_budget), 0 for no limit
+    int beam_width;       // rows a cell keeps, those of highest utility
+    long max_live_labels; // live labels from which a pass only moves to dusk
+    double deadline;      // wall clock seconds per solve
+    double deadline_at;   // wall_seconds() at which the current solve stops, 0 without deadline
+    int closing;          // the DP pass reached max_live_labels, only the moves to dusk are inserted
+    Label *kept_schedule; // with a deadline: copy of the best schedule without group cycle of the earlier passes,
+    int n_kept_schedule;  // n_kept_schedule labels from dawn, the last one is its dusk label
+    int kept_schedule_cap;
+    unsigned int solve_status; // SOLVE_* flags of the last solve
+
+    // results of the last ctx_solve()
+    int DSSR_count;
+    DSSRIterationStats *iteration_stats; // one per DP pass
+    int n_iteration_stats;
+    int iteration_stats_cap;
+    SolverStats stats; // counters, reset by ctx_solve()
+    double total_time;
+    Label *final_schedule;
+};
+
+// Context behind the process-wide API (set_general_parameters, set_activities, main, ...)
+SolverContext *global_context(void);
+
+// Draw-independent tables: build them once, then let other contexts read them
+int ctx_prepare(SolverContext *ctx);
+SolverContext *ctx_create_sharing(const SolverContext *src);
+void ctx_copy_settings(SolverContext *ctx, const SolverContext *src);
+
+// Algorithm steps on a context, the global DP()/DSSR() wrap these
+void ctx_dp(SolverContext *ctx);
+int ctx_dssr(SolverContext *ctx, Label *L);
+
+// index of the lowest set bit of a nonzero word
+static inline int lowest_bit(uint64_t bits)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(bits);
+#else
+    int i = 0;
+    while (!(bits & 1))
+    {
+        bits >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+/*  Row of the bucket holding the cells of time t. On the dense grid it is t, with a sliding bucket the times
+    before the end of the horizon share the ring rows t % bucket_window and the last row holds the end of the
+    horizon (dusk). A label at h only goes to h + 1 up to h + 1 + the longest travel time, or to dusk */
+static inline int bucket_row(const SolverContext *ctx, int t)
+{
+    if (ctx->bucket_window == 0)
+    {
+        return t;
+    }
+    return t >= ctx->p.horizon - 1 ? ctx->bucket_window : t % ctx->bucket_window;
+}
+
+static inline L_list *bucket_cell(SolverContext *ctx, int t, int act)
+{
+    return &ctx->bucket[bucket_row(ctx, t)][act];
+}
+
+// marks cell [t][act] as holding rows, the DP sweep only walks marked cells
+static inline void mark_active(SolverContext *ctx, int t, int act)
+{
+    ctx->active[bucket_row(ctx, t) * ctx->active_words + act / 64] |= (uint64_t)1 << (act % 64);
+}
+
+#endif // CONTEXT_H
@@ -0,0 +1,66 @@
+#ifndef POPULATION_H
+#define POPULATION_H
+
+#include "scheduling.h"
+
+/////////////////////////////////////////////////////////////
+//////////////////////// POPULATION /////////////////////////
+/////////////////////////////////////////////////////////////
+
+// One person of a batch: its activity set (dawn first, dusk last, as for set_activities)
+typedef struct Person
+{
+    Activity *activities;
+    int n_activities;
+    double initial_soc; // fixed initial SOC, or < 0 to draw it from N(initial_soc_mean, initial_soc_std_dev)
+    unsigned int seed;  // seed of the person's random draws, so results do not depend on the thread that solves it
+} Person;
+
+// Result of one person, rows are owned by the result (see free_population_results)
+typedef struct PersonResult
+{
+    int status;       // 0 if a schedule was found, -1 otherwise
+    int DSSR_count;
+    double utility;
+    double initial_soc;
+    double total_time;
+    SolverStats stats; // counters of the person's solve, see ctx_get_solver_stats()
+    ScheduleRow *rows; // the visits of the schedule, see ctx_export_schedule()
+    int n_rows;
+} PersonResult;
+
+// Result of one draw of solve_draws(), its visits are rows[first_row .. first_row + n_rows - 1]
+typedef struct DrawResult
+{
+    int status; // 0 if a schedule was found, -1 otherwise
+    int DSSR_count;
+    int first_row;
+    int n_rows;
+    unsigned int seed; // seed of the draw's error terms (and initial SOC unless it is fixed)
+    double utility;
+    double initial_soc;
+    double total_time; // CPU seconds
+} DrawResult;
+
+// Result of solve_draws(): one DrawResult per seed and the visits of all draws back to back, in seed order.
+// Both arrays are allocated by the solver, see free_draw_results()
+typedef struct MultiDrawResult
+{
+    DrawResult *draws;
+    int n_draws;
+    ScheduleRow *rows;
+    int n_rows;
+} MultiDrawResult;
+
+// dump file of solve_population_to_file(), see schedule_writer.h
+typedef struct ScheduleWriter ScheduleWriter;
+
+int solve_population(const Person *persons, int n_persons, int n_threads, PersonResult *results);
+int solve_population_to_file(const Person *persons, int n_persons, int n_threads, ScheduleWriter *writer);
+void free_population_results(PersonResult *results, int n_persons);
+
+int ctx_solve_draws(SolverContext *ctx, const unsigned int *seeds, int n_draws, int n_threads, MultiDrawResult *results);
+int solve_draws(const unsigned int *seeds, int n_draws, int n_threads, MultiDrawResult *results);
+void free_draw_results(MultiDrawResult *results);
+
+#endif // POPULATION_H
@@ -0,0 +1,89 @@
+#ifndef SCHEDULE_WRITER_H
+#define SCHEDULE_WRITER_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <stdio.h>
+#include "population.h"
+
+/////////////////////////////////////////////////////////////
+/////////////////////// SCHEDULE DUMPS //////////////////////
+/////////////////////////////////////////////////////////////
+
+/*  Binary columnar dump of the schedules of a population, written append-only in batches of persons.
+    All integers and doubles are in the byte order of the writer, given by byte_order; every column
+    starts on 8 bytes (the previous one is padded with zeros), so a mapped file can be read in place.
+
+    header     "EVSCHED1"        8 bytes
+               u32 version       SCHEDULE_DUMP_VERSION
+               u32 byte_order    0x01020304 as written
+    batch *    "EVSBATCH"        8 bytes
+               u32 n_persons
+               u32 n_rows
+               u64 size          of the whole batch, header included: the next batch starts there
+               person columns, n_persons values each:
+                 u32 person      id of the person, see solve_population_to_file()
+                 i32 status      0 if a schedule was found, -1 otherwise
+                 i32 dssr_count
+                 u32 first_row   first row of the person in this batch
+                 u32 n_rows      rows of the person: first_row .. first_row + n_rows - 1
+                 f64 utility
+                 f64 initial_soc
+               row columns, n_rows values each, the ScheduleRow fields (see ctx_export_schedule()):
+                 i32 act_id, i32 start_time, i32 duration, i32 charge_duration,
+                 f64 soc_start, f64 soc_end, f64 charge_cost, f64 utility
+    index      "EVSINDEX"        8 bytes, written by schedule_writer_close()
+               u64 n_batches, u64 n_persons, u64 n_rows
+               u64 offset        of each batch in the file, n_batches values
+    trailer    u64 offset        of the index
+               "EVSCHEND"        8 bytes
+
+    Persons are stored in the order their batches were flushed, not by id. A file without its trailer
+    (the writer did not finish) is read by walking the batches from the header with their size. */
+
+#define SCHEDULE_DUMP_VERSION 1
+
+// The file of a dump, shared by the threads writing to it
+typedef struct ScheduleWriter
+{
+    FILE *fp;
+    pthread_mutex_t lock;
+    int batch_persons;   // persons per batch, see schedule_batch_add()
+    uint64_t offset;     // end of the file so far
+    uint64_t *batches;   // offset of each batch written
+    uint64_t n_batches;
+    uint64_t cap_batches;
+    uint64_t n_persons;  // persons written
+    uint64_t n_rows;
+    unsigned int next_id; // first id of the next solve_population_to_file()
+    int error;            // set once a batch could not be added or written
+} ScheduleWriter;
+
+// Persons waiting to be written, one per writing thread
+typedef struct ScheduleBatch
+{
+    ScheduleWriter *writer;
+    uint32_t *person;
+    int32_t *status;
+    int32_t *dssr_count;
+    uint32_t *first_row;
+    uint32_t *n_person_rows;
+    double *utility;
+    double *initial_soc;
+    int n_persons;
+    ScheduleRow *rows;
+    int n_rows;
+    int cap_rows;
+    unsigned char *buf; // the columns of a batch as they are written
+    size_t cap_buf;
+} ScheduleBatch;
+
+ScheduleWriter *schedule_writer_open(const char *path, int batch_persons);
+int schedule_writer_close(ScheduleWriter *w);
+
+int schedule_batch_init(ScheduleBatch *b, ScheduleWriter *w);
+int schedule_batch_add(ScheduleBatch *b, unsigned int person, const PersonResult *res);
+int schedule_batch_flush(ScheduleBatch *b);
+void schedule_batch_free(ScheduleBatch *b);
+
+#endif // SCHEDULE_WRITER_H
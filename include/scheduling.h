@@ -10,15 +10,27 @@
 ///////////////////////// STRUCTS ////////////////////////////
 /////////////////////////////////////////////////////////////
 
-typedef struct Group_mem Group_mem;
-// doubly linked list structure, for retaining the current, previous, and next groups of an activity
-// necessary for the DSSR functionality
-struct Group_mem
-{
-    int g;
-    Group_mem *previous;
-    Group_mem *next;
-};
+// set of activity groups, one bit per group (bit g <=> group g), for the DSSR functionality
+// groups are capped by the utility parameter arrays (asc_parameters[9]), well inside the 32 bits
+typedef unsigned int Group_set;
+#define GROUP_BIT(g) (1u << (g))
+
+// label resources dominance can compare besides utility and group memory, see set_dominance()
+#define DOMINANCE_SOC 1u         // more battery left is better
+#define DOMINANCE_CHARGE_COST 2u // less spent on charging is better
+#define DOMINANCE_ACROSS_TIME 4u // also against the labels that entered the activity earlier, approximate
+
+// random number generators of the error terms and initial SOC, see set_rng()
+#define RNG_ERAND48 0 // one erand48() sequence per context, each draw continues it
+#define RNG_PHILOX 1  // counter-based: a draw is a function of (seed, stream, draw id, term index)
+
+// what cut the search of the last solve, see set_budget() and get_solve_status(); 0 if the schedule is optimal
+#define SOLVE_OPTIMAL 0
+#define SOLVE_BEAM 1u      // a full cell dropped labels beyond the beam width
+#define SOLVE_LABEL_CAP 2u // the live labels reached the cap, the pass then only moved to dusk
+#define SOLVE_DEADLINE 4u  // the deadline passed: best schedule without group cycle found so far
+#define SOLVE_CORRIDOR 8u  // coarse to fine, only the corridor of the coarse schedule was searched
+#define SOLVE_NO_SCHEDULE 16u // the deadline passed before any schedule without group cycle, the solve failed
 
 typedef struct Activity
 // id encompasses unique combo of type, charging mode, and location!!!!
@@ -31,7 +43,7 @@ typedef struct Activity
     double x;
     double y;
     int group; // this is the activity type
-    Group_mem *memory;
+    Group_set memory; // groups added to this activity by DSSR, intersected with the label memory on entry
     int des_duration;   // expressed in # of time intervals
     int des_start_time; // expressed in # of time intervals
 
@@ -47,53 +59,208 @@ typedef struct Activity
 // want to expand to pick the optimal, not just fastest in the future
 
 typedef struct Label Label; // holds data about a particular state or decision at a certain step in the process
+// Kept to one cache line (64 bytes): the doubles, the back pointer, then the memory and 16 bit counters
+// (see LABEL_FIELD_MAX). The activity is ctx->activities[act_id]. Every field is read by the DP or by
+// the schedule extraction, testing_check.py mirrors the layout
 struct Label
 {
-    int act_id;     // unique activity identifier (faster than L->act->id)
-    int time;       // current time in number of intervals since dawn
-    int start_time; // lets you compute the start time penalty (early/late) and check the activity's time window
-    // ^^ feeds the cost update when you enter a *new* activity
-    int duration; // time since the start of current activity in minutes
-    //  ^^ lets you check min/max duration constraint & compute the duration penalty (short/long)
-    // for the activity that just finished when you switch to the next activity (see update_utility)
-    int deviation_start;
-    int deviation_dur;
-    // ^^ running sums of absolute deviations from desired start time/duration
-    // they are book-keeping/diagnostic features and could be used in dominance rules
-    // They are not the objective, the real penalties are added inside update_utility
+    double utility; // cumulative utility
 
     double soc_at_activity_start; // battery state of charge at the start of activity 𝑎
     double current_soc;           // battery state in activity - relevant for charging activities
-    // double delta_soc_during_interval; // SOC increase during this charging time, if occurring
-    // double total_delta_soc;
-    // double soc; // check this - might be parsed from individual data
-    double delta_soc; // amount of battery charge increase at a single interval, expressed as % of battery capacity i.e. SOC
-
-    int charge_duration; // cumulative time spent charging at current activity (resets to zero when move to new activity)
-
-    // double wasted_charger_time;
     double charge_cost_at_activity_start; // cumulative charge cost at the start of activity 𝑎
     double current_charge_cost; // cumulative charging cost up to end of current interval
 
-    double utility; // cumulative utility
+    Label *previous; // back pointer to prev label
 
-    Group_mem *mem; // pointer to a linked list of visited groups
+    Group_set mem; // bitset of visited groups
     // the label's resource that encodes "what has already been done" at the group level
     // this is the implementation of R - set of activities/groups that are no longer feasible
     // no longer feasible to re-choose because of elementarity/policy rules
-    Label *previous; // back pointer to prev label
-    Activity *act;   // every feasibility check and cost update needs this metadata
+
+    short act_id;     // unique activity identifier, every feasibility check and cost update reads ctx->activities[act_id]
+    short time;       // current time in number of intervals since dawn
+    short start_time; // lets you compute the start time penalty (early/late) and check the activity's time window
+    // ^^ feeds the cost update when you enter a *new* activity
+    short duration; // time since the start of current activity in intervals
+    //  ^^ lets you check min/max duration constraint & compute the duration penalty (short/long)
+    // for the activity that just finished when you switch to the next activity (see update_utility)
+    short charge_duration; // cumulative time spent charging at current activity (resets to zero when move to new activity)
 };
 
-// Label_List
+// largest horizon, and activity count, the 16 bit fields of a Label can hold
+#define LABEL_FIELD_MAX 32767
+
+// What changes while staying at an activity, relative to the label that entered it.
+// Stays are kept as bucket rows instead of one Label per interval (stay compression):
+// a row's label is the one that entered the activity, with time = the row's cell and the fields below.
+typedef struct StayState
+{
+    double current_soc;
+    double current_charge_cost;
+    int duration;
+    int charge_duration;
+} StayState;
+
+// Label_List: the labels of one bucket cell [time][activity]
+// stored as columns so that the dominance scan runs over packed arrays,
+// row i is (utility[i], mem[i], element[i], stay[i]). Removing a row moves the last row into its place.
+// the rows live in one block starting at utility, the labels themselves in the label pool
+// With dominance resources (set_dominance) the rows are kept by decreasing utility instead, with their resource
+// keys and a skyline of the primary key (SOC, or minus the cost without DOMINANCE_SOC) to narrow the scans
 typedef struct L_list L_list;
 struct L_list
 {
-    Label *element;
-    L_list *previous;
-    L_list *next;
+    int n;   // number of labels in the cell
+    int cap; // rows allocated
+    double *utility;
+    Group_set *mem;
+    Label **element;
+    StayState *stay;
+    double *soc_key;  // SOC on the epsilon grid
+    double *cost_key; // charging cost on the epsilon grid
+    double *key_max;  // largest primary key of rows 0 .. i
+    double *key_min;  // smallest primary key of rows i .. n - 1
 };
 
+// One visit of a schedule, flattened out of the label chain (see ctx_export_schedule)
+// plain ints then doubles with no padding (48 bytes), so an array of rows maps onto a NumPy structured dtype
+typedef struct ScheduleRow
+{
+    int act_id;
+    int start_time;      // in intervals
+    int duration;        // in intervals
+    int charge_duration; // intervals spent charging during the visit
+    double soc_start;    // SOC when the visit starts
+    double soc_end;      // SOC when it ends
+    double charge_cost;  // cumulative charging cost at the end of the visit
+    double utility;      // cumulative utility at the end of the visit
+} ScheduleRow;
+
+// One day of a multi-day run: its activity set, dawn first and dusk last as for set_activities().
+// Consecutive days may share the same array, the travel tables are then kept from one day to the next
+typedef struct Day
+{
+    Activity *activities;
+    int n_activities;
+} Day;
+
+// Result of one day of solve_multiday(), its visits are rows[first_row .. first_row + n_rows - 1]
+typedef struct DayResult
+{
+    int status; // 0 if a schedule was found, -1 otherwise
+    int DSSR_count;
+    int first_row;
+    int n_rows;
+    double utility;
+    double initial_soc; // SOC at dawn
+    double final_soc;   // SOC at dusk, the dawn SOC of the next day
+    double total_time;  // CPU seconds
+} DayResult;
+
+// Flat result of solve_multiday(): one DayResult per day and the visits of all days back to back.
+// Both arrays are allocated by the solver, see free_multiday_result()
+typedef struct MultiDayResult
+{
+    DayResult *days;
+    int n_days;
+    ScheduleRow *rows;
+    int n_rows;
+} MultiDayResult;
+
+// Work done by one DP pass of a solve: pass 0 is the first DP, pass i the one after the i-th DSSR update
+typedef struct DSSRIterationStats
+{
+    int from_time;         // first time interval rebuilt, 0 for a full pass
+    long labels_generated; // labels created by the pass, stays included
+    long rows_kept;        // rows of the cells before from_time, kept from the previous pass
+    long rows_at_end;      // rows in the bucket once the pass is done
+    double time;           // CPU seconds
+    double wall_time;      // elapsed seconds
+} DSSRIterationStats;
+
+// Counters of the last solve of a context, see ctx_get_solver_stats().
+// Built with -DSOLVER_STATS=0 the hot path counts nothing: enabled is 0 and only the fields marked
+// (always) are filled. Each context counts on its own, so threads solving in parallel never share them.
+typedef struct SolverStats
+{
+    int enabled;
+
+    long labels_created;            // moves and stays generated by the DP
+    long labels_dominated_incoming; // new labels dropped because a row of their cell dominates them
+    long labels_dominated_evicted;  // rows removed from their cell by a new label that dominates them
+    long labels_dominated_earlier;  // labels dropped because one that entered their activity earlier dominates them
+    long peak_live_labels;          // most labels held at once by the label pool
+
+    // moves refused by is_feasible(), or beforehand by the successor lists for the static reasons
+    long rejected_time_window;  // earliest/latest start of the next activity
+    long rejected_horizon;      // not enough time left to do it and reach dusk
+    long rejected_soc;          // battery would be empty on arrival
+    long rejected_group_memory; // group already done (DSSR memory)
+    long rejected_min_duration; // current activity not done for its min duration yet
+    long rejected_max_duration; // stay longer than the max duration
+    long rejected_other;        // back to the previous activity, charging rules, dawn/dusk
+    long pruned_by_bound;       // rows not expanded because their completion bound cannot reach the incumbent (set_bounding)
+    long pruned_by_beam;        // labels dropped by a full cell, or evicted from it, for the beam width (set_budget)
+    long pruned_by_label_cap;   // moves not to dusk dropped once the live labels reached the cap (set_budget)
+
+    int max_cell_occupancy; // most rows ever held by one bucket cell
+
+    int dssr_iterations;    // (always) as get_count(), per pass work in ctx_get_dssr_iteration_stats()
+    double wall_time;       // (always) elapsed seconds of the solve
+    size_t bytes_allocated; // (always) heap held by the context: bucket, label slabs, tables
+} SolverStats;
+
+// Model parameters of one solve, see the globals below for their meaning and units.
+// get_general_parameters() fills one from the current globals.
+typedef struct SolverParams
+{
+    int horizon;
+    int time_interval;
+    double speed;
+    double travel_time_penalty;
+    double asc_parameters[9];
+    double early_parameters[9];
+    double late_parameters[9];
+    double long_parameters[9];
+    double short_parameters[9];
+
+    double battery_capacity;
+    double soc_full;
+    double soc_threshold;
+    double energy_consumption_rate;
+    double initial_soc_mean;
+    double initial_soc_std_dev;
+
+    double slow_charge_power;
+    double fast_charge_power;
+    double rapid_charge_power;
+    double home_slow_charge_price;
+    double AC_charge_price;
+    double public_dc_charge_price;
+
+    double tou_peak_factor;
+    double tou_midpeak_factor;
+    double tou_offpeak_factor;
+    int peak_start; // hours
+    int peak_end;
+    int midpeak1_start;
+    int midpeak1_end;
+    int midpeak2_start;
+    int midpeak2_end;
+
+    double gamma_charge_work;
+    double gamma_charge_non_work;
+    double gamma_charge_home;
+    double theta_soc;
+    double beta_delta_soc;
+    double beta_charge_cost;
+} SolverParams;
+
+// All the state of one solver instance. The functions below without a context work on a
+// single global context, use one context per thread to solve in parallel.
+typedef struct SolverContext SolverContext;
+
 // Global constants
 extern int time_interval; // fixed width of time interval eg 5 mins
 extern double speed;
@@ -159,8 +326,12 @@ Label *find_best(L_list *B, int o);
 
 // Result accessors
 int get_count(void);
+int get_dssr_iteration_stats(DSSRIterationStats *out, int cap);
+void get_solver_stats(SolverStats *out);
 double get_total_time(void);
+unsigned int get_solve_status(void);
 Label *get_final_schedule(void);
+int export_schedule(ScheduleRow *out, int cap);
 
 // Initialization functions
 void initialize_charge_rates(void);
@@ -172,13 +343,59 @@ void set_general_parameters(int pyhorizon, double pyspeed, double pytravel_time_
 
 );
 void set_activities(Activity *activities_data, int pynum_activities);
+void set_travel_skim(int *tt, double *soc, int n);
+int set_charge_tariff(int charge_mode, double *price, int n);
 void set_fixed_initial_soc(double soc);
 void clear_fixed_initial_soc(void);
 void set_random_seed(unsigned int seed_value);
 void set_utility_error_std_dev(double std_dev);
+void set_incremental_dssr(int enabled);
+void set_bounding(int enabled);
+void set_sliding_bucket(int enabled);
+void set_expansion_threads(int n);
+void set_rng(int rng);
+void set_random_stream(unsigned int stream);
+void set_dominance(int resources, double soc_epsilon, double cost_epsilon);
+void set_budget(int beam_width, long max_live_labels, double deadline);
+
+void get_general_parameters(SolverParams *p);
 
 // Algorithm functions
 void DP(void);
 int DSSR(Label *L);
+int solve_multiday(const Day *days, int n_days, double initial_soc, MultiDayResult *results);
+int solve_coarse_to_fine(int factor, int corridor);
+void free_multiday_result(MultiDayResult *results);
+
+// Reentrant API
+SolverContext *ctx_create(void);
+void ctx_destroy(SolverContext *ctx);
+void ctx_set_params(SolverContext *ctx, const SolverParams *p);
+int ctx_set_activities(SolverContext *ctx, const Activity *activities_data, int n);
+int ctx_set_travel_skim(SolverContext *ctx, int *tt, double *soc, int n);
+int ctx_set_charge_tariff(SolverContext *ctx, int charge_mode, const double *price, int n);
+void ctx_set_random_seed(SolverContext *ctx, unsigned int seed_value);
+void ctx_set_fixed_initial_soc(SolverContext *ctx, double soc);
+void ctx_clear_fixed_initial_soc(SolverContext *ctx);
+void ctx_set_utility_error_std_dev(SolverContext *ctx, double std_dev);
+void ctx_set_incremental_dssr(SolverContext *ctx, int enabled);
+void ctx_set_bounding(SolverContext *ctx, int enabled);
+void ctx_set_sliding_bucket(SolverContext *ctx, int enabled);
+void ctx_set_expansion_threads(SolverContext *ctx, int n);
+void ctx_set_rng(SolverContext *ctx, int rng);
+void ctx_set_random_stream(SolverContext *ctx, unsigned int stream);
+void ctx_set_dominance(SolverContext *ctx, int resources, double soc_epsilon, double cost_epsilon);
+void ctx_set_budget(SolverContext *ctx, int beam_width, long max_live_labels, double deadline);
+int ctx_solve(SolverContext *ctx);
+int ctx_solve_multiday(SolverContext *ctx, const Day *days, int n_days, double initial_soc, MultiDayResult *results);
+int ctx_solve_coarse_to_fine(SolverContext *ctx, int factor, int corridor);
+int ctx_get_count(const SolverContext *ctx);
+double ctx_get_total_time(const SolverContext *ctx);
+unsigned int ctx_get_solve_status(const SolverContext *ctx);
+Label *ctx_get_final_schedule(const SolverContext *ctx);
+double ctx_get_initial_soc(const SolverContext *ctx);
+int ctx_export_schedule(const SolverContext *ctx, ScheduleRow *out, int cap);
+int ctx_get_dssr_iteration_stats(const SolverContext *ctx, DSSRIterationStats *out, int cap);
+void ctx_get_solver_stats(const SolverContext *ctx, SolverStats *out);
 
 #endif // SCHEDULING_H
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <math.h>
 #include <time.h>
+#include <stdint.h>
 // #include <stdbool.h>
 #include "scheduling.h"
 
@@ -12,25 +13,36 @@
 // Utility functions
 void recursive_print(Label *L);
 // Memory management functions
+void ctx_create_bucket(SolverContext *ctx, int a, int b);
+void ctx_reset_bucket(SolverContext *ctx);
+void ctx_free_bucket(SolverContext *ctx);
+Label *ctx_alloc_label(SolverContext *ctx);
+void ctx_release_label(SolverContext *ctx, Label *L);
+// same on the global context
 void create_bucket(int a, int b);
+void reset_bucket(void);
 void free_bucket(void);
+void destroy_pools(void);
 // void free_activity_memories(void);
 
 // Group memory manipulation functions
-Group_mem *createNode(int data);
-Group_mem *copyLinkedList(Group_mem *head);
-Group_mem *unionLinkedLists(Group_mem *head1, Group_mem *head2, int pipi);
-L_list *remove_label(L_list *L);
-void add_memory(int at, int c);
+int append_label(L_list *cell, Label *element, const Label *state);
+void remove_label(SolverContext *ctx, L_list *cell, int i);
+void remove_label_in_order(SolverContext *ctx, L_list *cell, int i);
+void move_last_label_to(L_list *cell, int i);
+void add_memory(SolverContext *ctx, int at, int c);
 
 // Label/Activity checking functions
-int contains(Label *L, Activity *a);
+int contains(const Activity *activities, Label *L, Activity *a);
 int mem_contains(Label *L, Activity *a);
 int dom_mem_contains(Label *L1, Label *L2);
 
 // Random number generation functions
-void seed_random(unsigned int seed);
-double normal_random(double mean, double std_dev);
+void seed_random(unsigned short state[3], unsigned int seed);
+double normal_random(unsigned short state[3], double mean, double std_dev);
+void philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]);
+void philox_normals(const uint32_t key[2], uint32_t draw, uint32_t purpose, uint32_t first, double *out, int n,
+                    double mean, double std_dev);
 
 
 #endif // UTILS_H
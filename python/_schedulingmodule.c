@@ -0,0 +1,837 @@
+/*  CPython extension of the solver (`make python`): the activities come in as any C contiguous buffer of Activity
+    records, e.g. a NumPy structured array of dtype ACTIVITY_DTYPE, read in place. Each solve runs on its own
+    SolverContext with the GIL released, so Python threads can solve persons in parallel. Schedules come back as
+    NumPy structured arrays of ROW_DTYPE (memoryviews if NumPy is not installed).
+
+        import numpy as np, _scheduling as s
+        s.set_parameters(288, 20.4 * 1.60934 * 16.667, -0.1, 5, asc, early, late, longp, shortp)
+        acts = np.zeros(n, dtype=np.dtype(s.ACTIVITY_DTYPE))   # filled from the activities CSV
+        res = s.solve(acts, seed=42)                            # dict, res["rows"] is the schedule
+        draws, rows = s.solve_draws(acts, seeds=range(100))     # ctx_solve_draws()
+        results = s.solve_batch([acts1, acts2], seeds=[1, 2])   # solve_population()
+        s.solve_batch_to_file(persons, seeds, "dump.evs")       # solve_population_to_file()
+
+    The parameters are those of the process (set_parameters), read when a solve starts: change them between
+    solves, not while one runs on another thread */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scheduling.h"
+#include "population.h"
+#include "schedule_writer.h"
+#include "context.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////// RECORD LAYOUTS /////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// a field of a C struct as NumPy and PEP 3118 see it
+typedef struct Field
+{
+    const char *name;
+    char code;         // struct module code: i, I or d
+    const char *dtype; // NumPy format
+    size_t offset;
+} Field;
+
+#define INT_FIELD(type, f) {#f, 'i', "i4", offsetof(type, f)}
+#define UINT_FIELD(type, f) {#f, 'I', "u4", offsetof(type, f)}
+#define DOUBLE_FIELD(type, f) {#f, 'd', "f8", offsetof(type, f)}
+
+static const Field activity_fields[] = {
+    INT_FIELD(Activity, id),
+    INT_FIELD(Activity, earliest_start),
+    INT_FIELD(Activity, latest_start),
+    INT_FIELD(Activity, min_duration),
+    INT_FIELD(Activity, max_duration),
+    DOUBLE_FIELD(Activity, x),
+    DOUBLE_FIELD(Activity, y),
+    INT_FIELD(Activity, group),
+    UINT_FIELD(Activity, memory),
+    INT_FIELD(Activity, des_duration),
+    INT_FIELD(Activity, des_start_time),
+    INT_FIELD(Activity, charge_mode),
+    INT_FIELD(Activity, is_charging),
+    INT_FIELD(Activity, is_service_station),
+};
+
+static const Field row_fields[] = {
+    INT_FIELD(ScheduleRow, act_id),
+    INT_FIELD(ScheduleRow, start_time),
+    INT_FIELD(ScheduleRow, duration),
+    INT_FIELD(ScheduleRow, charge_duration),
+    DOUBLE_FIELD(ScheduleRow, soc_start),
+    DOUBLE_FIELD(ScheduleRow, soc_end),
+    DOUBLE_FIELD(ScheduleRow, charge_cost),
+    DOUBLE_FIELD(ScheduleRow, utility),
+};
+
+static const Field draw_fields[] = {
+    INT_FIELD(DrawResult, status),
+    INT_FIELD(DrawResult, DSSR_count),
+    INT_FIELD(DrawResult, first_row),
+    INT_FIELD(DrawResult, n_rows),
+    UINT_FIELD(DrawResult, seed),
+    DOUBLE_FIELD(DrawResult, utility),
+    DOUBLE_FIELD(DrawResult, initial_soc),
+    DOUBLE_FIELD(DrawResult, total_time),
+};
+
+#define N_FIELDS(fields) ((int)(sizeof(fields) / sizeof(fields[0])))
+
+typedef struct Layout
+{
+    const Field *fields;
+    int n_fields;
+    size_t itemsize;
+    char format[512]; // PEP 3118, standard sizes and explicit padding: "T{=i:id:...4x=d:x:...}"
+} Layout;
+
+static Layout activity_layout = {activity_fields, N_FIELDS(activity_fields), sizeof(Activity), ""};
+static Layout row_layout = {row_fields, N_FIELDS(row_fields), sizeof(ScheduleRow), ""};
+static Layout draw_layout = {draw_fields, N_FIELDS(draw_fields), sizeof(DrawResult), ""};
+
+static size_t field_size(const Field *f)
+{
+    return f->code == 'd' ? sizeof(double) : sizeof(int);
+}
+
+static void build_format(Layout *l)
+{
+    size_t pos = 0;
+    int len = snprintf(l->format, sizeof(l->format), "T{");
+    for (int i = 0; i < l->n_fields; i++)
+    {
+        const Field *f = &l->fields[i];
+        if (f->offset > pos)
+        {
+            len += snprintf(l->format + len, sizeof(l->format) - (size_t)len, "%zux", f->offset - pos);
+        }
+        len += snprintf(l->format + len, sizeof(l->format) - (size_t)len, "=%c:%s:", f->code, f->name);
+        pos = f->offset + field_size(f);
+    }
+    if (l->itemsize > pos)
+    {
+        len += snprintf(l->format + len, sizeof(l->format) - (size_t)len, "%zux", l->itemsize - pos);
+    }
+    snprintf(l->format + len, sizeof(l->format) - (size_t)len, "}");
+}
+
+// {"names": [...], "formats": [...], "offsets": [...], "itemsize": n}, what numpy.dtype() takes
+static PyObject *layout_dtype(const Layout *l)
+{
+    PyObject *names = PyList_New(l->n_fields);
+    PyObject *formats = PyList_New(l->n_fields);
+    PyObject *offsets = PyList_New(l->n_fields);
+    if (names == NULL || formats == NULL || offsets == NULL)
+    {
+        Py_XDECREF(names);
+        Py_XDECREF(formats);
+        Py_XDECREF(offsets);
+        return NULL;
+    }
+    for (int i = 0; i < l->n_fields; i++)
+    {
+        PyList_SET_ITEM(names, i, PyUnicode_FromString(l->fields[i].name));
+        PyList_SET_ITEM(formats, i, PyUnicode_FromString(l->fields[i].dtype));
+        PyList_SET_ITEM(offsets, i, PyLong_FromSize_t(l->fields[i].offset));
+    }
+    return Py_BuildValue("{sNsNsNsn}", "names", names, "formats", formats, "offsets", offsets,
+                         "itemsize", (Py_ssize_t)l->itemsize);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////// RECORD ARRAYS //////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// records allocated by the solver, handed to Python through the buffer protocol and freed with the object
+typedef struct
+{
+    PyObject_HEAD
+    void *data;
+    Py_ssize_t n;
+    const Layout *layout;
+    Py_ssize_t shape;
+    Py_ssize_t stride;
+} RecordArray;
+
+static void record_array_dealloc(RecordArray *self)
+{
+    free(self->data);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int record_array_getbuffer(RecordArray *self, Py_buffer *view, int flags)
+{
+    static char empty; // a valid pointer for zero records
+    int ret = PyBuffer_FillInfo(view, (PyObject *)self, self->data != NULL ? self->data : &empty,
+                                self->n * (Py_ssize_t)self->layout->itemsize, 0, flags);
+    if (ret != 0)
+    {
+        return ret;
+    }
+    view->itemsize = (Py_ssize_t)self->layout->itemsize;
+    view->format = (flags & PyBUF_FORMAT) ? (char *)self->layout->format : NULL;
+    if (flags & PyBUF_ND)
+    {
+        view->ndim = 1;
+        view->shape = &self->shape;
+        view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? &self->stride : NULL;
+    }
+    return 0;
+}
+
+static PyBufferProcs record_array_as_buffer = {(getbufferproc)record_array_getbuffer, NULL};
+
+static PyTypeObject RecordArrayType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "_scheduling.RecordArray",
+    .tp_basicsize = sizeof(RecordArray),
+    .tp_dealloc = (destructor)record_array_dealloc,
+    .tp_as_buffer = &record_array_as_buffer,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Records made by the solver, see the buffer protocol (numpy.asarray, memoryview)",
+};
+
+static PyObject *numpy_asarray; // numpy.asarray, Py_None if NumPy is not installed
+
+/*  Takes ownership of n records at data (malloc'd, NULL if n is 0) and returns them as a NumPy array,
+    a memoryview without NumPy. data is freed on failure */
+static PyObject *records_to_python(void *data, Py_ssize_t n, const Layout *layout)
+{
+    RecordArray *a = PyObject_New(RecordArray, &RecordArrayType);
+    if (a == NULL)
+    {
+        free(data);
+        return NULL;
+    }
+    a->data = data;
+    a->n = n;
+    a->layout = layout;
+    a->shape = n;
+    a->stride = (Py_ssize_t)layout->itemsize;
+    PyObject *out = numpy_asarray != Py_None ? PyObject_CallOneArg(numpy_asarray, (PyObject *)a)
+                                               : PyMemoryView_FromObject((PyObject *)a);
+    Py_DECREF(a);
+    return out;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////// ARGUMENTS //////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int little_endian(void)
+{
+    const unsigned short one = 1;
+    return *(const unsigned char *)&one == 1;
+}
+
+/*  1 if the PEP 3118 format of a buffer describes the records of l: the same fields in the same order, with
+    the same codes at the same offsets. The text differs between producers (NumPy, ctypes, build_format), so
+    the offsets are worked out as the struct module does: aligned after '@' (the default), packed after a
+    byte order, which must be the native one. ctypes writes a byte order but not the padding of a structure,
+    so a field may also start at the next multiple of its size */
+static int same_layout(const char *format, const Layout *l)
+{
+    if (format == NULL || strncmp(format, "T{", 2) != 0)
+    {
+        return 0;
+    }
+    const char *s = format + 2;
+    int aligned = 1;
+    size_t pos = 0;
+    int k = 0;
+    while (*s != '\0' && *s != '}')
+    {
+        char c = *s;
+        if (c == '@' || c == '^' || c == '=' || c == '<' || c == '>' || c == '!')
+        {
+            if (((c == '>' || c == '!') && little_endian()) || (c == '<' && !little_endian()))
+            {
+                return 0;
+            }
+            aligned = c == '@';
+            s++;
+            continue;
+        }
+        size_t count = 1;
+        if (c >= '0' && c <= '9')
+        {
+            char *end;
+            count = (size_t)strtoul(s, &end, 10);
+            s = end;
+        }
+        c = *s++;
+        if (c == 'x')
+        {
+            pos += count;
+            continue;
+        }
+        const char *name = s + 1;
+        const char *end = strchr(name, ':');
+        if ((c != 'i' && c != 'I' && c != 'd') || count != 1 || *s != ':' || end == NULL || k >= l->n_fields)
+        {
+            return 0;
+        }
+        const Field *f = &l->fields[k++];
+        size_t size = field_size(f);
+        size_t next = (pos + size - 1) / size * size;
+        pos = aligned || f->offset == next ? next : pos;
+        if (f->code != c || f->offset != pos || strlen(f->name) != (size_t)(end - name) ||
+            strncmp(f->name, name, (size_t)(end - name)) != 0)
+        {
+            return 0;
+        }
+        pos += size;
+        s = end + 1;
+    }
+    return *s == '}' && s[1] == '\0' && k == l->n_fields && pos <= l->itemsize;
+}
+
+/*  A 1-d C contiguous buffer of Activity records (format of ACTIVITY_DTYPE), kept until PyBuffer_Release().
+    Record i must have id i and a group in 0 .. 8, so the solver can index its tables with them */
+static int get_activities(PyObject *obj, Py_buffer *view)
+{
+    if (PyObject_GetBuffer(obj, view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0)
+    {
+        return -1;
+    }
+    if (view->ndim != 1 || view->itemsize != (Py_ssize_t)sizeof(Activity) || view->len < 2 * (Py_ssize_t)sizeof(Activity))
+    {
+        PyErr_Format(PyExc_ValueError, "activities: expected a 1-d array of at least 2 records of %zu bytes "
+                                       "(ACTIVITY_DTYPE), dawn first and dusk last",
+                     sizeof(Activity));
+        PyBuffer_Release(view);
+        return -1;
+    }
+    if (!same_layout(view->format, &activity_layout))
+    {
+        PyErr_Format(PyExc_ValueError, "activities: records of format %s, expected ACTIVITY_FORMAT %s",
+                     view->format != NULL ? view->format : "B", activity_layout.format);
+        PyBuffer_Release(view);
+        return -1;
+    }
+    Py_ssize_t n = view->len / view->itemsize;
+    if (n > LABEL_FIELD_MAX)
+    {
+        PyErr_Format(PyExc_ValueError, "activities: at most %d records", LABEL_FIELD_MAX);
+        PyBuffer_Release(view);
+        return -1;
+    }
+    const Activity *acts = (const Activity *)view->buf;
+    for (Py_ssize_t i = 0; i < n; i++)
+    {
+        if (acts[i].id != i || acts[i].group < 0 || acts[i].group >= 9)
+        {
+            PyErr_Format(PyExc_ValueError, "activities: record %zd has id %d and group %d, expected id %zd "
+                                           "and a group in 0 .. 8",
+                         i, acts[i].id, acts[i].group, i);
+            PyBuffer_Release(view);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static Py_ssize_t n_records(const Py_buffer *view)
+{
+    return view->len / view->itemsize;
+}
+
+// the seeds of a sequence of integers, malloc'd
+static unsigned int *get_seeds(PyObject *obj, Py_ssize_t *n_out)
+{
+    PyObject *seq = PySequence_Fast(obj, "seeds must be a sequence of integers");
+    if (seq == NULL)
+    {
+        return NULL;
+    }
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    unsigned int *seeds = (unsigned int *)malloc((size_t)(n > 0 ? n : 1) * sizeof(unsigned int));
+    if (seeds == NULL)
+    {
+        Py_DECREF(seq);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    for (Py_ssize_t i = 0; i < n; i++)
+    {
+        unsigned long v = PyLong_AsUnsignedLongMask(PySequence_Fast_GET_ITEM(seq, i));
+        if (PyErr_Occurred())
+        {
+            free(seeds);
+            Py_DECREF(seq);
+            return NULL;
+        }
+        seeds[i] = (unsigned int)v;
+    }
+    Py_DECREF(seq);
+    *n_out = n;
+    return seeds;
+}
+
+static int get_parameter_array(PyObject *obj, double out[9], const char *name)
+{
+    PyObject *seq = PySequence_Fast(obj, name);
+    if (seq == NULL)
+    {
+        return -1;
+    }
+    if (PySequence_Fast_GET_SIZE(seq) != 9)
+    {
+        PyErr_Format(PyExc_ValueError, "%s: expected 9 values, one per activity group", name);
+        Py_DECREF(seq);
+        return -1;
+    }
+    for (int i = 0; i < 9; i++)
+    {
+        out[i] = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(seq, i));
+    }
+    Py_DECREF(seq);
+    return PyErr_Occurred() ? -1 : 0;
+}
+
+// a context for the activities with the process parameters and initial SOC (None: drawn)
+static SolverContext *create_context(const Py_buffer *acts, PyObject *initial_soc)
+{
+    SolverContext *ctx = ctx_create();
+    if (ctx == NULL)
+    {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    // the records were checked by get_activities(), ctx_set_activities() only fails out of memory
+    if (ctx_set_activities(ctx, (const Activity *)acts->buf, (int)n_records(acts)) != 0)
+    {
+        ctx_destroy(ctx);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    SolverParams p;
+    get_general_parameters(&p);
+    ctx_set_params(ctx, &p);
+    ctx_copy_settings(ctx, global_context());
+    if (initial_soc != Py_None)
+    {
+        double soc = PyFloat_AsDouble(initial_soc);
+        if (PyErr_Occurred())
+        {
+            ctx_destroy(ctx);
+            return NULL;
+        }
+        ctx_set_fixed_initial_soc(ctx, soc);
+    }
+    return ctx;
+}
+
+static PyObject *result_dict(int status, double utility, double initial_soc, int dssr, double seconds,
+                             PyObject *rows)
+{
+    if (rows == NULL)
+    {
+        return NULL;
+    }
+    return Py_BuildValue("{sisdsdsisdsN}", "status", status, "utility", utility, "initial_soc", initial_soc,
+                         "dssr_iterations", dssr, "total_time", seconds, "rows", rows);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////// MODULE FUNCTIONS ///////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PyDoc_STRVAR(set_parameters_doc,
+             "set_parameters(horizon, speed, travel_time_penalty, time_interval, asc, early, late, long, short,\n"
+             "               error_std_dev=1.0)\n\n"
+             "Model parameters of every later solve, as set_general_parameters() and set_utility_error_std_dev().");
+
+static PyObject *py_set_parameters(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    (void)self;
+    static char *keywords[] = {"horizon", "speed", "travel_time_penalty", "time_interval", "asc", "early", "late",
+                               "long", "short", "error_std_dev", NULL};
+    int horizon, time_interval;
+    double speed, penalty, std_dev = 1.0;
+    PyObject *arrays[5];
+    double values[5][9];
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "iddiOOOOO|d", keywords, &horizon, &speed, &penalty, &time_interval,
+                                     &arrays[0], &arrays[1], &arrays[2], &arrays[3], &arrays[4], &std_dev))
+    {
+        return NULL;
+    }
+    static const char *names[5] = {"asc", "early", "late", "long", "short"};
+    for (int i = 0; i < 5; i++)
+    {
+        if (get_parameter_array(arrays[i], values[i], names[i]) != 0)
+        {
+            return NULL;
+        }
+    }
+    set_general_parameters(horizon, speed, penalty, time_interval, values[0], values[1], values[2], values[3], values[4]);
+    set_utility_error_std_dev(std_dev);
+    Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(solve_doc,
+             "solve(activities, seed=42, initial_soc=None) -> dict\n\n"
+             "Solves one person (ctx_solve), the GIL released. The dict has status (0 if a schedule was found),\n"
+             "utility, initial_soc, dssr_iterations, total_time and rows, the visits as ROW_DTYPE records.");
+
+static PyObject *py_solve(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    (void)self;
+    static char *keywords[] = {"activities", "seed", "initial_soc", NULL};
+    PyObject *obj, *initial_soc = Py_None;
+    unsigned long seed = 42;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|kO", keywords, &obj, &seed, &initial_soc))
+    {
+        return NULL;
+    }
+    Py_buffer acts;
+    if (get_activities(obj, &acts) != 0)
+    {
+        return NULL;
+    }
+    SolverContext *ctx = create_context(&acts, initial_soc);
+    PyBuffer_Release(&acts); // the context has its own copy
+    if (ctx == NULL)
+    {
+        return NULL;
+    }
+    ctx_set_random_seed(ctx, (unsigned int)seed);
+
+    int status;
+    Py_BEGIN_ALLOW_THREADS
+    status = ctx_solve(ctx);
+    Py_END_ALLOW_THREADS
+
+    int n_rows = status == 0 ? ctx_export_schedule(ctx, NULL, 0) : 0;
+    ScheduleRow *rows = n_rows > 0 ? (ScheduleRow *)malloc((size_t)n_rows * sizeof(ScheduleRow)) : NULL;
+    if (n_rows > 0 && rows == NULL)
+    {
+        ctx_destroy(ctx);
+        return PyErr_NoMemory();
+    }
+    n_rows = ctx_export_schedule(ctx, rows, n_rows);
+    PyObject *out = result_dict(status, status == 0 ? ctx_get_final_schedule(ctx)->utility : 0.0,
+                                ctx_get_initial_soc(ctx), ctx_get_count(ctx), ctx_get_total_time(ctx),
+                                records_to_python(rows, n_rows, &row_layout));
+    ctx_destroy(ctx);
+    return out;
+}
+
+PyDoc_STRVAR(solve_draws_doc,
+             "solve_draws(activities, seeds, threads=0, initial_soc=None) -> (draws, rows)\n\n"
+             "One solve per seed of the same person (ctx_solve_draws) on threads threads (0: one per CPU), the\n"
+             "GIL released. draws holds DRAW_DTYPE records in seed order, the visits of draw k are\n"
+             "rows[draws[k].first_row : draws[k].first_row + draws[k].n_rows].");
+
+static PyObject *py_solve_draws(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    (void)self;
+    static char *keywords[] = {"activities", "seeds", "threads", "initial_soc", NULL};
+    PyObject *obj, *seeds_obj, *initial_soc = Py_None;
+    int n_threads = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|iO", keywords, &obj, &seeds_obj, &n_threads, &initial_soc))
+    {
+        return NULL;
+    }
+    Py_ssize_t n_draws = 0;
+    unsigned int *seeds = get_seeds(seeds_obj, &n_draws);
+    if (seeds == NULL)
+    {
+        return NULL;
+    }
+    Py_buffer acts;
+    if (get_activities(obj, &acts) != 0)
+    {
+        free(seeds);
+        return NULL;
+    }
+    SolverContext *ctx = create_context(&acts, initial_soc);
+    PyBuffer_Release(&acts);
+    if (ctx == NULL)
+    {
+        free(seeds);
+        return NULL;
+    }
+
+    MultiDrawResult res;
+    int n_solved;
+    Py_BEGIN_ALLOW_THREADS
+    n_solved = ctx_solve_draws(ctx, seeds, (int)n_draws, n_threads, &res);
+    Py_END_ALLOW_THREADS
+    ctx_destroy(ctx);
+    free(seeds);
+    if (n_solved < 0)
+    {
+        PyErr_SetString(PyExc_MemoryError, "solve_draws: out of memory or activities not set up");
+        return NULL;
+    }
+
+    // the arrays of res go to the Python objects
+    PyObject *rows = records_to_python(res.rows, res.n_rows, &row_layout);
+    PyObject *draws = records_to_python(res.draws, res.n_draws, &draw_layout);
+    if (rows == NULL || draws == NULL)
+    {
+        Py_XDECREF(rows);
+        Py_XDECREF(draws);
+        return NULL;
+    }
+    return Py_BuildValue("(NN)", draws, rows);
+}
+
+// the persons of a batch, their activities read in place from the held buffers
+typedef struct PersonBatch
+{
+    PyObject *seq; // the sequence of activity arrays
+    Py_buffer *views;
+    Py_ssize_t n_views;
+    Person *persons;
+    Py_ssize_t n;
+} PersonBatch;
+
+static void release_persons(PersonBatch *batch)
+{
+    for (Py_ssize_t i = 0; i < batch->n_views; i++)
+    {
+        PyBuffer_Release(&batch->views[i]);
+    }
+    free(batch->views);
+    free(batch->persons);
+    Py_XDECREF(batch->seq);
+    memset(batch, 0, sizeof(*batch));
+}
+
+// person i gets the activities persons[i], seeds[i] and initial_socs[i] (None or < 0: drawn)
+static int get_persons(PyObject *persons_obj, PyObject *seeds_obj, PyObject *socs_obj, PersonBatch *batch)
+{
+    memset(batch, 0, sizeof(*batch));
+    batch->seq = PySequence_Fast(persons_obj, "persons must be a sequence of activity arrays");
+    if (batch->seq == NULL)
+    {
+        return -1;
+    }
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(batch->seq);
+    batch->n = n;
+    Py_ssize_t n_seeds = 0;
+    unsigned int *seeds = get_seeds(seeds_obj, &n_seeds);
+    PyObject *socs = socs_obj != Py_None ? PySequence_Fast(socs_obj, "initial_socs must be a sequence") : NULL;
+    batch->views = (Py_buffer *)calloc((size_t)(n > 0 ? n : 1), sizeof(Py_buffer));
+    batch->persons = (Person *)calloc((size_t)(n > 0 ? n : 1), sizeof(Person));
+    int ret = -1;
+    if (seeds == NULL || (socs_obj != Py_None && socs == NULL))
+    {
+        goto done;
+    }
+    if (batch->views == NULL || batch->persons == NULL)
+    {
+        PyErr_NoMemory();
+        goto done;
+    }
+    if (n_seeds != n || (socs != NULL && PySequence_Fast_GET_SIZE(socs) != n))
+    {
+        PyErr_SetString(PyExc_ValueError, "one seed (and initial SOC) per person");
+        goto done;
+    }
+    for (Py_ssize_t i = 0; i < n; i++)
+    {
+        if (get_activities(PySequence_Fast_GET_ITEM(batch->seq, i), &batch->views[i]) != 0)
+        {
+            goto done;
+        }
+        batch->n_views++;
+        Person *p = &batch->persons[i];
+        p->activities = (Activity *)batch->views[i].buf;
+        p->n_activities = (int)n_records(&batch->views[i]);
+        p->seed = seeds[i];
+        p->initial_soc = -1.0;
+        PyObject *soc = socs != NULL ? PySequence_Fast_GET_ITEM(socs, i) : Py_None;
+        if (soc != Py_None)
+        {
+            p->initial_soc = PyFloat_AsDouble(soc);
+            if (PyErr_Occurred())
+            {
+                goto done;
+            }
+        }
+    }
+    ret = 0;
+
+done:
+    free(seeds);
+    Py_XDECREF(socs);
+    if (ret != 0)
+    {
+        release_persons(batch);
+    }
+    return ret;
+}
+
+PyDoc_STRVAR(solve_batch_doc,
+             "solve_batch(persons, seeds, initial_socs=None, threads=0) -> list of dicts\n\n"
+             "Solves a batch of persons (solve_population), each an array of activities, person i with seeds[i]\n"
+             "and initial_socs[i] (None or < 0: drawn), on threads threads (0: one per CPU) with the GIL released.\n"
+             "The arrays are read in place. One dict per person, as solve() returns.");
+
+static PyObject *py_solve_batch(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    (void)self;
+    static char *keywords[] = {"persons", "seeds", "initial_socs", "threads", NULL};
+    PyObject *persons_obj, *seeds_obj, *socs_obj = Py_None;
+    int n_threads = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|Oi", keywords, &persons_obj, &seeds_obj, &socs_obj, &n_threads))
+    {
+        return NULL;
+    }
+    PersonBatch batch;
+    if (get_persons(persons_obj, seeds_obj, socs_obj, &batch) != 0)
+    {
+        return NULL;
+    }
+    Py_ssize_t n = batch.n;
+    PersonResult *results = (PersonResult *)calloc((size_t)(n > 0 ? n : 1), sizeof(PersonResult));
+    if (results == NULL)
+    {
+        release_persons(&batch);
+        return PyErr_NoMemory();
+    }
+
+    int n_solved;
+    Py_BEGIN_ALLOW_THREADS
+    n_solved = solve_population(batch.persons, (int)n, n_threads, results);
+    Py_END_ALLOW_THREADS
+    release_persons(&batch);
+
+    PyObject *out = NULL;
+    if (n_solved < 0)
+    {
+        PyErr_SetString(PyExc_MemoryError, "solve_batch: out of memory");
+    }
+    else
+    {
+        out = PyList_New(n);
+    }
+    for (Py_ssize_t i = 0; out != NULL && i < n; i++)
+    {
+        PersonResult *r = &results[i];
+        PyObject *d = result_dict(r->status, r->utility, r->initial_soc, r->DSSR_count, r->total_time,
+                                  records_to_python(r->rows, r->n_rows, &row_layout));
+        r->rows = NULL; // owned by the array now, freed with it on failure too
+        if (d == NULL)
+        {
+            Py_CLEAR(out);
+            break;
+        }
+        PyList_SET_ITEM(out, i, d);
+    }
+    free_population_results(results, (int)n);
+    free(results);
+    return out;
+}
+
+PyDoc_STRVAR(solve_batch_to_file_doc,
+             "solve_batch_to_file(persons, seeds, path, initial_socs=None, threads=0, batch_persons=256) -> int\n\n"
+             "Same as solve_batch(), the schedules written to the binary dump at path (solve_population_to_file,\n"
+             "format in include/schedule_writer.h) instead of returned, person i with id i. The workers write\n"
+             "batches of batch_persons persons as they go. Returns the number of persons with a schedule.");
+
+static PyObject *py_solve_batch_to_file(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    (void)self;
+    static char *keywords[] = {"persons", "seeds", "path", "initial_socs", "threads", "batch_persons", NULL};
+    PyObject *persons_obj, *seeds_obj, *path_obj, *socs_obj = Py_None;
+    int n_threads = 0;
+    int batch_persons = 256;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOO&|Oii", keywords, &persons_obj, &seeds_obj,
+                                     PyUnicode_FSConverter, &path_obj, &socs_obj, &n_threads, &batch_persons))
+    {
+        return NULL;
+    }
+    PersonBatch batch;
+    if (get_persons(persons_obj, seeds_obj, socs_obj, &batch) != 0)
+    {
+        Py_DECREF(path_obj);
+        return NULL;
+    }
+    ScheduleWriter *w = schedule_writer_open(PyBytes_AS_STRING(path_obj), batch_persons);
+    if (w == NULL)
+    {
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path_obj);
+        Py_DECREF(path_obj);
+        release_persons(&batch);
+        return NULL;
+    }
+
+    int n_solved, closed;
+    Py_BEGIN_ALLOW_THREADS
+    n_solved = solve_population_to_file(batch.persons, (int)batch.n, n_threads, w);
+    closed = schedule_writer_close(w);
+    Py_END_ALLOW_THREADS
+    release_persons(&batch);
+
+    if (n_solved < 0 || closed != 0)
+    {
+        PyErr_Format(PyExc_OSError, "solve_batch_to_file: could not write %s", PyBytes_AS_STRING(path_obj));
+        Py_DECREF(path_obj);
+        return NULL;
+    }
+    Py_DECREF(path_obj);
+    return PyLong_FromLong(n_solved);
+}
+
+static PyMethodDef scheduling_methods[] = {
+    {"set_parameters", (PyCFunction)(void (*)(void))py_set_parameters, METH_VARARGS | METH_KEYWORDS, set_parameters_doc},
+    {"solve", (PyCFunction)(void (*)(void))py_solve, METH_VARARGS | METH_KEYWORDS, solve_doc},
+    {"solve_draws", (PyCFunction)(void (*)(void))py_solve_draws, METH_VARARGS | METH_KEYWORDS, solve_draws_doc},
+    {"solve_batch", (PyCFunction)(void (*)(void))py_solve_batch, METH_VARARGS | METH_KEYWORDS, solve_batch_doc},
+    {"solve_batch_to_file", (PyCFunction)(void (*)(void))py_solve_batch_to_file, METH_VARARGS | METH_KEYWORDS,
+     solve_batch_to_file_doc},
+    {NULL, NULL, 0, NULL},
+};
+
+static struct PyModuleDef scheduling_module = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "_scheduling",
+    .m_doc = "EV activity scheduling DP: solves on NumPy structured arrays with the GIL released",
+    .m_size = -1,
+    .m_methods = scheduling_methods,
+};
+
+PyMODINIT_FUNC PyInit__scheduling(void)
+{
+    build_format(&activity_layout);
+    build_format(&row_layout);
+    build_format(&draw_layout);
+    if (PyType_Ready(&RecordArrayType) < 0)
+    {
+        return NULL;
+    }
+    PyObject *m = PyModule_Create(&scheduling_module);
+    if (m == NULL)
+    {
+        return NULL;
+    }
+    PyObject *numpy = PyImport_ImportModule("numpy");
+    if (numpy != NULL)
+    {
+        numpy_asarray = PyObject_GetAttrString(numpy, "asarray");
+        Py_DECREF(numpy);
+    }
+    if (numpy_asarray == NULL)
+    {
+        PyErr_Clear();
+        numpy_asarray = Py_NewRef(Py_None);
+    }
+    if (PyModule_AddObject(m, "ACTIVITY_DTYPE", layout_dtype(&activity_layout)) < 0 ||
+        PyModule_AddObject(m, "ROW_DTYPE", layout_dtype(&row_layout)) < 0 ||
+        PyModule_AddObject(m, "DRAW_DTYPE", layout_dtype(&draw_layout)) < 0 ||
+        PyModule_AddStringConstant(m, "ACTIVITY_FORMAT", activity_layout.format) < 0)
+    {
+        Py_DECREF(m);
+        return NULL;
+    }
+    return m;
+}
@@ -0,0 +1,298 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "activity_csv.h"
+
+/*  Activity CSV reader working straight on the mapped file: fields are located in place,
+    numbers are converted from a small copy of their field only, act_type is not copied at all.
+    Same conversion as initialise_and_personalise_activities() in testing_check.py:
+    group is shifted down by one (home = 0), empty fields are 0, rows are placed by id. */
+
+// columns the reader knows, the others are skipped
+enum
+{
+    COL_SKIP,
+    COL_ID,
+    COL_ACT_TYPE,
+    COL_X,
+    COL_Y,
+    COL_GROUP,
+    COL_EARLIEST_START,
+    COL_LATEST_START,
+    COL_MIN_DURATION,
+    COL_MAX_DURATION,
+    COL_DES_START_TIME,
+    COL_DES_DURATION,
+    COL_CHARGE_MODE,
+    COL_IS_CHARGING,
+    COL_IS_SERVICE_STATION
+};
+
+static const char *column_names[] = {
+    "", "id", "act_type", "x", "y", "group", "earliest_start", "latest_start", "min_duration",
+    "max_duration", "des_start_time", "des_duration", "charge_mode", "is_charging", "is_service_station"};
+
+#define MAX_COLUMNS 64
+
+static int column_of(const char *name, size_t len)
+{
+    for (int c = 1; c < (int)(sizeof(column_names) / sizeof(column_names[0])); c++)
+    {
+        if (strlen(column_names[c]) == len && memcmp(column_names[c], name, len) == 0)
+        {
+            return c;
+        }
+    }
+    return COL_SKIP;
+}
+
+// end of the field starting at p: the next comma or end of line
+static const char *field_end(const char *p, const char *end)
+{
+    while (p < end && *p != ',' && *p != '\n' && *p != '\r')
+    {
+        p++;
+    }
+    return p;
+}
+
+// number in [p, e), 0 if the field is empty or not a number (pandas NaN)
+static double field_number(const char *p, const char *e)
+{
+    char buf[64];
+    size_t len = (size_t)(e - p);
+    if (len == 0 || len >= sizeof(buf))
+    {
+        return 0.0;
+    }
+    memcpy(buf, p, len);
+    buf[len] = '\0';
+    char *stop;
+    double v = strtod(buf, &stop);
+    return stop == buf || v != v ? 0.0 : v;
+}
+
+static void set_field(Activity *a, int col, double v)
+{
+    switch (col)
+    {
+    case COL_ID:
+        a->id = (int)v;
+        break;
+    case COL_X:
+        a->x = v;
+        break;
+    case COL_Y:
+        a->y = v;
+        break;
+    case COL_GROUP:
+        a->group = (int)v - 1; // home = 0
+        break;
+    case COL_EARLIEST_START:
+        a->earliest_start = (int)v;
+        break;
+    case COL_LATEST_START:
+        a->latest_start = (int)v;
+        break;
+    case COL_MIN_DURATION:
+        a->min_duration = (int)v;
+        break;
+    case COL_MAX_DURATION:
+        a->max_duration = (int)v;
+        break;
+    case COL_DES_START_TIME:
+        a->des_start_time = (int)v;
+        break;
+    case COL_DES_DURATION:
+        a->des_duration = (int)v;
+        break;
+    case COL_CHARGE_MODE:
+        a->charge_mode = (int)v;
+        break;
+    case COL_IS_CHARGING:
+        a->is_charging = (int)v;
+        break;
+    case COL_IS_SERVICE_STATION:
+        a->is_service_station = (int)v;
+        break;
+    }
+}
+
+// start of the next line after p
+static const char *next_line(const char *p, const char *end)
+{
+    while (p < end && *p != '\n')
+    {
+        p++;
+    }
+    return p < end ? p + 1 : end;
+}
+
+/*  Puts the rows in id order. Returns 0 if the ids are not exactly 0 .. n - 1 */
+static int order_by_id(ActivityTable *t)
+{
+    int n = t->n_activities;
+    Activity *acts = (Activity *)malloc((size_t)n * sizeof(Activity));
+    const char **types = (const char **)malloc((size_t)n * sizeof(const char *));
+    int *lens = (int *)malloc((size_t)n * sizeof(int));
+    char *seen = (char *)calloc((size_t)n, 1);
+    int ok = acts != NULL && types != NULL && lens != NULL && seen != NULL;
+    for (int i = 0; ok && i < n; i++)
+    {
+        int id = t->activities[i].id;
+        if (id < 0 || id >= n || seen[id])
+        {
+            ok = 0;
+            break;
+        }
+        seen[id] = 1;
+        acts[id] = t->activities[i];
+        types[id] = t->act_type[i];
+        lens[id] = t->act_type_len[i];
+    }
+    free(seen);
+    if (!ok)
+    {
+        free(acts);
+        free(types);
+        free(lens);
+        return 0;
+    }
+    free(t->activities);
+    free(t->act_type);
+    free(t->act_type_len);
+    t->activities = acts;
+    t->act_type = types;
+    t->act_type_len = lens;
+    return 1;
+}
+
+/*  Maps the file at path and reads its activities into table.
+    Returns 0 on success, -1 with a message on stderr if the file cannot be read, has no id column,
+    or its ids are not 0 .. n - 1 */
+int load_activity_csv(const char *path, ActivityTable *table)
+{
+    memset(table, 0, sizeof(*table));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        perror(path);
+        return -1;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || sb.st_size == 0)
+    {
+        fprintf(stderr, "%s: empty or unreadable file\n", path);
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        perror(path);
+        return -1;
+    }
+    table->map = map;
+    table->map_size = (size_t)sb.st_size;
+    const char *p = (const char *)map;
+    const char *end = p + table->map_size;
+
+    // header
+    int cols[MAX_COLUMNS];
+    int n_cols = 0;
+    int has_id = 0;
+    while (p < end && *p != '\n' && *p != '\r' && n_cols < MAX_COLUMNS)
+    {
+        const char *e = field_end(p, end);
+        cols[n_cols] = column_of(p, (size_t)(e - p));
+        has_id |= cols[n_cols] == COL_ID;
+        n_cols++;
+        p = e < end && *e == ',' ? e + 1 : e;
+    }
+    p = next_line(p, end);
+    if (!has_id)
+    {
+        fprintf(stderr, "%s: no id column\n", path);
+        free_activity_table(table);
+        return -1;
+    }
+
+    // rows, the arrays grow as needed
+    int cap = 0;
+    while (p < end)
+    {
+        if (*p == '\n' || *p == '\r')
+        { // blank line
+            p = next_line(p, end);
+            continue;
+        }
+        if (table->n_activities == cap)
+        {
+            cap = cap > 0 ? 2 * cap : 32;
+            Activity *acts = (Activity *)realloc(table->activities, (size_t)cap * sizeof(Activity));
+            const char **types = acts == NULL ? NULL : (const char **)realloc(table->act_type, (size_t)cap * sizeof(const char *));
+            int *lens = types == NULL ? NULL : (int *)realloc(table->act_type_len, (size_t)cap * sizeof(int));
+            if (acts != NULL)
+            {
+                table->activities = acts;
+            }
+            if (types != NULL)
+            {
+                table->act_type = types;
+            }
+            if (lens == NULL)
+            {
+                fprintf(stderr, "%s: out of memory\n", path);
+                free_activity_table(table);
+                return -1;
+            }
+            table->act_type_len = lens;
+        }
+        int i = table->n_activities++;
+        Activity *a = &table->activities[i];
+        memset(a, 0, sizeof(*a));
+        table->act_type[i] = p;
+        table->act_type_len[i] = 0;
+        for (int c = 0; c < n_cols && p < end && *p != '\n' && *p != '\r'; c++)
+        {
+            const char *e = field_end(p, end);
+            if (cols[c] == COL_ACT_TYPE)
+            {
+                table->act_type[i] = p;
+                table->act_type_len[i] = (int)(e - p);
+            }
+            else if (cols[c] != COL_SKIP)
+            {
+                set_field(a, cols[c], field_number(p, e));
+            }
+            p = e < end && *e == ',' ? e + 1 : e;
+        }
+        p = next_line(p, end);
+    }
+
+    if (!order_by_id(table))
+    {
+        fprintf(stderr, "%s: activity ids must be 0 .. %d, each once\n", path, table->n_activities - 1);
+        free_activity_table(table);
+        return -1;
+    }
+    return 0;
+}
+
+/* Unmaps the file and frees the arrays of the table */
+void free_activity_table(ActivityTable *table)
+{
+    free(table->activities);
+    free(table->act_type);
+    free(table->act_type_len);
+    if (table->map != NULL)
+    {
+        munmap(table->map, table->map_size);
+    }
+    memset(table, 0, sizeof(*table));
+}
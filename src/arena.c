@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "arena.h"
+
+/* Sets up an empty pool, no memory is allocated until the first pool_alloc() */
+void pool_init(Pool *p, size_t elem_size, size_t per_slab)
+{
+    // every object must be able to hold the free list link
+    if (elem_size < sizeof(void *))
+    {
+        elem_size = sizeof(void *);
+    }
+    size_t align = sizeof(void *);
+    p->elem_size = (elem_size + align - 1) / align * align;
+    p->per_slab = per_slab > 0 ? per_slab : 1;
+    p->slabs = NULL;
+    p->n_slabs = 0;
+    p->cap_slabs = 0;
+    p->current = 0;
+    p->used = 0;
+    p->free_list = NULL;
+}
+
+/* Moves the bump pointer on to the next slab, allocating a new one if every slab is in use */
+static int pool_next_slab(Pool *p)
+{
+    if (p->n_slabs > 0)
+    {
+        p->current++;
+    }
+    p->used = 0;
+    if (p->current < p->n_slabs)
+    {
+        return 1; // slab left over from before the last reset
+    }
+    if (p->n_slabs == p->cap_slabs)
+    {
+        int cap = p->cap_slabs > 0 ? 2 * p->cap_slabs : 8;
+        char **slabs = realloc(p->slabs, (size_t)cap * sizeof(char *));
+        if (slabs == NULL)
+        {
+            return 0;
+        }
+        p->slabs = slabs;
+        p->cap_slabs = cap;
+    }
+    p->slabs[p->n_slabs] = malloc(p->elem_size * p->per_slab);
+    if (p->slabs[p->n_slabs] == NULL)
+    {
+        return 0;
+    }
+    p->n_slabs++;
+    return 1;
+}
+
+/* Returns one object, from the free list if possible, otherwise bumped out of the current slab */
+void *pool_alloc(Pool *p)
+{
+    if (p->free_list != NULL)
+    {
+        void *elem = p->free_list;
+        p->free_list = *(void **)elem;
+        return elem;
+    }
+    if (p->n_slabs == 0 || p->used == p->per_slab)
+    {
+        if (!pool_next_slab(p))
+        {
+            fprintf(stderr, "pool_alloc: out of memory\n");
+            return NULL;
+        }
+    }
+    void *elem = p->slabs[p->current] + p->used * p->elem_size;
+    p->used++;
+    return elem;
+}
+
+/* Puts an object back on the free list. The object must not be referenced anymore */
+void pool_release(Pool *p, void *elem)
+{
+    if (elem == NULL)
+    {
+        return;
+    }
+    *(void **)elem = p->free_list;
+    p->free_list = elem;
+}
+
+/* Forgets every object handed out so far in O(1), the slabs are kept for reuse */
+void pool_reset(Pool *p)
+{
+    p->free_list = NULL;
+    p->current = 0;
+    p->used = 0;
+}
+
+/* Gives every slab back to the system */
+void pool_destroy(Pool *p)
+{
+    for (int i = 0; i < p->n_slabs; i++)
+    {
+        free(p->slabs[i]);
+    }
+    free(p->slabs);
+    p->slabs = NULL;
+    p->n_slabs = 0;
+    p->cap_slabs = 0;
+    p->current = 0;
+    p->used = 0;
+    p->free_list = NULL;
+}
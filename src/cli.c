@@ -0,0 +1,568 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <ctype.h>
+#include "scheduling.h"
+#include "activity_csv.h"
+#include "cli.h"
+
+/*  Command line driver: solves one person without Python.
+
+    usage: scheduling <activities.csv> [parameters file] [schedule.csv]
+
+    The activities CSV has the columns of the testing_latest files. The parameter file holds
+    `name = value` lines (`#` starts a comment), names are the SolverParams fields, for the arrays
+    a comma separated list of 9 values (asc_parameters, or asc for short). The run is set with
+    seed, rng (0 erand48, 1 Philox), random_stream, initial_soc (fixed, drawn if not given),
+    utility_error_std_dev, incremental_dssr, bounding, sliding_bucket, expansion_threads,
+    dominance (sum of 1 SOC, 2 charging cost, 4 across time), soc_epsilon and cost_epsilon, both needed
+    with dominance on SOC and charging cost.
+    coarse_factor > 1 solves coarse to fine, within corridor intervals of the coarse schedule.
+    beam_width, max_live_labels and deadline (seconds) limit the search, see ctx_set_budget().
+    A parameter not in the file keeps the value of testing_latest/testing_check.py, "-" skips the file.
+    The schedule is written as extract_schedule() writes it, on stdout without an output path or with "-". */
+
+typedef struct CliRun
+{
+    SolverParams p;
+    unsigned int seed;
+    int rng;
+    unsigned int random_stream;
+    int fixed_soc_enabled;
+    double fixed_soc;
+    double utility_error_std_dev;
+    int incremental_dssr;
+    int bounding;
+    int sliding_bucket;
+    int expansion_threads;
+    int coarse_factor;
+    int corridor;
+    int beam_width;
+    long max_live_labels;
+    double deadline;
+    int dominance;
+    double soc_epsilon;
+    double cost_epsilon;
+} CliRun;
+
+typedef enum
+{
+    PARAM_INT,
+    PARAM_DOUBLE,
+    PARAM_ARRAY9
+} ParamType;
+
+typedef struct ParamKey
+{
+    const char *name;
+    ParamType type;
+    size_t offset; // in SolverParams
+} ParamKey;
+
+#define PARAM(field, type) {#field, type, offsetof(SolverParams, field)}
+
+static const ParamKey param_keys[] = {
+    PARAM(horizon, PARAM_INT),
+    PARAM(time_interval, PARAM_INT),
+    PARAM(speed, PARAM_DOUBLE),
+    PARAM(travel_time_penalty, PARAM_DOUBLE),
+    PARAM(asc_parameters, PARAM_ARRAY9),
+    PARAM(early_parameters, PARAM_ARRAY9),
+    PARAM(late_parameters, PARAM_ARRAY9),
+    PARAM(long_parameters, PARAM_ARRAY9),
+    PARAM(short_parameters, PARAM_ARRAY9),
+    {"asc", PARAM_ARRAY9, offsetof(SolverParams, asc_parameters)},
+    {"early", PARAM_ARRAY9, offsetof(SolverParams, early_parameters)},
+    {"late", PARAM_ARRAY9, offsetof(SolverParams, late_parameters)},
+    {"long", PARAM_ARRAY9, offsetof(SolverParams, long_parameters)},
+    {"short", PARAM_ARRAY9, offsetof(SolverParams, short_parameters)},
+    PARAM(battery_capacity, PARAM_DOUBLE),
+    PARAM(soc_full, PARAM_DOUBLE),
+    PARAM(soc_threshold, PARAM_DOUBLE),
+    PARAM(energy_consumption_rate, PARAM_DOUBLE),
+    PARAM(initial_soc_mean, PARAM_DOUBLE),
+    PARAM(initial_soc_std_dev, PARAM_DOUBLE),
+    PARAM(slow_charge_power, PARAM_DOUBLE),
+    PARAM(fast_charge_power, PARAM_DOUBLE),
+    PARAM(rapid_charge_power, PARAM_DOUBLE),
+    PARAM(home_slow_charge_price, PARAM_DOUBLE),
+    PARAM(AC_charge_price, PARAM_DOUBLE),
+    PARAM(public_dc_charge_price, PARAM_DOUBLE),
+    PARAM(tou_peak_factor, PARAM_DOUBLE),
+    PARAM(tou_midpeak_factor, PARAM_DOUBLE),
+    PARAM(tou_offpeak_factor, PARAM_DOUBLE),
+    PARAM(peak_start, PARAM_INT),
+    PARAM(peak_end, PARAM_INT),
+    PARAM(midpeak1_start, PARAM_INT),
+    PARAM(midpeak1_end, PARAM_INT),
+    PARAM(midpeak2_start, PARAM_INT),
+    PARAM(midpeak2_end, PARAM_INT),
+    PARAM(gamma_charge_work, PARAM_DOUBLE),
+    PARAM(gamma_charge_non_work, PARAM_DOUBLE),
+    PARAM(gamma_charge_home, PARAM_DOUBLE),
+    PARAM(theta_soc, PARAM_DOUBLE),
+    PARAM(beta_delta_soc, PARAM_DOUBLE),
+    PARAM(beta_charge_cost, PARAM_DOUBLE),
+};
+
+/* Model parameters of testing_latest/testing_check.py, the globals give the others */
+static void default_run(CliRun *run)
+{
+    static const double asc[9] = {0, 10.6, 16.1, 11.3, 17.4, 12, 16.1, 6.76, 0};
+    static const double early[9] = {0, -1.37, -1.73, -2.51, -2.56, -0.031, -1.73, -2.55, 0};
+    static const double late[9] = {0, -0.79, -3.42, -0.993, -1.54, -1.58, -3.42, -0.578, -0.61};
+    static const double longp[9] = {0, -0.201, -0.597, -0.133, -0.0783, -0.209, -0.597, -0.0267, -0.24};
+    static const double shortp[9] = {0, -4.78, -5.63, 0.528, -0.783, -0.00764, -5.63, 0.134, -0.61};
+
+    get_general_parameters(&run->p);
+    run->p.horizon = 288;
+    run->p.time_interval = 5;
+    run->p.speed = 20.4 * 1.60934 * 16.667; // km/h to m/min
+    run->p.travel_time_penalty = -0.1;
+    memcpy(run->p.asc_parameters, asc, sizeof(asc));
+    memcpy(run->p.early_parameters, early, sizeof(early));
+    memcpy(run->p.late_parameters, late, sizeof(late));
+    memcpy(run->p.long_parameters, longp, sizeof(longp));
+    memcpy(run->p.short_parameters, shortp, sizeof(shortp));
+    run->seed = 42;
+    run->rng = RNG_ERAND48;
+    run->random_stream = 0;
+    run->fixed_soc_enabled = 0;
+    run->fixed_soc = 0.0;
+    run->utility_error_std_dev = 1.0;
+    run->incremental_dssr = 0;
+    run->bounding = 0;
+    run->sliding_bucket = 0;
+    run->expansion_threads = 1;
+    run->coarse_factor = 1;
+    run->corridor = 3;
+    run->beam_width = 0;
+    run->max_live_labels = 0;
+    run->deadline = 0.0;
+    run->dominance = 0;
+    run->soc_epsilon = 0.0;
+    run->cost_epsilon = 0.0;
+}
+
+static char *trim(char *s)
+{
+    while (isspace((unsigned char)*s))
+    {
+        s++;
+    }
+    char *e = s + strlen(s);
+    while (e > s && isspace((unsigned char)e[-1]))
+    {
+        *--e = '\0';
+    }
+    return s;
+}
+
+// parses a number filling the whole of s, returns 0 if it is not one
+static int parse_double(const char *s, double *v)
+{
+    char *stop;
+    *v = strtod(s, &stop);
+    return stop != s && *trim(stop) == '\0';
+}
+
+/* Sets parameter name of the run to value, returns 0 if the name or the value is not valid */
+static int set_param(CliRun *run, const char *name, char *value)
+{
+    double v;
+    if (strcmp(name, "seed") == 0)
+    {
+        if (!parse_double(value, &v))
+        {
+            return 0;
+        }
+        run->seed = (unsigned int)v;
+        return 1;
+    }
+    if (strcmp(name, "rng") == 0)
+    {
+        if (!parse_double(value, &v))
+        {
+            return 0;
+        }
+        run->rng = (int)v;
+        return 1;
+    }
+    if (strcmp(name, "random_stream") == 0)
+    {
+        if (!parse_double(value, &v))
+        {
+            return 0;
+        }
+        run->random_stream = (unsigned int)v;
+        return 1;
+    }
+    if (strcmp(name, "initial_soc") == 0)
+    {
+        if (!parse_double(value, &v))
+        {
+            return 0;
+        }
+        run->fixed_soc_enabled = v >= 0.0; // < 0: drawn
+        run->fixed_soc = v;
+        return 1;
+    }
+    if (strcmp(name, "utility_error_std_dev") == 0)
+    {
+        return parse_double(value, &run->utility_error_std_dev);
+    }
+    if (strcmp(name, "incremental_dssr") == 0)
+    {
+        if (!parse_double(value, &v))
+        {
+            return 0;
+        }
+        run->incremental_dssr = v != 0.0;
+        return 1;
+    }
+    if (strcmp(name, "bounding") == 0)
+    {
+        if (!parse_double(value, &v))
+        {
+            return 0;
+        }
+        run->bounding = v != 0.0;
+        return 1;
+    }
+    if (strcmp(name, "sliding_bucket") == 0)
+    {
+        if (!parse_double(value, &v))
+        {
+            return 0;
+        }
+        run->sliding_bucket = v != 0.0;
+        return 1;
+    }
+    if (strcmp(name, "expansion_threads") == 0)
+    {
+        if (!parse_double(value, &v))
+        {
+            return 0;
+        }
+        run->expansion_threads = (int)v;
+        return 1;
+    }
+    if (strcmp(name, "coarse_factor") == 0)
+    {
+        if (!parse_double(value, &v))
+        {
+            return 0;
+        }
+        run->coarse_factor = (int)v;
+        return 1;
+    }
+    if (strcmp(name, "corridor") == 0)
+    {
+        if (!parse_double(value, &v))
+        {
+            return 0;
+        }
+        run->corridor = (int)v;
+        return 1;
+    }
+    if (strcmp(name, "beam_width") == 0)
+    {
+        if (!parse_double(value, &v))
+        {
+            return 0;
+        }
+        run->beam_width = (int)v;
+        return 1;
+    }
+    if (strcmp(name, "max_live_labels") == 0)
+    {
+        if (!parse_double(value, &v))
+        {
+            return 0;
+        }
+        run->max_live_labels = (long)v;
+        return 1;
+    }
+    if (strcmp(name, "deadline") == 0)
+    {
+        if (!parse_double(value, &v))
+        {
+            return 0;
+        }
+        run->deadline = v;
+        return 1;
+    }
+    if (strcmp(name, "dominance") == 0)
+    {
+        if (!parse_double(value, &v))
+        {
+            return 0;
+        }
+        run->dominance = (int)v;
+        return 1;
+    }
+    if (strcmp(name, "soc_epsilon") == 0)
+    {
+        return parse_double(value, &run->soc_epsilon);
+    }
+    if (strcmp(name, "cost_epsilon") == 0)
+    {
+        return parse_double(value, &run->cost_epsilon);
+    }
+
+    for (size_t k = 0; k < sizeof(param_keys) / sizeof(param_keys[0]); k++)
+    {
+        const ParamKey *key = &param_keys[k];
+        if (strcmp(name, key->name) != 0)
+        {
+            continue;
+        }
+        char *field = (char *)&run->p + key->offset;
+        switch (key->type)
+        {
+        case PARAM_INT:
+            if (!parse_double(value, &v))
+            {
+                return 0;
+            }
+            *(int *)field = (int)v;
+            return 1;
+        case PARAM_DOUBLE:
+            return parse_double(value, (double *)field);
+        case PARAM_ARRAY9:
+        {
+            double values[9];
+            int n = 0;
+            for (char *tok = strtok(value, ","); tok != NULL; tok = strtok(NULL, ","))
+            {
+                if (n == 9 || !parse_double(trim(tok), &values[n]))
+                {
+                    return 0;
+                }
+                n++;
+            }
+            if (n != 9)
+            {
+                return 0;
+            }
+            memcpy(field, values, sizeof(values));
+            return 1;
+        }
+        }
+    }
+    return 0;
+}
+
+/* Reads a parameter file into the run, returns 0 with a message on stderr on the first bad line */
+static int read_params(const char *path, CliRun *run)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+    {
+        perror(path);
+        return 0;
+    }
+    char line[1024];
+    int line_no = 0;
+    int ok = 1;
+    while (ok && fgets(line, sizeof(line), f) != NULL)
+    {
+        line_no++;
+        line[strcspn(line, "#\r\n")] = '\0';
+        char *s = trim(line);
+        if (*s == '\0')
+        {
+            continue;
+        }
+        char *eq = strchr(s, '=');
+        if (eq == NULL)
+        {
+            fprintf(stderr, "%s:%d: expected name = value\n", path, line_no);
+            ok = 0;
+            break;
+        }
+        *eq = '\0';
+        char *name = trim(s);
+        if (!set_param(run, name, trim(eq + 1)))
+        {
+            fprintf(stderr, "%s:%d: bad parameter %s\n", path, line_no, name);
+            ok = 0;
+        }
+    }
+    fclose(f);
+    if (ok && (run->dominance & DOMINANCE_SOC) && (run->dominance & DOMINANCE_CHARGE_COST) &&
+        !(run->soc_epsilon > 0 && run->cost_epsilon > 0))
+    {
+        // without a grid on both resources almost no label dominates another, see ctx_set_dominance()
+        fprintf(stderr, "%s: dominance on SOC and charging cost needs soc_epsilon and cost_epsilon > 0\n", path);
+        ok = 0;
+    }
+    return ok;
+}
+
+// writes v the way Python prints a float: shortest digits that read back the same, always with a . or e
+static void write_float(FILE *out, double v)
+{
+    char buf[32];
+    for (int precision = 15; precision <= 17; precision++)
+    {
+        snprintf(buf, sizeof(buf), "%.*g", precision, v);
+        if (strtod(buf, NULL) == v)
+        {
+            break;
+        }
+    }
+    fputs(buf, out);
+    if (strpbrk(buf, ".eni") == NULL) // not 1e+20, nan or inf
+    {
+        fputs(".0", out);
+    }
+}
+
+/* Writes the schedule with the columns of extract_schedule() in testing_check.py */
+static void write_schedule(FILE *out, const ActivityTable *table, const ScheduleRow *rows, int n_rows, int time_interval)
+{
+    fputs("act_id,act_type,start_time,duration,soc_start,soc_end,is_charging,charge_mode,charge_duration,charge_cost,utility,x,y\n", out);
+    for (int i = 0; i < n_rows; i++)
+    {
+        const ScheduleRow *r = &rows[i];
+        const Activity *a = &table->activities[r->act_id];
+        fprintf(out, "%d,%.*s,", r->act_id, table->act_type_len[r->act_id], table->act_type[r->act_id]);
+        write_float(out, r->start_time * time_interval / 60.0); // hours
+        fprintf(out, ",%d,", r->duration);
+        write_float(out, r->soc_start);
+        fputc(',', out);
+        write_float(out, r->soc_end);
+        fprintf(out, ",%d,%d,", a->is_charging, a->charge_mode);
+        write_float(out, r->charge_duration * time_interval / 60.0); // hours
+        fputc(',', out);
+        write_float(out, r->charge_cost);
+        fputc(',', out);
+        write_float(out, r->utility);
+        fputc(',', out);
+        write_float(out, a->x);
+        fputc(',', out);
+        write_float(out, a->y);
+        fputc('\n', out);
+    }
+}
+
+// opens the output path, stdout for NULL or "-"
+static FILE *open_output(const char *path)
+{
+    if (path == NULL || strcmp(path, "-") == 0)
+    {
+        return stdout;
+    }
+    FILE *out = fopen(path, "w");
+    if (out == NULL)
+    {
+        perror(path);
+    }
+    return out;
+}
+
+/* Solves the activities of table with run on ctx and writes the schedule to out_path, see cli_main() */
+static int solve_and_write(SolverContext *ctx, const ActivityTable *table, const CliRun *run,
+                           const char *activities_path, const char *out_path)
+{
+    if (ctx_set_activities(ctx, table->activities, table->n_activities) != 0)
+    {
+        fprintf(stderr, "%s: out of memory\n", activities_path);
+        return 2;
+    }
+    ctx_set_params(ctx, &run->p);
+    ctx_set_random_seed(ctx, run->seed);
+    ctx_set_rng(ctx, run->rng);
+    ctx_set_random_stream(ctx, run->random_stream);
+    if (run->fixed_soc_enabled)
+    {
+        ctx_set_fixed_initial_soc(ctx, run->fixed_soc);
+    }
+    ctx_set_utility_error_std_dev(ctx, run->utility_error_std_dev);
+    ctx_set_incremental_dssr(ctx, run->incremental_dssr);
+    ctx_set_bounding(ctx, run->bounding);
+    ctx_set_sliding_bucket(ctx, run->sliding_bucket);
+    ctx_set_expansion_threads(ctx, run->expansion_threads);
+    ctx_set_dominance(ctx, run->dominance, run->soc_epsilon, run->cost_epsilon);
+    ctx_set_budget(ctx, run->beam_width, run->max_live_labels, run->deadline);
+
+    if (ctx_solve_coarse_to_fine(ctx, run->coarse_factor, run->corridor) != 0)
+    {
+        if (ctx_get_solve_status(ctx) & SOLVE_NO_SCHEDULE)
+        {
+            fprintf(stderr, "%s: deadline passed before a schedule without group cycle was found\n", activities_path);
+        }
+        else
+        {
+            fprintf(stderr, "%s: no feasible schedule\n", activities_path);
+        }
+        return 1;
+    }
+    int n_rows = ctx_export_schedule(ctx, NULL, 0);
+    ScheduleRow *rows = (ScheduleRow *)malloc((size_t)n_rows * sizeof(ScheduleRow));
+    if (rows == NULL)
+    {
+        fprintf(stderr, "%s: out of memory\n", activities_path);
+        return 2;
+    }
+    ctx_export_schedule(ctx, rows, n_rows);
+
+    int status = 2;
+    FILE *out = open_output(out_path);
+    if (out != NULL)
+    {
+        write_schedule(out, table, rows, n_rows, run->p.time_interval);
+        int failed = out == stdout ? fflush(out) != 0 : fclose(out) != 0;
+        if (failed)
+        {
+            perror(out_path != NULL ? out_path : "stdout");
+        }
+        status = failed ? 2 : 0;
+    }
+    free(rows);
+    fprintf(stderr, "utility = %.6f, initial SOC = %.4f, DSSR iterations = %d, time = %.3f s\n",
+            ctx_get_final_schedule(ctx)->utility, ctx_get_initial_soc(ctx), ctx_get_count(ctx), ctx_get_total_time(ctx));
+    if (ctx_get_solve_status(ctx) != SOLVE_OPTIMAL)
+    {
+        fprintf(stderr, "search cut by the budget or the corridor, not proven optimal (status %u)\n", ctx_get_solve_status(ctx));
+    }
+    return status;
+}
+
+/*  Runs the driver, returns the exit status:
+    0 schedule written, 1 no feasible schedule, 2 bad arguments or input */
+int cli_main(int argc, char *argv[])
+{
+    if (argc < 2 || argc > 4)
+    {
+        fprintf(stderr, "usage: %s <activities.csv> [parameters file] [schedule.csv]\n", argv[0]);
+        return 2;
+    }
+    CliRun run;
+    default_run(&run);
+    if (argc > 2 && strcmp(argv[2], "-") != 0 && !read_params(argv[2], &run))
+    {
+        return 2;
+    }
+
+    ActivityTable table;
+    if (load_activity_csv(argv[1], &table) != 0)
+    {
+        return 2;
+    }
+    SolverContext *ctx = ctx_create();
+    int status = 2;
+    if (ctx == NULL)
+    {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+    }
+    else
+    {
+        status = solve_and_write(ctx, &table, &run, argv[1], argc > 3 ? argv[3] : NULL);
+    }
+    ctx_destroy(ctx);
+    free_activity_table(&table);
+    return status;
+}
@@ -1,4 +1,3 @@
-
 /*  Algorythm developped by Fabian Torres & Pierre Hellich
     Semester project Fall 2023                              */
 
@@ -8,42 +7,34 @@
 #include <time.h>
 // #include <stdbool.h>
 #include "scheduling.h"
+#include "context.h"
 #include "utils.h"
+#include "cli.h"
 
-
+/*  Solves for the activities given to set_activities() with the global parameters.
+    The work is done by ctx_solve() on the global context, the results are copied back
+    into the globals (final_schedule, DSSR_count, total_time, initial_soc, bucket).
+    With arguments, it is the command line driver instead (see cli.c) */
 int main(int argc, char *argv[])
 {
+    if (argc > 1)
+    {
+        return cli_main(argc, argv);
+    }
 
-    clock_t start_time, end_time;
-    start_time = clock();
-
-    // it's populating or updating the "bucket" with feasible solutions or labels
-    // bucket = pour chaque time horizon et pour chaque activite, voici un schedule ?
-    create_bucket(horizon, max_num_activities);
-    DP();
+    SolverContext *ctx = global_context();
 
-    // It's presumably the final set of solutions or labels that the algorithm is interested in
-    L_list *li = &bucket[horizon - 1][max_num_activities - 1]; // li points to last element of bucket (pointer of pointer)
-                                                           // ie la liste de label ou la journee est finie par la derniere activitee DUSK
+    // the globals can be written directly, pick up their current values
+    SolverParams p;
+    get_general_parameters(&p);
+    ctx_set_params(ctx, &p);
 
-    DSSR_count = 0;
-    while (DSSR(find_best(li, 0)))
-    { // detect cycles in the current best solution
-        // while(DSSR_count < 10 && DSSR(find_best(li, 1))){
-        // printf("\n While loop");
-        free_bucket();
-        create_bucket(horizon, max_num_activities);
-        DP();
-        DSSR_count++;
-        // if(DSSR_count >= 40){  // If we've reached the maximum count, break out of the loop
-        //     printf("\n Maximum DSSR_count reached.");
-        //     break;
-        // }
-        li = &bucket[horizon - 1][max_num_activities - 1];
-    };
+    ctx_solve(ctx);
 
-    final_schedule = find_best(li, 0);
-    end_time = clock();
-    total_time = (double)(end_time - start_time) / CLOCKS_PER_SEC;
+    final_schedule = ctx->final_schedule;
+    DSSR_count = ctx->DSSR_count;
+    total_time = ctx->total_time;
+    initial_soc = ctx->initial_soc;
+    bucket = ctx->bucket;
     return 0;
-}
\ No newline at end of file
+}
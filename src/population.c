@@ -0,0 +1,546 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "scheduling.h"
+#include "context.h"
+#include "population.h"
+#include "schedule_writer.h"
+
+/*  Batch solver: persons are solved on a pool of threads, each with its own SolverContext
+    (bucket, pools, tables, RNG), so the workers share nothing but the work queues.
+
+    Work stealing: every worker owns a range [head, tail) of person indices, starting from an
+    even split. It takes persons from the front of its own range and, once that is empty,
+    steals the back half of the largest range left. Person cost varies a lot with the number
+    of activities and charging options, this keeps every thread busy until the end.
+
+    With a dump file (solve_population_to_file) the results are not kept: every worker adds its
+    persons to its own batch of the writer, written out whenever it is full. */
+
+typedef struct WorkRange
+{
+    pthread_mutex_t lock;
+    int head;
+    int tail;
+} WorkRange;
+
+typedef struct PopulationPool
+{
+    const Person *persons;
+    PersonResult *results;
+    WorkRange *ranges;
+    int n_workers;
+    SolverParams params;          // global parameters when the batch was started
+    const SolverContext *settings; // solver settings of the workers (the global context)
+    ScheduleWriter *writer;       // dump of the results instead of results, or NULL
+    unsigned int first_id;        // id in the dump of persons[0]
+} PopulationPool;
+
+typedef struct Worker
+{
+    PopulationPool *pool;
+    int id;
+    int n_solved;
+} Worker;
+
+/* Takes the next person of the worker's own range, -1 if it is empty */
+static int pop_own(WorkRange *r)
+{
+    int i = -1;
+    pthread_mutex_lock(&r->lock);
+    if (r->head < r->tail)
+    {
+        i = r->head++;
+    }
+    pthread_mutex_unlock(&r->lock);
+    return i;
+}
+
+/*  Moves the back half of the largest other range into the thief's range and returns its first person,
+    -1 once every range is empty */
+static int steal(PopulationPool *pool, int thief)
+{
+    for (;;)
+    {
+        int victim = -1;
+        int best = 0;
+        for (int w = 0; w < pool->n_workers; w++)
+        {
+            if (w == thief)
+            {
+                continue;
+            }
+            pthread_mutex_lock(&pool->ranges[w].lock);
+            int left = pool->ranges[w].tail - pool->ranges[w].head;
+            pthread_mutex_unlock(&pool->ranges[w].lock);
+            if (left > best)
+            {
+                best = left;
+                victim = w;
+            }
+        }
+        if (victim < 0)
+        {
+            return -1;
+        }
+
+        WorkRange *v = &pool->ranges[victim];
+        int head = 0;
+        int tail = 0;
+        pthread_mutex_lock(&v->lock);
+        if (v->head < v->tail)
+        {
+            int mid = v->head + (v->tail - v->head) / 2; // the victim keeps [head, mid)
+            head = mid;
+            tail = v->tail;
+            v->tail = mid;
+        }
+        pthread_mutex_unlock(&v->lock);
+        if (head == tail)
+        {
+            continue; // the victim emptied its range in the meantime, look again
+        }
+
+        WorkRange *own = &pool->ranges[thief];
+        pthread_mutex_lock(&own->lock);
+        own->head = head + 1;
+        own->tail = tail;
+        pthread_mutex_unlock(&own->lock);
+        return head;
+    }
+}
+
+/*  Solves one person on the worker's context and copies the result out of the bucket. id is the Philox
+    stream of the person (RNG_PHILOX), the ERAND48 draws only depend on its seed */
+static void solve_person(SolverContext *ctx, const Person *person, unsigned int id, PersonResult *res)
+{
+    memset(res, 0, sizeof(*res));
+    res->status = -1;
+    if (ctx_set_activities(ctx, person->activities, person->n_activities) != 0)
+    {
+        return;
+    }
+    if (person->initial_soc >= 0.0)
+    {
+        ctx_set_fixed_initial_soc(ctx, person->initial_soc);
+    }
+    else
+    {
+        ctx_clear_fixed_initial_soc(ctx);
+    }
+    ctx_set_random_seed(ctx, person->seed);
+    ctx_set_random_stream(ctx, id);
+
+    if (ctx_solve(ctx) == 0)
+    {
+        int n_rows = ctx_export_schedule(ctx, NULL, 0);
+        res->rows = (ScheduleRow *)malloc((size_t)n_rows * sizeof(ScheduleRow));
+        if (res->rows != NULL)
+        {
+            res->n_rows = ctx_export_schedule(ctx, res->rows, n_rows);
+            res->utility = ctx->final_schedule->utility;
+            res->status = 0;
+        }
+    }
+    res->DSSR_count = ctx->DSSR_count;
+    res->initial_soc = ctx->initial_soc;
+    res->total_time = ctx->total_time;
+    ctx_get_solver_stats(ctx, &res->stats);
+}
+
+static void *population_worker(void *arg)
+{
+    Worker *w = (Worker *)arg;
+    PopulationPool *pool = w->pool;
+
+    SolverContext *ctx = ctx_create();
+    if (ctx == NULL)
+    {
+        fprintf(stderr, "solve_population: out of memory\n");
+        return NULL; // the other workers steal this worker's persons
+    }
+    ctx_set_params(ctx, &pool->params);
+    ctx_copy_settings(ctx, pool->settings);
+    ScheduleBatch batch;
+    if (pool->writer != NULL && schedule_batch_init(&batch, pool->writer) != 0)
+    {
+        fprintf(stderr, "solve_population: out of memory\n");
+        ctx_destroy(ctx);
+        return NULL;
+    }
+
+    for (;;)
+    {
+        int i = pop_own(&pool->ranges[w->id]);
+        if (i < 0)
+        {
+            i = steal(pool, w->id);
+        }
+        if (i < 0)
+        {
+            break;
+        }
+        if (pool->writer == NULL)
+        {
+            solve_person(ctx, &pool->persons[i], pool->first_id + (unsigned int)i, &pool->results[i]);
+            w->n_solved += pool->results[i].status == 0;
+            continue;
+        }
+        PersonResult res;
+        solve_person(ctx, &pool->persons[i], pool->first_id + (unsigned int)i, &res);
+        w->n_solved += res.status == 0;
+        unsigned int id = pool->first_id + (unsigned int)i;
+        int added = schedule_batch_add(&batch, id, &res);
+        free(res.rows);
+        if (added != 0)
+        {
+            // the error is kept by the writer, schedule_writer_close() reports it
+            fprintf(stderr, "solve_population_to_file: person %u could not be written\n", id);
+            break;
+        }
+    }
+    if (pool->writer != NULL)
+    {
+        schedule_batch_flush(&batch);
+        schedule_batch_free(&batch);
+    }
+    ctx_destroy(ctx);
+    return NULL;
+}
+
+/* Solves the persons into results or writer, see solve_population() */
+static int run_population(const Person *persons, int n_persons, int n_threads, PersonResult *results,
+                          ScheduleWriter *writer)
+{
+    if (n_persons <= 0)
+    {
+        return 0;
+    }
+    if (n_threads <= 0)
+    {
+        long n_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = n_cpu > 0 ? (int)n_cpu : 1;
+    }
+    if (n_threads > n_persons)
+    {
+        n_threads = n_persons;
+    }
+
+    PopulationPool pool;
+    pool.persons = persons;
+    pool.results = results;
+    pool.n_workers = n_threads;
+    get_general_parameters(&pool.params);
+    pool.settings = global_context();
+    pool.writer = writer;
+    pool.first_id = 0;
+    if (writer != NULL)
+    {
+        pthread_mutex_lock(&writer->lock);
+        pool.first_id = writer->next_id;
+        writer->next_id += (unsigned int)n_persons;
+        pthread_mutex_unlock(&writer->lock);
+    }
+    pool.ranges = (WorkRange *)malloc((size_t)n_threads * sizeof(WorkRange));
+    Worker *workers = (Worker *)malloc((size_t)n_threads * sizeof(Worker));
+    pthread_t *threads = (pthread_t *)malloc((size_t)n_threads * sizeof(pthread_t));
+    if (pool.ranges == NULL || workers == NULL || threads == NULL)
+    {
+        free(pool.ranges);
+        free(workers);
+        free(threads);
+        return -1;
+    }
+
+    for (int w = 0; w < n_threads; w++)
+    {
+        pthread_mutex_init(&pool.ranges[w].lock, NULL);
+        pool.ranges[w].head = (int)((long)n_persons * w / n_threads);
+        pool.ranges[w].tail = (int)((long)n_persons * (w + 1) / n_threads);
+        workers[w].pool = &pool;
+        workers[w].id = w;
+        workers[w].n_solved = 0;
+    }
+    for (int i = 0; results != NULL && i < n_persons; i++)
+    {
+        memset(&results[i], 0, sizeof(PersonResult));
+        results[i].status = -1; // unsolved until a worker gets there
+    }
+
+    // worker 0 runs on the calling thread
+    int n_started = 1;
+    for (int w = 1; w < n_threads; w++)
+    {
+        if (pthread_create(&threads[w], NULL, population_worker, &workers[w]) != 0)
+        {
+            break; // fewer threads, their ranges get stolen
+        }
+        n_started++;
+    }
+    population_worker(&workers[0]);
+    for (int w = 1; w < n_started; w++)
+    {
+        pthread_join(threads[w], NULL);
+    }
+
+    int n_solved = 0;
+    for (int w = 0; w < n_threads; w++)
+    {
+        n_solved += workers[w].n_solved;
+        pthread_mutex_destroy(&pool.ranges[w].lock);
+    }
+    free(pool.ranges);
+    free(workers);
+    free(threads);
+    return n_solved;
+}
+
+/*  Solves n_persons persons with the current global parameters and solver settings (error term std dev,
+    dominance, budget, ..., see ctx_copy_settings()), on n_threads threads (<= 0: one per online CPU).
+    results[i] is the result of persons[i] whatever the number of threads. With RNG_PHILOX (set_rng())
+    persons[i] draws from stream i, the global random stream is not used.
+    Returns the number of persons with a schedule, -1 if the pool could not be set up */
+int solve_population(const Person *persons, int n_persons, int n_threads, PersonResult *results)
+{
+    return run_population(persons, n_persons, n_threads, results, NULL);
+}
+
+/*  Same as solve_population(), the results written to the dump of writer instead of kept (see
+    schedule_writer.h). persons[i] gets the id next_id + i, next_id counting the persons of the
+    previous calls on writer, so a population solved in chunks keeps its numbering; with RNG_PHILOX
+    the id is the person's stream as well. The batches of the workers are flushed before it returns. Returns the number of persons with a schedule, -1 if
+    the pool could not be set up; write errors are reported by schedule_writer_close() */
+int solve_population_to_file(const Person *persons, int n_persons, int n_threads, ScheduleWriter *writer)
+{
+    return run_population(persons, n_persons, n_threads, NULL, writer);
+}
+
+/* Frees the rows of results filled in by solve_population() */
+void free_population_results(PersonResult *results, int n_persons)
+{
+    for (int i = 0; i < n_persons; i++)
+    {
+        free(results[i].rows);
+        results[i].rows = NULL;
+        results[i].n_rows = 0;
+    }
+}
+
+/*  Monte Carlo draws of one person: the same activities solved once per seed, each seed giving new
+    utility error terms. The travel tables and successor lists do not depend on the draw, they are built
+    once on the caller's context and read by every worker (see ctx_create_sharing). Draws are handed
+    out one at a time, each one reseeds its context, so a draw's schedule does not depend on the thread
+    that solves it. The DSSR memory of the activities is put back before each draw. */
+
+typedef struct DrawPool
+{
+    pthread_mutex_t lock;
+    int next; // next draw to hand out
+    int n_draws;
+    const unsigned int *seeds;
+    const Activity *activities; // the activities before any draw
+    int n_activities;
+    DrawResult *draws;
+    ScheduleRow **rows; // rows of each draw until they are gathered
+} DrawPool;
+
+typedef struct DrawWorker
+{
+    DrawPool *pool;
+    SolverContext *ctx;
+} DrawWorker;
+
+/* Solves draw k on the worker's context and keeps a copy of its rows */
+static void solve_draw(SolverContext *ctx, DrawPool *pool, int k)
+{
+    DrawResult *res = &pool->draws[k];
+    res->status = -1;
+    res->seed = pool->seeds[k];
+    memcpy(ctx->activities, pool->activities, (size_t)pool->n_activities * sizeof(Activity));
+    ctx_set_random_seed(ctx, res->seed);
+
+    if (ctx_solve(ctx) == 0)
+    {
+        int n_rows = ctx_export_schedule(ctx, NULL, 0);
+        pool->rows[k] = (ScheduleRow *)malloc((size_t)n_rows * sizeof(ScheduleRow));
+        if (pool->rows[k] != NULL)
+        {
+            res->n_rows = ctx_export_schedule(ctx, pool->rows[k], n_rows);
+            res->utility = ctx->final_schedule->utility;
+            res->status = 0;
+        }
+    }
+    res->DSSR_count = ctx->DSSR_count;
+    res->initial_soc = ctx->initial_soc;
+    res->total_time = ctx->total_time;
+}
+
+static void *draw_worker(void *arg)
+{
+    DrawWorker *w = (DrawWorker *)arg;
+    DrawPool *pool = w->pool;
+    for (;;)
+    {
+        pthread_mutex_lock(&pool->lock);
+        int k = pool->next < pool->n_draws ? pool->next++ : -1;
+        pthread_mutex_unlock(&pool->lock);
+        if (k < 0)
+        {
+            break;
+        }
+        solve_draw(w->ctx, pool, k);
+    }
+    return NULL;
+}
+
+/*  Solves the activities of ctx once per seed in seeds, on n_threads threads (<= 0: one per online CPU,
+    1: back to back on ctx). The parameters, error term std dev and initial SOC setting of ctx apply to
+    every draw, draw k gives the same schedule as ctx_set_random_seed(ctx, seeds[k]) then ctx_solve(ctx).
+    results is filled in with arrays owned by the caller, see free_draw_results(); ctx holds the last
+    draw it solved itself. Returns the number of draws with a schedule, -1 if ctx is not set up or out of memory */
+int ctx_solve_draws(SolverContext *ctx, const unsigned int *seeds, int n_draws, int n_threads, MultiDrawResult *results)
+{
+    memset(results, 0, sizeof(*results));
+    if (n_draws <= 0)
+    {
+        return 0;
+    }
+    if (ctx_prepare(ctx) != 0)
+    {
+        return -1;
+    }
+    if (n_threads <= 0)
+    {
+        long n_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = n_cpu > 0 ? (int)n_cpu : 1;
+    }
+    if (n_threads > n_draws)
+    {
+        n_threads = n_draws;
+    }
+
+    DrawPool pool;
+    pool.next = 0;
+    pool.n_draws = n_draws;
+    pool.seeds = seeds;
+    pool.n_activities = ctx->max_num_activities;
+    Activity *saved = (Activity *)malloc((size_t)pool.n_activities * sizeof(Activity));
+    pool.activities = saved;
+    pool.draws = (DrawResult *)calloc((size_t)n_draws, sizeof(DrawResult));
+    pool.rows = (ScheduleRow **)calloc((size_t)n_draws, sizeof(ScheduleRow *));
+    DrawWorker *workers = (DrawWorker *)malloc((size_t)n_threads * sizeof(DrawWorker));
+    pthread_t *threads = (pthread_t *)malloc((size_t)n_threads * sizeof(pthread_t));
+    if (saved == NULL || pool.draws == NULL || pool.rows == NULL || workers == NULL || threads == NULL)
+    {
+        free(saved);
+        free(pool.draws);
+        free(pool.rows);
+        free(workers);
+        free(threads);
+        return -1;
+    }
+    memcpy(saved, ctx->activities, (size_t)pool.n_activities * sizeof(Activity));
+    pthread_mutex_init(&pool.lock, NULL);
+
+    // worker 0 runs on the calling thread with ctx, the others on contexts reading its tables
+    int n_workers = 1;
+    workers[0].pool = &pool;
+    workers[0].ctx = ctx;
+    for (int w = 1; w < n_threads; w++)
+    {
+        workers[w].pool = &pool;
+        workers[w].ctx = ctx_create_sharing(ctx);
+        if (workers[w].ctx == NULL)
+        {
+            break; // fewer threads
+        }
+        n_workers++;
+    }
+    int n_started = 1;
+    for (int w = 1; w < n_workers; w++)
+    {
+        if (pthread_create(&threads[w], NULL, draw_worker, &workers[w]) != 0)
+        {
+            break; // the started workers take its draws
+        }
+        n_started++;
+    }
+    draw_worker(&workers[0]);
+    for (int w = 1; w < n_started; w++)
+    {
+        pthread_join(threads[w], NULL);
+    }
+    for (int w = 1; w < n_workers; w++)
+    {
+        ctx_destroy(workers[w].ctx);
+    }
+    memcpy(ctx->activities, saved, (size_t)pool.n_activities * sizeof(Activity));
+    pthread_mutex_destroy(&pool.lock);
+
+    // gather the rows in seed order
+    int n_rows = 0;
+    int n_solved = 0;
+    for (int k = 0; k < n_draws; k++)
+    {
+        pool.draws[k].first_row = n_rows;
+        n_rows += pool.draws[k].n_rows;
+        n_solved += pool.draws[k].status == 0;
+    }
+    results->draws = pool.draws;
+    results->n_draws = n_draws;
+    results->rows = (ScheduleRow *)malloc((size_t)(n_rows > 0 ? n_rows : 1) * sizeof(ScheduleRow));
+    if (results->rows == NULL)
+    {
+        n_solved = -1;
+    }
+    else
+    {
+        for (int k = 0; k < n_draws; k++)
+        {
+            if (pool.draws[k].n_rows > 0)
+            {
+                memcpy(results->rows + pool.draws[k].first_row, pool.rows[k], (size_t)pool.draws[k].n_rows * sizeof(ScheduleRow));
+            }
+        }
+        results->n_rows = n_rows;
+    }
+    for (int k = 0; k < n_draws; k++)
+    {
+        free(pool.rows[k]);
+    }
+    free(pool.rows);
+    free(saved);
+    free(workers);
+    free(threads);
+    return n_solved;
+}
+
+/*  Draws on the global context, see ctx_solve_draws(). Like main(), the global parameters are
+    picked up first and the globals describe the last draw solved on the calling thread afterwards */
+int solve_draws(const unsigned int *seeds, int n_draws, int n_threads, MultiDrawResult *results)
+{
+    SolverContext *ctx = global_context();
+
+    SolverParams p;
+    get_general_parameters(&p);
+    ctx_set_params(ctx, &p);
+
+    int n_solved = ctx_solve_draws(ctx, seeds, n_draws, n_threads, results);
+
+    final_schedule = ctx->final_schedule;
+    DSSR_count = ctx->DSSR_count;
+    total_time = ctx->total_time;
+    initial_soc = ctx->initial_soc;
+    bucket = ctx->bucket;
+    return n_solved;
+}
+
+/* Frees the arrays filled in by solve_draws() */
+void free_draw_results(MultiDrawResult *results)
+{
+    free(results->draws);
+    free(results->rows);
+    memset(results, 0, sizeof(*results));
+}
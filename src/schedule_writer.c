@@ -0,0 +1,273 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "schedule_writer.h"
+
+/*  Writer of the schedule dumps described in schedule_writer.h. Each writing thread fills its own
+    ScheduleBatch, lays the columns of a full batch out in its buffer and only takes the writer's lock
+    for the single fwrite() of the batch, so workers do not wait on each other while they solve. */
+
+static const char header_magic[8] = {'E', 'V', 'S', 'C', 'H', 'E', 'D', '1'};
+static const char batch_magic[8] = {'E', 'V', 'S', 'B', 'A', 'T', 'C', 'H'};
+static const char index_magic[8] = {'E', 'V', 'S', 'I', 'N', 'D', 'E', 'X'};
+static const char trailer_magic[8] = {'E', 'V', 'S', 'C', 'H', 'E', 'N', 'D'};
+
+#define BATCH_HEADER_SIZE 24
+
+// bytes of a column of n values, padded to 8
+static size_t column_size(size_t n, size_t value_size)
+{
+    return (n * value_size + 7) & ~(size_t)7;
+}
+
+/*  Creates the dump file at path (truncated) and writes its header. Batches hold batch_persons persons
+    (<= 0: 256). NULL if the file cannot be created */
+ScheduleWriter *schedule_writer_open(const char *path, int batch_persons)
+{
+    ScheduleWriter *w = (ScheduleWriter *)calloc(1, sizeof(ScheduleWriter));
+    if (w == NULL)
+    {
+        return NULL;
+    }
+    w->fp = fopen(path, "wb");
+    if (w->fp == NULL)
+    {
+        free(w);
+        return NULL;
+    }
+    pthread_mutex_init(&w->lock, NULL);
+    w->batch_persons = batch_persons > 0 ? batch_persons : 256;
+
+    uint32_t version = SCHEDULE_DUMP_VERSION;
+    uint32_t byte_order = 0x01020304;
+    if (fwrite(header_magic, 8, 1, w->fp) != 1 || fwrite(&version, 4, 1, w->fp) != 1 ||
+        fwrite(&byte_order, 4, 1, w->fp) != 1)
+    {
+        w->error = 1;
+    }
+    w->offset = 16;
+    return w;
+}
+
+/*  Writes the index and trailer, closes the file and frees w. The batches of every thread must have been
+    flushed. Returns 0, -1 if any write failed (the file is then not a complete dump) */
+int schedule_writer_close(ScheduleWriter *w)
+{
+    if (w == NULL)
+    {
+        return -1;
+    }
+    uint64_t index_offset = w->offset;
+    uint64_t counts[3] = {w->n_batches, w->n_persons, w->n_rows};
+    if (fwrite(index_magic, 8, 1, w->fp) != 1 || fwrite(counts, 8, 3, w->fp) != 3 ||
+        (w->n_batches > 0 && fwrite(w->batches, 8, w->n_batches, w->fp) != w->n_batches) ||
+        fwrite(&index_offset, 8, 1, w->fp) != 1 || fwrite(trailer_magic, 8, 1, w->fp) != 1)
+    {
+        w->error = 1;
+    }
+    if (fclose(w->fp) != 0)
+    {
+        w->error = 1;
+    }
+    int ret = w->error ? -1 : 0;
+    pthread_mutex_destroy(&w->lock);
+    free(w->batches);
+    free(w);
+    return ret;
+}
+
+/* An empty batch of w, 0 or -1 if out of memory */
+int schedule_batch_init(ScheduleBatch *b, ScheduleWriter *w)
+{
+    memset(b, 0, sizeof(*b));
+    b->writer = w;
+    size_t n = (size_t)w->batch_persons;
+    b->person = (uint32_t *)malloc(n * sizeof(uint32_t));
+    b->status = (int32_t *)malloc(n * sizeof(int32_t));
+    b->dssr_count = (int32_t *)malloc(n * sizeof(int32_t));
+    b->first_row = (uint32_t *)malloc(n * sizeof(uint32_t));
+    b->n_person_rows = (uint32_t *)malloc(n * sizeof(uint32_t));
+    b->utility = (double *)malloc(n * sizeof(double));
+    b->initial_soc = (double *)malloc(n * sizeof(double));
+    if (b->person == NULL || b->status == NULL || b->dssr_count == NULL || b->first_row == NULL ||
+        b->n_person_rows == NULL || b->utility == NULL || b->initial_soc == NULL)
+    {
+        schedule_batch_free(b);
+        return -1;
+    }
+    return 0;
+}
+
+// appends n values of src to the batch buffer at *pos and pads them to 8
+static void put_column(unsigned char *buf, size_t *pos, const void *src, size_t n, size_t value_size)
+{
+    size_t size = column_size(n, value_size);
+    if (n > 0)
+    {
+        memcpy(buf + *pos, src, n * value_size);
+    }
+    memset(buf + *pos + n * value_size, 0, size - n * value_size);
+    *pos += size;
+}
+
+// gathers the field at offset of n rows into a column, padded to 8
+static void put_row_column(unsigned char *buf, size_t *pos, const ScheduleRow *rows, size_t n, size_t offset,
+                           size_t value_size)
+{
+    size_t size = column_size(n, value_size);
+    for (size_t r = 0; r < n; r++)
+    {
+        memcpy(buf + *pos + r * value_size, (const unsigned char *)&rows[r] + offset, value_size);
+    }
+    memset(buf + *pos + n * value_size, 0, size - n * value_size);
+    *pos += size;
+}
+
+/*  Writes the persons of b as one batch and empties b. Returns 0, -1 if the batch could not be written
+    (out of memory or write error, the writer's error is set as well) */
+int schedule_batch_flush(ScheduleBatch *b)
+{
+    if (b->n_persons == 0)
+    {
+        return 0;
+    }
+    ScheduleWriter *w = b->writer;
+    size_t np = (size_t)b->n_persons;
+    size_t nr = (size_t)b->n_rows;
+    size_t size = BATCH_HEADER_SIZE + 5 * column_size(np, 4) + 2 * column_size(np, 8) + 4 * column_size(nr, 4) +
+                  4 * column_size(nr, 8);
+    if (size > b->cap_buf)
+    {
+        unsigned char *buf = (unsigned char *)realloc(b->buf, size);
+        if (buf == NULL)
+        {
+            pthread_mutex_lock(&w->lock);
+            w->error = 1;
+            pthread_mutex_unlock(&w->lock);
+            b->n_persons = 0;
+            b->n_rows = 0;
+            return -1;
+        }
+        b->buf = buf;
+        b->cap_buf = size;
+    }
+
+    // header, then the person columns and the row columns
+    unsigned char *buf = b->buf;
+    uint32_t counts[2] = {(uint32_t)np, (uint32_t)nr};
+    uint64_t size64 = (uint64_t)size;
+    memcpy(buf, batch_magic, 8);
+    memcpy(buf + 8, counts, 8);
+    memcpy(buf + 16, &size64, 8);
+    size_t pos = BATCH_HEADER_SIZE;
+    put_column(buf, &pos, b->person, np, 4);
+    put_column(buf, &pos, b->status, np, 4);
+    put_column(buf, &pos, b->dssr_count, np, 4);
+    put_column(buf, &pos, b->first_row, np, 4);
+    put_column(buf, &pos, b->n_person_rows, np, 4);
+    put_column(buf, &pos, b->utility, np, 8);
+    put_column(buf, &pos, b->initial_soc, np, 8);
+
+    put_row_column(buf, &pos, b->rows, nr, offsetof(ScheduleRow, act_id), 4);
+    put_row_column(buf, &pos, b->rows, nr, offsetof(ScheduleRow, start_time), 4);
+    put_row_column(buf, &pos, b->rows, nr, offsetof(ScheduleRow, duration), 4);
+    put_row_column(buf, &pos, b->rows, nr, offsetof(ScheduleRow, charge_duration), 4);
+    put_row_column(buf, &pos, b->rows, nr, offsetof(ScheduleRow, soc_start), 8);
+    put_row_column(buf, &pos, b->rows, nr, offsetof(ScheduleRow, soc_end), 8);
+    put_row_column(buf, &pos, b->rows, nr, offsetof(ScheduleRow, charge_cost), 8);
+    put_row_column(buf, &pos, b->rows, nr, offsetof(ScheduleRow, utility), 8);
+
+    int ret = 0;
+    pthread_mutex_lock(&w->lock);
+    if (w->n_batches == w->cap_batches)
+    {
+        uint64_t cap = w->cap_batches > 0 ? 2 * w->cap_batches : 64;
+        uint64_t *batches = (uint64_t *)realloc(w->batches, (size_t)cap * sizeof(uint64_t));
+        if (batches == NULL)
+        {
+            w->error = 1;
+        }
+        else
+        {
+            w->batches = batches;
+            w->cap_batches = cap;
+        }
+    }
+    if (w->error || fwrite(buf, 1, size, w->fp) != size)
+    {
+        w->error = 1;
+        ret = -1;
+    }
+    else
+    {
+        w->batches[w->n_batches++] = w->offset;
+        w->offset += size64;
+        w->n_persons += np;
+        w->n_rows += nr;
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    b->n_persons = 0;
+    b->n_rows = 0;
+    return ret;
+}
+
+/*  Adds the result of person to b, its rows are copied. The batch is written once it holds batch_persons
+    persons. Returns 0, -1 if out of memory or the batch could not be written (the writer's error is set
+    as well) */
+int schedule_batch_add(ScheduleBatch *b, unsigned int person, const PersonResult *res)
+{
+    if (b->n_rows + res->n_rows > b->cap_rows)
+    {
+        int cap = b->cap_rows > 0 ? b->cap_rows : 16 * b->writer->batch_persons;
+        while (cap < b->n_rows + res->n_rows)
+        {
+            cap *= 2;
+        }
+        ScheduleRow *rows = (ScheduleRow *)realloc(b->rows, (size_t)cap * sizeof(ScheduleRow));
+        if (rows == NULL)
+        {
+            pthread_mutex_lock(&b->writer->lock);
+            b->writer->error = 1; // the person is missing from the dump
+            pthread_mutex_unlock(&b->writer->lock);
+            return -1;
+        }
+        b->rows = rows;
+        b->cap_rows = cap;
+    }
+    int i = b->n_persons++;
+    b->person[i] = person;
+    b->status[i] = res->status;
+    b->dssr_count[i] = res->DSSR_count;
+    b->first_row[i] = (uint32_t)b->n_rows;
+    b->n_person_rows[i] = (uint32_t)res->n_rows;
+    b->utility[i] = res->utility;
+    b->initial_soc[i] = res->initial_soc;
+    if (res->n_rows > 0)
+    {
+        memcpy(b->rows + b->n_rows, res->rows, (size_t)res->n_rows * sizeof(ScheduleRow));
+    }
+    b->n_rows += res->n_rows;
+
+    if (b->n_persons == b->writer->batch_persons)
+    {
+        return schedule_batch_flush(b);
+    }
+    return 0;
+}
+
+/* Frees the arrays of b, persons not flushed are dropped */
+void schedule_batch_free(ScheduleBatch *b)
+{
+    free(b->person);
+    free(b->status);
+    free(b->dssr_count);
+    free(b->first_row);
+    free(b->n_person_rows);
+    free(b->utility);
+    free(b->initial_soc);
+    free(b->rows);
+    free(b->buf);
+    memset(b, 0, sizeof(*b));
+}
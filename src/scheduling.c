@@ -5,13 +5,18 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <time.h>
 #include <stdbool.h>
+#include <pthread.h>
 #include "scheduling.h"
+#include "context.h"
 #include "utils.h"
 
 /// global _constants
+// These are the parameters of the process-wide API (set_general_parameters, set_activities, main).
+// main() copies them into the global context before each solve, ctx_create() starts from them.
 int time_interval;
 double speed;
 double travel_time_penalty;
@@ -34,83 +39,112 @@ double energy_consumption_rate = 0.2; // kwh_per_km
 unsigned int seed = 42;            // Default seed for reproducibility (can be changed via set_random_seed())
 double initial_soc_mean = 0.40;    // 30% average starting SOC
 double initial_soc_std_dev = 0.1;  // 10% standard deviation
-double initial_soc; // Will be set using normal_random() in create_label()
+double initial_soc; // initial SOC of the last main() run, drawn in create_label()
 
-static int fixed_initial_soc_enabled = 0;
-static double fixed_initial_soc_value = 0.30;
+static int alloc_travel_tables(SolverContext *ctx, int n);
+static int build_locations(SolverContext *ctx, const int *tt, const double *soc);
+static void build_travel_tables(SolverContext *ctx);
+static int build_successor_lists(SolverContext *ctx);
+static int build_charge_tables(SolverContext *ctx);
 
-static double utility_error_std_dev = 1.0;
-static int rng_seeded = 0;
+static void free_utility_error_terms(SolverContext *ctx)
+{
+    free(ctx->eps_participation);
+    free(ctx->eps_start_time);
+    free(ctx->eps_duration);
+    free(ctx->eps_travel);
+    free(ctx->eps_charging);
+    ctx->eps_participation = NULL;
+    ctx->eps_start_time = NULL;
+    ctx->eps_duration = NULL;
+    ctx->eps_travel = NULL;
+    ctx->eps_charging = NULL;
+    ctx->eps_n = 0;
+}
 
-// Utility error terms
-// draw them ONCE at the start of each DP() run, store them in arrays, and then
-// update_utility() just looks them up.
-static double *eps_participation = NULL; 
-static double *eps_start_time = NULL;    
-static double *eps_duration = NULL;     
-static double *eps_travel = NULL;    
-static double *eps_charging = NULL; 
-static int eps_n = 0;
+// what a counter-based draw is for, third word of its Philox counter
+enum
+{
+    DRAW_ERROR_TERMS = 0,
+    DRAW_INITIAL_SOC = 1
+};
 
-static void free_utility_error_terms(void)
+/*  RNG_PHILOX: the error terms of draw ctx->draw_id in one batch per array. The term index of each value is
+    its place in the arrays one after the other, the travel terms left at 0 included */
+static void draw_error_terms_counter(SolverContext *ctx, double sd)
 {
-    free(eps_participation);
-    free(eps_start_time);
-    free(eps_duration);
-    free(eps_travel);
-    free(eps_charging);
-    eps_participation = NULL;
-    eps_start_time = NULL;
-    eps_duration = NULL;
-    eps_travel = NULL;
-    eps_charging = NULL;
-    eps_n = 0;
+    int n = ctx->max_num_activities;
+    uint32_t key[2] = {ctx->seed, ctx->random_stream};
+    uint32_t draw = ctx->draw_id;
+    philox_normals(key, draw, DRAW_ERROR_TERMS, 0, ctx->eps_participation, n, 0.0, sd);
+    philox_normals(key, draw, DRAW_ERROR_TERMS, (uint32_t)n, ctx->eps_start_time, n, 0.0, sd);
+    philox_normals(key, draw, DRAW_ERROR_TERMS, 2 * (uint32_t)n, ctx->eps_duration, n, 0.0, sd);
+    philox_normals(key, draw, DRAW_ERROR_TERMS, 3 * (uint32_t)n, ctx->eps_charging, 8 * n, 0.0, sd);
+    philox_normals(key, draw, DRAW_ERROR_TERMS, 11 * (uint32_t)n, ctx->eps_travel, n * n, 0.0, sd);
+    for (int from = 0; from < n; from++)
+    {
+        for (int to = 0; to < n; to++)
+        {
+            if (from == to || ctx->activities[from].group == 0 || ctx->activities[to].group == 0)
+            {
+                ctx->eps_travel[from * n + to] = 0.0;
+            }
+        }
+    }
 }
 
-static void draw_utility_error_terms_for_dp(void)
+static void draw_utility_error_terms_for_dp(SolverContext *ctx)
 {
     // No noise requested => free any old arrays and exit.
-    if (utility_error_std_dev <= 0.0 || max_num_activities <= 0 || activities == NULL)
+    if (ctx->utility_error_std_dev <= 0.0 || ctx->max_num_activities <= 0 || ctx->activities == NULL)
     {
-        free_utility_error_terms();
+        free_utility_error_terms(ctx);
         return;
     }
 
-    int n = max_num_activities;
-    if (eps_n != n)
+    int n = ctx->max_num_activities;
+    if (ctx->eps_n != n)
     {
-        free_utility_error_terms();
-        eps_participation = (double *)malloc((size_t)n * sizeof(double));
-        eps_start_time = (double *)malloc((size_t)n * sizeof(double));
-        eps_duration = (double *)malloc((size_t)n * sizeof(double));
-        eps_travel = (double *)malloc((size_t)n * (size_t)n * sizeof(double));
-        eps_charging = (double *)malloc((size_t)n * 8U * sizeof(double));
-        eps_n = n;
+        free_utility_error_terms(ctx);
+        ctx->eps_participation = (double *)malloc((size_t)n * sizeof(double));
+        ctx->eps_start_time = (double *)malloc((size_t)n * sizeof(double));
+        ctx->eps_duration = (double *)malloc((size_t)n * sizeof(double));
+        ctx->eps_travel = (double *)malloc((size_t)n * (size_t)n * sizeof(double));
+        ctx->eps_charging = (double *)malloc((size_t)n * 8U * sizeof(double));
+        ctx->eps_n = n;
     }
 
     // Draw all the errors we might need.
-    for (int i = 0; i < n; i++)
+    double sd = ctx->utility_error_std_dev;
+    if (ctx->rng == RNG_PHILOX)
     {
-        eps_participation[i] = normal_random(0.0, utility_error_std_dev);
-        eps_start_time[i] = normal_random(0.0, utility_error_std_dev);
-        eps_duration[i] = normal_random(0.0, utility_error_std_dev);
-        for (int mode = 0; mode < 8; mode++)
-        {
-            eps_charging[i * 8 + mode] = normal_random(0.0, utility_error_std_dev);
-        }
+        draw_error_terms_counter(ctx, sd);
     }
-    for (int from = 0; from < n; from++)
+    else
     {
-        for (int to = 0; to < n; to++)
+        for (int i = 0; i < n; i++)
         {
-            // Keep travel noise off for self-travel and any travel to/from home (group==0).
-            if (from == to || activities[from].group == 0 || activities[to].group == 0)
+            ctx->eps_participation[i] = normal_random(ctx->rng_state, 0.0, sd);
+            ctx->eps_start_time[i] = normal_random(ctx->rng_state, 0.0, sd);
+            ctx->eps_duration[i] = normal_random(ctx->rng_state, 0.0, sd);
+            for (int mode = 0; mode < 8; mode++)
             {
-                eps_travel[from * n + to] = 0.0;
+                ctx->eps_charging[i * 8 + mode] = normal_random(ctx->rng_state, 0.0, sd);
             }
-            else
+        }
+        for (int from = 0; from < n; from++)
+        {
+            for (int to = 0; to < n; to++)
             {
-                eps_travel[from * n + to] = normal_random(0.0, utility_error_std_dev);
+                // Keep travel noise off for self-travel and any travel to/from home (group==0).
+                if (from == to || ctx->activities[from].group == 0 || ctx->activities[to].group == 0)
+                {
+                    ctx->eps_travel[from * n + to] = 0.0;
+                }
+                else
+                {
+                    ctx->eps_travel[from * n + to] = normal_random(ctx->rng_state, 0.0, sd);
+                }
             }
         }
     }
@@ -118,14 +152,14 @@ static void draw_utility_error_terms_for_dp(void)
     // Don’t inject noise into any "home" activities (including dummy dawn/dusk).
     for (int i = 0; i < n; i++)
     {
-        if (activities[i].group == 0)
+        if (ctx->activities[i].group == 0)
         {
-            eps_participation[i] = 0.0;
-            eps_start_time[i] = 0.0;
-            eps_duration[i] = 0.0;
+            ctx->eps_participation[i] = 0.0;
+            ctx->eps_start_time[i] = 0.0;
+            ctx->eps_duration[i] = 0.0;
             for (int mode = 0; mode < 8; mode++)
             {
-                eps_charging[i * 8 + mode] = 0.0;
+                ctx->eps_charging[i * 8 + mode] = 0.0;
             }
         }
     }
@@ -210,915 +244,3570 @@ void initialize_charge_rates(void) // initialise these rates per eqn (39) in pap
     rapid_charge_rate = (rapid_charge_power / battery_capacity) * fraction_of_hours_per_interval;
 }
 
-double initialise_SOC(unsigned int seed_val)
+/* Same as initialize_charge_rates() and initialise_tou_times_intervals(), on the parameters of a context */
+static void derive_context_parameters(SolverContext *ctx)
 {
-    if (!rng_seeded)
+    SolverParams *p = &ctx->p;
+    if (p->time_interval <= 0)
     {
-        seed_random(seed_val);
-        rng_seeded = 1;
+        return; // set_general_parameters() not called yet
     }
-    double output;
-    output = normal_random(initial_soc_mean, initial_soc_std_dev);
-
-    // // Clamp to valid SOC range [0.0, 1.0]
-    // if (output < 0.0) output = 0.0;
-    // if (output > 1.0) output = 1.0;
-
-    return output;
+    double fraction_of_hours_per_interval = p->time_interval / 60.0;
+    ctx->slow_charge_rate = (p->slow_charge_power / p->battery_capacity) * fraction_of_hours_per_interval;
+    ctx->fast_charge_rate = (p->fast_charge_power / p->battery_capacity) * fraction_of_hours_per_interval;
+    ctx->rapid_charge_rate = (p->rapid_charge_power / p->battery_capacity) * fraction_of_hours_per_interval;
+
+    ctx->peak_start_interval = (p->peak_start * 60) / p->time_interval;
+    ctx->peak_end_interval = (p->peak_end * 60) / p->time_interval;
+    ctx->midpeak1_start_interval = (p->midpeak1_start * 60) / p->time_interval;
+    ctx->midpeak1_end_interval = (p->midpeak1_end * 60) / p->time_interval;
+    ctx->midpeak2_start_interval = (p->midpeak2_start * 60) / p->time_interval;
+    ctx->midpeak2_end_interval = (p->midpeak2_end * 60) / p->time_interval;
 }
 
-void set_random_seed(unsigned int seed_value)
+/* Copies the current global parameters into p, e.g. to start a context from the defaults */
+void get_general_parameters(SolverParams *p)
 {
-    seed = seed_value;
-    // Seed immediately so all subsequent random draws (initial SOC, utility error term)
-    // are controlled by this seed.
-    seed_random(seed_value);
-    rng_seeded = 1;
+    p->horizon = horizon;
+    p->time_interval = time_interval;
+    p->speed = speed;
+    p->travel_time_penalty = travel_time_penalty;
+    for (int i = 0; i < 9; i++)
+    {
+        p->asc_parameters[i] = asc_parameters[i];
+        p->early_parameters[i] = early_parameters[i];
+        p->late_parameters[i] = late_parameters[i];
+        p->long_parameters[i] = long_parameters[i];
+        p->short_parameters[i] = short_parameters[i];
+    }
+    p->battery_capacity = battery_capacity;
+    p->soc_full = soc_full;
+    p->soc_threshold = soc_threshold;
+    p->energy_consumption_rate = energy_consumption_rate;
+    p->initial_soc_mean = initial_soc_mean;
+    p->initial_soc_std_dev = initial_soc_std_dev;
+    p->slow_charge_power = slow_charge_power;
+    p->fast_charge_power = fast_charge_power;
+    p->rapid_charge_power = rapid_charge_power;
+    p->home_slow_charge_price = home_slow_charge_price;
+    p->AC_charge_price = AC_charge_price;
+    p->public_dc_charge_price = public_dc_charge_price;
+    p->tou_peak_factor = tou_peak_factor;
+    p->tou_midpeak_factor = tou_midpeak_factor;
+    p->tou_offpeak_factor = tou_offpeak_factor;
+    p->peak_start = peak_start;
+    p->peak_end = peak_end;
+    p->midpeak1_start = midpeak1_start;
+    p->midpeak1_end = midpeak1_end;
+    p->midpeak2_start = midpeak2_start;
+    p->midpeak2_end = midpeak2_end;
+    p->gamma_charge_work = gamma_charge_work;
+    p->gamma_charge_non_work = gamma_charge_non_work;
+    p->gamma_charge_home = gamma_charge_home;
+    p->theta_soc = theta_soc;
+    p->beta_delta_soc = beta_delta_soc;
+    p->beta_charge_cost = beta_charge_cost;
 }
 
-void set_fixed_initial_soc(double soc)
+//////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////// SOLVER CONTEXT /////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/* Returns a new context holding the current global parameters and no activities, NULL if out of memory */
+SolverContext *ctx_create(void)
 {
-    fixed_initial_soc_enabled = 1;
-    fixed_initial_soc_value = soc;
+    SolverContext *ctx = (SolverContext *)calloc(1, sizeof(SolverContext));
+    if (ctx == NULL)
+    {
+        return NULL;
+    }
+    get_general_parameters(&ctx->p);
+    derive_context_parameters(ctx);
+    build_charge_tables(ctx); // retried by ctx_set_params(), ctx_solve() fails without them
+    pool_init(&ctx->label_pool, sizeof(Label), 4096);
+    ctx->utility_error_std_dev = 1.0;
+    ctx->fixed_initial_soc_value = 0.30;
+    ctx->seed = seed;
+    return ctx;
+}
 
-    // Clamp to valid SOC range [0.0, 1.0]
-    if (fixed_initial_soc_value < 0.0)
-        fixed_initial_soc_value = 0.0;
-    if (fixed_initial_soc_value > 1.0)
-        fixed_initial_soc_value = 1.0;
+/* Frees a context and everything it owns, labels of its last solve included */
+void ctx_destroy(SolverContext *ctx)
+{
+    if (ctx == NULL)
+    {
+        return;
+    }
+    ctx_free_bucket(ctx);
+    pool_destroy(&ctx->label_pool);
+    free_utility_error_terms(ctx);
+    if (!ctx->shared_tables)
+    {
+        free(ctx->travel_intervals);
+        free(ctx->travel_soc);
+        free(ctx->succ_offsets);
+        free(ctx->succ_list);
+        free(ctx->succ_rejects);
+    }
+    free(ctx->location);
+    free(ctx->charge_price);
+    free(ctx->charge_tariff);
+    free(ctx->completion_bound);
+    for (int a = 0; a < ctx->frontier_n; a++)
+    {
+        free(ctx->frontier[a].utility);
+    }
+    free(ctx->frontier);
+    for (int i = 0; i < ctx->n_expand_pools; i++)
+    {
+        pool_destroy(&ctx->expand_pools[i]);
+    }
+    free(ctx->expand_pools);
+    free(ctx->candidates);
+    free(ctx->activities);
+    free(ctx->iteration_stats);
+    free(ctx->kept_schedule);
+    free(ctx);
 }
 
-void clear_fixed_initial_soc(void)
+/* Context used by the process-wide API, created on first use */
+SolverContext *global_context(void)
 {
-    fixed_initial_soc_enabled = 0;
+    static SolverContext *global_ctx = NULL;
+    if (global_ctx == NULL)
+    {
+        global_ctx = ctx_create();
+        if (global_ctx == NULL)
+        {
+            fprintf(stderr, "global_context: out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return global_ctx;
 }
 
-void set_utility_error_std_dev(double std_dev)
+/*  Builds what every solve of the current activities and parameters reads but never writes:
+    the travel tables and the successor lists. ctx_solve() does it on demand, call it first to share
+    the tables with ctx_create_sharing(). Returns 0 on success, -1 if not set up or out of memory */
+int ctx_prepare(SolverContext *ctx)
 {
-    if (std_dev < 0.0)
+    if (ctx->activities == NULL || ctx->max_num_activities <= 0 || ctx->p.horizon <= 1 || ctx->travel_intervals == NULL)
     {
-        std_dev = 0.0;
+        return -1;
+    }
+    if (!ctx->succ_valid && !build_successor_lists(ctx))
+    {
+        return -1;
     }
-    utility_error_std_dev = std_dev;
+    return 0;
 }
 
-void set_general_parameters(int pyhorizon, double pyspeed, double pytravel_time_penalty, int pytime_interval,
-                            double *asc, double *early, double *late, double *longp, double *shortp
-                            // int pyflexible, int pymid_flex, int pynot_flex
-)
+/*  Copies the solver settings of src into ctx: error term std dev, DSSR, bounding, bucket, dominance and
+    budget options, RNG and random stream (see the ctx_set_* functions). Not the parameters, activities,
+    seed, initial SOC or expansion threads, which belong to the person or the caller */
+void ctx_copy_settings(SolverContext *ctx, const SolverContext *src)
 {
-    speed = pyspeed;
-    travel_time_penalty = pytravel_time_penalty;
-    horizon = pyhorizon;
-    time_interval = pytime_interval;
-    // flex = pyflexible;
-    // mid_flex = pymid_flex;
-    // not_flex = pynot_flex;
-    initialize_charge_rates();
-    initialise_tou_times_intervals();
+    ctx->utility_error_std_dev = src->utility_error_std_dev;
+    ctx->incremental_dssr = src->incremental_dssr;
+    ctx->bounding = src->bounding;
+    ctx->sliding_bucket = src->sliding_bucket;
+    ctx->dominance = src->dominance;
+    ctx->soc_epsilon = src->soc_epsilon;
+    ctx->cost_epsilon = src->cost_epsilon;
+    ctx->beam_width = src->beam_width;
+    ctx->max_live_labels = src->max_live_labels;
+    ctx->deadline = src->deadline;
+    ctx->rng = src->rng;
+    ctx->random_stream = src->random_stream;
+}
 
-    for (int i = 0; i < 9; i++)
+/*  Returns a context with the parameters, activities and solver settings of src that reads the travel
+    tables and successor lists of src instead of building its own, NULL if out of memory or src is not
+    prepared (see ctx_prepare). src must outlive it and keep its activities and parameters meanwhile.
+    Setting new activities, a skim or travel parameters on the new context gives it its own tables again */
+SolverContext *ctx_create_sharing(const SolverContext *src)
+{
+    if (!src->succ_valid)
     {
-        asc_parameters[i] = asc[i];
-        early_parameters[i] = early[i];
-        late_parameters[i] = late[i];
-        long_parameters[i] = longp[i];
-        short_parameters[i] = shortp[i];
+        return NULL;
+    }
+    SolverContext *ctx = ctx_create();
+    if (ctx == NULL)
+    {
+        return NULL;
+    }
+    ctx->activities = (Activity *)malloc((size_t)src->max_num_activities * sizeof(Activity));
+    if (ctx->activities == NULL)
+    {
+        ctx_destroy(ctx);
+        return NULL;
+    }
+    memcpy(ctx->activities, src->activities, (size_t)src->max_num_activities * sizeof(Activity));
+    ctx->max_num_activities = src->max_num_activities;
+    ctx->activities_cap = src->max_num_activities;
+    ctx->p = src->p;
+    derive_context_parameters(ctx);
+    if (!build_charge_tables(ctx))
+    {
+        ctx_destroy(ctx);
+        return NULL;
+    }
+    if (src->tariff_modes != 0)
+    {
+        size_t n_prices = (size_t)N_CHARGE_MODES * (size_t)src->charge_horizon;
+        ctx->charge_tariff = (double *)malloc(n_prices * sizeof(double));
+        if (ctx->charge_tariff == NULL)
+        {
+            ctx_destroy(ctx);
+            return NULL;
+        }
+        memcpy(ctx->charge_tariff, src->charge_tariff, n_prices * sizeof(double));
+        ctx->tariff_modes = src->tariff_modes;
+        build_charge_tables(ctx);
+    }
 
+    ctx->location = (int *)malloc((size_t)src->max_num_activities * sizeof(int));
+    if (ctx->location == NULL)
+    {
+        ctx_destroy(ctx);
+        return NULL;
     }
-};
+    memcpy(ctx->location, src->location, (size_t)src->max_num_activities * sizeof(int));
+    ctx->location_cap = src->max_num_activities;
+    ctx->travel_intervals = src->travel_intervals;
+    ctx->travel_soc = src->travel_soc;
+    ctx->travel_n = src->travel_n;
+    ctx->travel_skim_loaded = src->travel_skim_loaded;
+    ctx->succ_offsets = src->succ_offsets;
+    ctx->succ_list = src->succ_list;
+    ctx->succ_cap = src->succ_cap;
+    ctx->succ_rejects = src->succ_rejects;
+    ctx->succ_valid = 1;
+    ctx->shared_tables = 1;
+
+    ctx_copy_settings(ctx, src);
+    ctx->fixed_initial_soc_enabled = src->fixed_initial_soc_enabled;
+    ctx->fixed_initial_soc_value = src->fixed_initial_soc_value;
+    ctx->seed = src->seed;
+    return ctx;
+}
 
-void set_activities(Activity *activities_data, int pynum_activities)
+// before the tables of a sharing context change: the travel tables become its own copy,
+// the successor lists are dropped and rebuilt on the next solve
+static void unshare_tables(SolverContext *ctx)
 {
-    activities = activities_data;
-    max_num_activities = pynum_activities;
+    if (!ctx->shared_tables)
+    {
+        return;
+    }
+    const int *tt = ctx->travel_intervals;
+    const double *soc = ctx->travel_soc;
+    int n = ctx->travel_n;
+    ctx->travel_intervals = NULL;
+    ctx->travel_soc = NULL;
+    ctx->travel_n = 0;
+    if (tt != NULL && alloc_travel_tables(ctx, n))
+    {
+        memcpy(ctx->travel_intervals, tt, (size_t)n * (size_t)n * sizeof(int));
+        memcpy(ctx->travel_soc, soc, (size_t)n * (size_t)n * sizeof(double));
+    }
+    ctx->succ_offsets = NULL;
+    ctx->succ_list = NULL;
+    ctx->succ_cap = 0;
+    ctx->succ_rejects = NULL;
+    ctx->succ_valid = 0;
+    ctx->shared_tables = 0;
 }
 
-/* Allocates memory for and initializes a new Label with the specified Activity */
-static Label *create_label(Activity *aa)
+void ctx_set_params(SolverContext *ctx, const SolverParams *p)
 {
-    Label *L = malloc(sizeof(Label));
-    L->act_id = 0;
-    L->time = aa->min_duration; // double check this, make sure it is in minutes
-    L->start_time = 0;
-    L->utility = 0;
-    L->deviation_start = 0;
-    L->deviation_dur = 0;
-    L->duration = aa->min_duration;
-    L->previous = NULL;
-    L->act = aa;
-    L->mem = malloc(sizeof(Group_mem));
-    L->mem->g = 0;
-    L->mem->next = NULL;
-    L->mem->previous = NULL;
+    // the travel tables only depend on these, skip the rebuild when a caller re-sends the same parameters
+    int travel_changed = ctx->travel_intervals == NULL || p->speed != ctx->p.speed ||
+                         p->time_interval != ctx->p.time_interval ||
+                         p->energy_consumption_rate != ctx->p.energy_consumption_rate ||
+                         p->battery_capacity != ctx->p.battery_capacity;
+    if (travel_changed || p->horizon != ctx->p.horizon)
+    {
+        unshare_tables(ctx);
+        ctx->succ_valid = 0;
+    }
+    int changed = memcmp(p, &ctx->p, sizeof(*p)) != 0;
+    ctx->p = *p;
+    derive_context_parameters(ctx);
+    if (changed || ctx->charge_price == NULL)
+    {
+        build_charge_tables(ctx);
+    }
+    if (travel_changed && !ctx->travel_skim_loaded)
+    {
+        build_travel_tables(ctx);
+    }
+}
 
-    // Ensure the RNG is seeded before any random draws (initial SOC and/or utility error term).
-    if (!rng_seeded)
+/*  Copies n activities into the context, so the caller's array is not referenced after the call.
+    DSSR memory starts from the memory given in activities_data.
+    Returns 0 on success, -1 if out of memory */
+int ctx_set_activities(SolverContext *ctx, const Activity *activities_data, int n)
+{
+    unshare_tables(ctx);
+    if (n > ctx->activities_cap)
+    {
+        Activity *a = (Activity *)realloc(ctx->activities, (size_t)n * sizeof(Activity));
+        if (a == NULL)
+        {
+            return -1;
+        }
+        ctx->activities = a;
+        ctx->activities_cap = n;
+    }
+    if (n > 0)
     {
-        seed_random(seed);
-        rng_seeded = 1;
+        memcpy(ctx->activities, activities_data, (size_t)n * sizeof(Activity));
     }
+    ctx->max_num_activities = n;
+    ctx->travel_skim_loaded = 0;
+    ctx->succ_valid = 0;
+    build_travel_tables(ctx);
+    return 0;
+}
 
-    // Initialize SOC
-    if (fixed_initial_soc_enabled)
+/*  Replaces the euclidean travel tables with a network skim for the current activities.
+    tt[from * n + to] is the travel time in intervals and soc[from * n + to] the SOC used
+    (fraction of battery capacity), n must match the number of activities. Activities at the same place with
+    the same rows and columns share a location of the tables, the others get their own.
+    The skim is kept until the next call to ctx_set_activities(). Returns 0 on success, -1 otherwise */
+int ctx_set_travel_skim(SolverContext *ctx, int *tt, double *soc, int n)
+{
+    if (n != ctx->max_num_activities || tt == NULL || soc == NULL)
     {
-        initial_soc = fixed_initial_soc_value;
+        printf("\n set_travel_skim: expected a %d x %d skim, got n = %d", ctx->max_num_activities, ctx->max_num_activities, n);
+        return -1;
     }
-    else
+    unshare_tables(ctx);
+    int n_locations = build_locations(ctx, tt, soc);
+    if (n_locations < 0 || !alloc_travel_tables(ctx, n_locations))
     {
-        initial_soc = initialise_SOC(seed);
+        return -1;
     }
-    L->soc_at_activity_start = initial_soc; // battery state of charge at the start of activity 𝑎
-    L->current_soc = initial_soc;
-    L->charge_duration = 0;
-    L->delta_soc = 0; // clarify what is meant by this cf (10)
-    L->charge_cost_at_activity_start = 0;
-    L->current_charge_cost = 0;
+    for (int from = 0; from < n; from++)
+    {
+        for (int to = 0; to < n; to++)
+        {
+            int i = ctx->location[ctx->activities[from].id] * n_locations + ctx->location[ctx->activities[to].id];
+            ctx->travel_intervals[i] = tt[from * n + to] < 0 ? 0 : tt[from * n + to];
+            ctx->travel_soc[i] = soc[from * n + to];
+        }
+    }
+    ctx->travel_skim_loaded = 1;
+    ctx->succ_valid = 0;
+    return 0;
+}
 
-    // L->delta_soc_during_interval = 0; // SOC increase during a single time interval, if occurring
-    // L->total_delta_soc = 0; // total SOC increase over charging period so far
-    // L->soc = initial_soc; // check this - might be parsed from individual data
+void ctx_set_random_seed(SolverContext *ctx, unsigned int seed_value)
+{
+    ctx->seed = seed_value;
+    // Seed immediately so all subsequent random draws (initial SOC, utility error term)
+    // are controlled by this seed.
+    seed_random(ctx->rng_state, seed_value);
+    ctx->rng_seeded = 1;
+    ctx->draw_id = 0;
+}
 
-    return L;
-};
+/*  RNG_ERAND48 (the default) continues one sequence per context, so a draw depends on every draw made before it.
+    With RNG_PHILOX the error terms and the initial SOC of a DP pass are a function of the seed, the stream
+    (ctx_set_random_stream, e.g. the person id), the draw id (DP passes that drew since the seed or stream was
+    set) and the index of the term: the same on any thread, whatever was solved before */
+void ctx_set_rng(SolverContext *ctx, int rng)
+{
+    ctx->rng = rng == RNG_PHILOX ? RNG_PHILOX : RNG_ERAND48;
+}
 
-//////////////////////////////////////////////////////////////////////////////////////////////////////////
-///////////////////// HELPER FUNCTIONS /////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////////////////////////////////////////
+void ctx_set_random_stream(SolverContext *ctx, unsigned int stream)
+{
+    ctx->random_stream = stream;
+    ctx->draw_id = 0;
+}
 
-static double distance_x(Activity *a1, Activity *a2) // this will change as we will just reference a skim matrix
+void ctx_set_fixed_initial_soc(SolverContext *ctx, double soc)
 {
-    // Distance in metres
-    double dx = (double)(a2->x - a1->x);
-    double dy = (double)(a2->y - a1->y);
-    double dist = sqrt(dx * dx + dy * dy);
-    return dist;
-};
+    ctx->fixed_initial_soc_enabled = 1;
+    ctx->fixed_initial_soc_value = soc;
+
+    // Clamp to valid SOC range [0.0, 1.0]
+    if (ctx->fixed_initial_soc_value < 0.0)
+        ctx->fixed_initial_soc_value = 0.0;
+    if (ctx->fixed_initial_soc_value > 1.0)
+        ctx->fixed_initial_soc_value = 1.0;
+}
+
+void ctx_clear_fixed_initial_soc(SolverContext *ctx)
+{
+    ctx->fixed_initial_soc_enabled = 0;
+}
 
-static int travel_time(Activity *a1, Activity *a2) // returns travel time in no of intervals
+void ctx_set_utility_error_std_dev(SolverContext *ctx, double std_dev)
 {
-    double dist = distance_x(a1, a2); // this will change too
-    double minutes = dist / speed;    // speed is metres per minute
-    int intervals = (int)ceil(minutes / (double)time_interval);
-    if (intervals < 0)
+    if (std_dev < 0.0)
     {
-        intervals = 0;
+        std_dev = 0.0;
     }
-    return intervals;
-};
+    ctx->utility_error_std_dev = std_dev;
+}
 
-static double energy_consumed_soc(Activity *a1, Activity *a2) // energy consumed in SOC going from one activity to another
+/*  Incremental DSSR: after a cycle is found, keep the labels the new memory cannot change and only
+    rebuild the DP from the earliest time an activity with new memory can be entered.
+    The error terms and the initial SOC are then drawn once per solve instead of once per DP pass */
+void ctx_set_incremental_dssr(SolverContext *ctx, int enabled)
 {
-    double distance_km = distance_x(a1, a2) / 1000;
-    double energy_kWh = energy_consumption_rate * distance_km;
-
-    // convert to a percent of the battery capacity (ie represent in SOC)
-    double soc_consumed = energy_kWh / battery_capacity;
+    ctx->incremental_dssr = enabled != 0;
+}
 
-    return soc_consumed;
-};
+/*  Bounding: rows whose utility plus an optimistic bound on what the rest of the day can add stays below
+    the best dusk label of the DP pass so far are not expanded. Their labels are still inserted: the cell rule
+    only compares utility and memory, a label dropped before it would let the labels it dominates through,
+    with other durations and SOCs, and change the schedules found. make perf-check solves every run with and
+    without bounding and fails if one differs */
+void ctx_set_bounding(SolverContext *ctx, int enabled)
+{
+    ctx->bounding = enabled != 0;
+}
 
-static void get_charge_rate_and_price(Activity *a, double result[2])
-// need to make sure activity charge modes are parsed to ints for this to work
-// all charge rates are in % terms of battery capacity, not absolute terms
+/*  Dominance resources: with DOMINANCE_SOC a label only dominates labels of its cell with no more battery left,
+    with DOMINANCE_CHARGE_COST only those that spent no less on charging, on top of the utility and memory rule.
+    An epsilon > 0 compares its resource on a grid of that step, labels in the same step count as equal:
+    fewer labels, the result is then approximate. 0 (the default) keeps the utility and memory rule alone.
+    Both resources with zero epsilons keep so many labels that a solve takes seconds to minutes, the command
+    line requires both epsilons then; even with them it is far slower than one resource. Extra resources are
+    no guarantee of a better schedule either: DOMINANCE_CHARGE_COST alone can find a lower utility.
+    DOMINANCE_ACROSS_TIME also checks against the labels that entered the same activity at an earlier interval
+    (update_frontiers()), which under the utility and memory rule is approximate and changes the schedules */
+void ctx_set_dominance(SolverContext *ctx, int resources, double soc_epsilon, double cost_epsilon)
 {
-    double charge_rate = 0.0;
-    double charge_price = 0.0;
+    ctx->dominance = resources & (DOMINANCE_SOC | DOMINANCE_CHARGE_COST | DOMINANCE_ACROSS_TIME);
+    ctx->soc_epsilon = soc_epsilon > 0 ? soc_epsilon : 0.0;
+    ctx->cost_epsilon = cost_epsilon > 0 ? cost_epsilon : 0.0;
+}
 
-    switch (a->charge_mode)
-    {
-    case 0: // not charging
-        charge_rate = 0;
-        charge_price = 0;
-        break;
+/*  Sliding bucket: instead of one row of cells per time interval, a ring of rows as long as the longest travel
+    time plus a row for dusk, each ring row being emptied once its time is expanded. The labels stay in their
+    pool for the back pointers. Same schedules, the bucket no longer grows with the horizon.
+    Incremental DSSR then rebuilds whole passes, the earlier cells it would keep are gone */
+void ctx_set_sliding_bucket(SolverContext *ctx, int enabled)
+{
+    ctx->sliding_bucket = enabled != 0;
+}
 
-    case 1: // slow charging
-        charge_rate = slow_charge_rate;
-        charge_price = home_slow_charge_price;
-        // if (a->group == 0)
-        // {
-        //     charge_price = home_slow_charge_price;
-        // }
-        // if (a->group != 0)
-        // {
-        //     charge_price = AC_charge_price;
-        // }
-        break;
+/*  Expansion threads: the rows of each time interval are generated by n threads, the caller included, then
+    inserted in the serial order, so the schedules and the bucket are exactly those of the serial sweep.
+    Only intervals with many rows are split, for instances with many candidate activities. n <= 1 is serial.
+    Not copied by ctx_create_sharing(): those contexts already run on threads of their own */
+void ctx_set_expansion_threads(SolverContext *ctx, int n)
+{
+    ctx->expansion_threads = n > 1 ? n : 1;
+}
 
-    case 2: // fast charging
-        charge_rate = fast_charge_rate;
-        charge_price = AC_charge_price;
-        break;
+/*  Budgets for an anytime solve, 0 for no limit. A cell keeps at most beam_width rows, those of highest
+    utility; once max_live_labels labels are live a DP pass only keeps the moves to dusk, so it still ends
+    with schedules; after deadline seconds of wall clock the pass in progress stops, no further DSSR pass
+    is started and the solve returns the schedule of highest utility without group cycle among the dusk
+    rows of all its passes. The best rows of the first passes usually repeat a group, so a deadline shorter
+    than a few passes often ends in SOLVE_NO_SCHEDULE (building the successor lists of a new context is not
+    cut). ctx_get_solve_status() tells which limit cut the search: with none the schedule is the one of the
+    unlimited solve */
+void ctx_set_budget(SolverContext *ctx, int beam_width, long max_live_labels, double deadline)
+{
+    ctx->beam_width = beam_width > 0 ? beam_width : 0;
+    ctx->max_live_labels = max_live_labels > 0 ? max_live_labels : 0;
+    ctx->deadline = deadline > 0.0 ? deadline : 0.0;
+}
 
-    case 3: // rapid charging
-        charge_rate = rapid_charge_rate;
-        charge_price = public_dc_charge_price;
-        break;
+// Result accessors of the last ctx_solve()
+int ctx_get_count(const SolverContext *ctx) { return ctx->DSSR_count; }
+double ctx_get_total_time(const SolverContext *ctx) { return ctx->total_time; }
+unsigned int ctx_get_solve_status(const SolverContext *ctx) { return ctx->solve_status; }
+Label *ctx_get_final_schedule(const SolverContext *ctx) { return ctx->final_schedule; }
+double ctx_get_initial_soc(const SolverContext *ctx) { return ctx->initial_soc; }
 
-    case 4: // free slow charging
-        charge_rate = slow_charge_rate;
-        charge_price = 0.0;
-        break;
+/* Heap held by a context, the label slabs are counted whole */
+static size_t ctx_bytes_allocated(const SolverContext *ctx)
+{
+    size_t bytes = sizeof(SolverContext);
+    const Pool *pool = &ctx->label_pool;
+    bytes += (size_t)pool->n_slabs * pool->elem_size * pool->per_slab + (size_t)pool->cap_slabs * sizeof(char *);
+    for (int i = 0; i < ctx->n_expand_pools; i++)
+    {
+        pool = &ctx->expand_pools[i];
+        bytes += sizeof(Pool) + (size_t)pool->n_slabs * pool->elem_size * pool->per_slab +
+                 (size_t)pool->cap_slabs * sizeof(char *);
+    }
+    bytes += (size_t)ctx->candidates_cap * sizeof(Candidate);
 
-    case 5: // free fast charging
-        charge_rate = fast_charge_rate;
-        charge_price = 0.0;
-        break;
+    size_t row_bytes = 5 * sizeof(double) + sizeof(StayState) + sizeof(Label *) + sizeof(Group_set);
+    for (int i = 0; i < ctx->bucket_rows; i++)
+    {
+        for (int j = 0; j < ctx->bucket_cols; j++)
+        {
+            bytes += (size_t)ctx->bucket[i][j].cap * row_bytes;
+        }
+    }
+    bytes += (size_t)ctx->bucket_rows * (sizeof(L_list *) + (size_t)ctx->bucket_cols * sizeof(L_list) +
+                                         (size_t)ctx->active_words * sizeof(uint64_t));
 
-    case 6: // free rapid charging
-        charge_rate = rapid_charge_rate;
-        charge_price = 0.0;
-        break;
+    if (ctx->succ_offsets != NULL && !ctx->shared_tables)
+    {
+        size_t n_cells = (size_t)ctx->max_num_activities * (size_t)ctx->p.horizon;
+        bytes += (n_cells + 1) * sizeof(int) + (size_t)ctx->succ_cap * sizeof(int);
+        if (ctx->succ_rejects != NULL)
+        {
+            bytes += n_cells * N_STATIC_REJECT * sizeof(int);
+        }
     }
-    result[0] = charge_rate;
-    result[1] = charge_price;
+    if (!ctx->shared_tables)
+    {
+        bytes += (size_t)ctx->travel_n * (size_t)ctx->travel_n * (sizeof(int) + sizeof(double));
+    }
+    bytes += (size_t)ctx->location_cap * sizeof(int);
+    bytes += (size_t)ctx->eps_n * (3 + (size_t)ctx->eps_n + 8) * sizeof(double);
+    bytes += (size_t)N_CHARGE_MODES * (size_t)ctx->charge_horizon * (ctx->charge_tariff != NULL ? 2 : 1) * sizeof(double);
+    bytes += ctx->bound_cap * sizeof(double);
+    for (int a = 0; a < ctx->frontier_n; a++)
+    {
+        bytes += (size_t)ctx->frontier[a].cap * (3 * sizeof(double) + sizeof(Group_set));
+    }
+    bytes += (size_t)ctx->frontier_n * sizeof(ArrivalFrontier);
+    bytes += (size_t)ctx->activities_cap * sizeof(Activity);
+    bytes += (size_t)ctx->iteration_stats_cap * sizeof(DSSRIterationStats);
+    return bytes;
 }
 
-static double get_tou_factor(int time)
+/* Fills out with the counters of the last solve, see SolverStats */
+void ctx_get_solver_stats(const SolverContext *ctx, SolverStats *out)
 {
-    // double hour = (time * time_interval) / 60; // gives the time in 24hour standard
+    *out = ctx->stats;
+    out->enabled = SOLVER_STATS;
+    out->dssr_iterations = ctx->DSSR_count;
+    out->bytes_allocated = ctx_bytes_allocated(ctx);
+}
 
-    if (time >= peak_start_interval && time < peak_end_interval)
+/*  Copies the per pass work of the last solve into out (at most cap records).
+    Returns the number of passes, DSSR count + 1 after a successful solve */
+int ctx_get_dssr_iteration_stats(const SolverContext *ctx, DSSRIterationStats *out, int cap)
+{
+    int n = ctx->n_iteration_stats < cap ? ctx->n_iteration_stats : cap;
+    if (n > 0)
     {
-        return tou_peak_factor;
+        memcpy(out, ctx->iteration_stats, (size_t)n * sizeof(DSSRIterationStats));
     }
-    else if ((time >= midpeak1_start_interval && time < midpeak1_end_interval) || (time >= midpeak2_start_interval && time < midpeak2_end_interval))
+    return ctx->n_iteration_stats;
+}
+
+static double ctx_initialise_soc(SolverContext *ctx, unsigned int seed_val)
+{
+    if (!ctx->rng_seeded)
     {
-        return tou_midpeak_factor;
+        seed_random(ctx->rng_state, seed_val);
+        ctx->rng_seeded = 1;
     }
-    else
+    double output;
+    if (ctx->rng == RNG_PHILOX)
     {
-        return tou_offpeak_factor;
+        uint32_t key[2] = {seed_val, ctx->random_stream};
+        philox_normals(key, ctx->draw_id, DRAW_INITIAL_SOC, 0, &output, 1, ctx->p.initial_soc_mean,
+                       ctx->p.initial_soc_std_dev);
+        return output;
     }
+    output = normal_random(ctx->rng_state, ctx->p.initial_soc_mean, ctx->p.initial_soc_std_dev);
+
+    // // Clamp to valid SOC range [0.0, 1.0]
+    // if (output < 0.0) output = 0.0;
+    // if (output > 1.0) output = 1.0;
+
+    return output;
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////
-/////////////////////// BIG FUNCTIONS ////////////////////////////////////////////////////////////////////
+///////////////////// GLOBAL API /////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-/*  Determines if an Activity a can be added to a sequence ending in label L.
-    It returns 1 if it's feasible and 0 if it's not.
-    Note - a is the considered activity, but does not yet have fixed duration
-    or charging participation.
+double initialise_SOC(unsigned int seed_val)
+{
+    return ctx_initialise_soc(global_context(), seed_val);
+}
+
+void set_random_seed(unsigned int seed_value)
+{
+    seed = seed_value;
+    ctx_set_random_seed(global_context(), seed_value);
+}
+
+void set_incremental_dssr(int enabled)
+{
+    ctx_set_incremental_dssr(global_context(), enabled);
+}
+
+void set_bounding(int enabled)
+{
+    ctx_set_bounding(global_context(), enabled);
+}
+
+void set_sliding_bucket(int enabled)
+{
+    ctx_set_sliding_bucket(global_context(), enabled);
+}
+
+void set_expansion_threads(int n)
+{
+    ctx_set_expansion_threads(global_context(), n);
+}
+
+void set_rng(int rng)
+{
+    ctx_set_rng(global_context(), rng);
+}
+
+void set_random_stream(unsigned int stream)
+{
+    ctx_set_random_stream(global_context(), stream);
+}
+
+void set_dominance(int resources, double soc_epsilon, double cost_epsilon)
+{
+    ctx_set_dominance(global_context(), resources, soc_epsilon, cost_epsilon);
+}
+
+void set_budget(int beam_width, long max_live_labels, double deadline)
+{
+    ctx_set_budget(global_context(), beam_width, max_live_labels, deadline);
+}
+
+unsigned int get_solve_status(void)
+{
+    return ctx_get_solve_status(global_context());
+}
+
+int get_dssr_iteration_stats(DSSRIterationStats *out, int cap)
+{
+    return ctx_get_dssr_iteration_stats(global_context(), out, cap);
+}
+
+/*  ctx_export_schedule() on the global context: the rows are copies, free_bucket() or the next solve
+    can follow at once. Python maps out onto a NumPy structured array, see export_schedule() in testing_check.py */
+int export_schedule(ScheduleRow *out, int cap)
+{
+    return ctx_export_schedule(global_context(), out, cap);
+}
+
+void get_solver_stats(SolverStats *out)
+{
+    ctx_get_solver_stats(global_context(), out);
+}
+
+void set_fixed_initial_soc(double soc)
+{
+    ctx_set_fixed_initial_soc(global_context(), soc);
+}
+
+void clear_fixed_initial_soc(void)
+{
+    ctx_clear_fixed_initial_soc(global_context());
+}
+
+void set_utility_error_std_dev(double std_dev)
+{
+    ctx_set_utility_error_std_dev(global_context(), std_dev);
+}
+
+void set_general_parameters(int pyhorizon, double pyspeed, double pytravel_time_penalty, int pytime_interval,
+                            double *asc, double *early, double *late, double *longp, double *shortp
+                            // int pyflexible, int pymid_flex, int pynot_flex
+)
+{
+    speed = pyspeed;
+    travel_time_penalty = pytravel_time_penalty;
+    horizon = pyhorizon;
+    time_interval = pytime_interval;
+    // flex = pyflexible;
+    // mid_flex = pymid_flex;
+    // not_flex = pynot_flex;
+    initialize_charge_rates();
+    initialise_tou_times_intervals();
+
+    for (int i = 0; i < 9; i++)
+    {
+        asc_parameters[i] = asc[i];
+        early_parameters[i] = early[i];
+        late_parameters[i] = late[i];
+        long_parameters[i] = longp[i];
+        short_parameters[i] = shortp[i];
+
+    }
+
+    SolverParams p;
+    get_general_parameters(&p);
+    ctx_set_params(global_context(), &p);
+};
+
+void set_activities(Activity *activities_data, int pynum_activities)
+{
+    SolverContext *ctx = global_context();
+    if (ctx_set_activities(ctx, activities_data, pynum_activities) != 0)
+    {
+        fprintf(stderr, "set_activities: out of memory\n");
+        return;
+    }
+    // the global context works on its own copy, DSSR memory is written there
+    activities = ctx->activities;
+    max_num_activities = pynum_activities;
+}
+
+void set_travel_skim(int *tt, double *soc, int n)
+{
+    ctx_set_travel_skim(global_context(), tt, soc, n);
+}
+
+int set_charge_tariff(int charge_mode, double *price, int n)
+{
+    return ctx_set_charge_tariff(global_context(), charge_mode, price, n);
+}
+
+/* Allocates memory for and initializes a new Label with the specified Activity */
+static Label *create_label(SolverContext *ctx, Activity *aa)
+{
+    Label *L = ctx_alloc_label(ctx);
+    L->act_id = 0;
+    L->time = aa->min_duration; // double check this, make sure it is in minutes
+    L->start_time = 0;
+    L->utility = 0;
+    L->duration = aa->min_duration;
+    L->previous = NULL;
+    L->mem = GROUP_BIT(0);
+
+    // Ensure the RNG is seeded before any random draws (initial SOC and/or utility error term).
+    if (!ctx->rng_seeded)
+    {
+        seed_random(ctx->rng_state, ctx->seed);
+        ctx->rng_seeded = 1;
+    }
+
+    // Initialize SOC
+    if (ctx->reuse_draws)
+    {
+        // same initial SOC as the previous pass of this solve
+    }
+    else if (ctx->fixed_initial_soc_enabled)
+    {
+        ctx->initial_soc = ctx->fixed_initial_soc_value;
+    }
+    else
+    {
+        ctx->initial_soc = ctx_initialise_soc(ctx, ctx->seed);
+    }
+    L->soc_at_activity_start = ctx->initial_soc; // battery state of charge at the start of activity 𝑎
+    L->current_soc = ctx->initial_soc;
+    L->charge_duration = 0;
+    L->charge_cost_at_activity_start = 0;
+    L->current_charge_cost = 0;
+
+    // L->delta_soc_during_interval = 0; // SOC increase during a single time interval, if occurring
+    // L->total_delta_soc = 0; // total SOC increase over charging period so far
+    // L->soc = initial_soc; // check this - might be parsed from individual data
+
+    return L;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////// HELPER FUNCTIONS /////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static double distance_x(Activity *a1, Activity *a2) // only used to fill the travel tables when no skim is given
+{
+    // Distance in metres
+    double dx = (double)(a2->x - a1->x);
+    double dy = (double)(a2->y - a1->y);
+    double dist = sqrt(dx * dx + dy * dy);
+    return dist;
+};
+
+static int travel_time(const SolverContext *ctx, const Activity *a1, const Activity *a2) // returns travel time in no of intervals
+{
+    return ctx->travel_intervals[ctx->location[a1->id] * ctx->travel_n + ctx->location[a2->id]];
+};
+
+static double energy_consumed_soc(const SolverContext *ctx, const Activity *a1, const Activity *a2) // energy consumed in SOC going from one activity to another
+{
+    return ctx->travel_soc[ctx->location[a1->id] * ctx->travel_n + ctx->location[a2->id]];
+};
+
+/*  Groups the activities by location into ctx->location: two activities share one if they have the same
+    coordinates and, with a skim (tt and soc, n x n by activity id), the same rows and columns in it.
+    Locations are numbered in the order of their first activity. Returns the number of locations,
+    -1 if out of memory */
+static int build_locations(SolverContext *ctx, const int *tt, const double *soc)
+{
+    int n = ctx->max_num_activities;
+    if (n > ctx->location_cap)
+    {
+        int *location = (int *)realloc(ctx->location, (size_t)n * sizeof(int));
+        if (location == NULL)
+        {
+            return -1;
+        }
+        ctx->location = location;
+        ctx->location_cap = n;
+    }
+    int *first = (int *)malloc((size_t)(n > 0 ? n : 1) * sizeof(int)); // first activity id of each location
+    if (first == NULL)
+    {
+        return -1;
+    }
+    int n_locations = 0;
+    for (int k = 0; k < n; k++)
+    {
+        const Activity *a = &ctx->activities[k];
+        int loc = 0;
+        for (; loc < n_locations; loc++)
+        {
+            int r = first[loc];
+            if (ctx->activities[r].x != a->x || ctx->activities[r].y != a->y)
+            {
+                continue;
+            }
+            int same = 1;
+            for (int j = 0; tt != NULL && same && j < n; j++)
+            {
+                same = tt[a->id * n + j] == tt[r * n + j] && tt[j * n + a->id] == tt[j * n + r] &&
+                       soc[a->id * n + j] == soc[r * n + j] && soc[j * n + a->id] == soc[j * n + r];
+            }
+            if (same)
+            {
+                break;
+            }
+        }
+        if (loc == n_locations)
+        {
+            first[n_locations++] = a->id;
+        }
+        ctx->location[a->id] = loc;
+    }
+    free(first);
+    return n_locations;
+}
+
+/* (Re)allocates the travel tables for n locations */
+static int alloc_travel_tables(SolverContext *ctx, int n)
+{
+    if (ctx->travel_n != n || ctx->travel_intervals == NULL)
+    {
+        free(ctx->travel_intervals);
+        free(ctx->travel_soc);
+        ctx->travel_intervals = (int *)malloc((size_t)n * (size_t)n * sizeof(int));
+        ctx->travel_soc = (double *)malloc((size_t)n * (size_t)n * sizeof(double));
+        if (ctx->travel_intervals == NULL || ctx->travel_soc == NULL)
+        {
+            free(ctx->travel_intervals);
+            free(ctx->travel_soc);
+            ctx->travel_intervals = NULL;
+            ctx->travel_soc = NULL;
+            ctx->travel_n = 0;
+            return 0;
+        }
+        ctx->travel_n = n;
+    }
+    return 1;
+}
+
+/*  Fills the travel tables from the euclidean distance between the locations of the activities.
+    travel time = ceil(distance / speed) in intervals, SOC used = energy_consumption_rate * km / battery_capacity */
+static void build_travel_tables(SolverContext *ctx)
+{
+    // nothing to build until both the activities and the general parameters are set
+    if (ctx->activities == NULL || ctx->max_num_activities <= 0 || ctx->p.speed <= 0 || ctx->p.time_interval <= 0)
+    {
+        return;
+    }
+    int n = build_locations(ctx, NULL, NULL);
+    if (n < 0 || !alloc_travel_tables(ctx, n))
+    {
+        return;
+    }
+    // one activity per location, the first one: locations are numbered in the order of their first activity
+    Activity **at = (Activity **)malloc((size_t)n * sizeof(Activity *));
+    if (at == NULL)
+    {
+        return;
+    }
+    for (int k = 0, next = 0; k < ctx->max_num_activities; k++)
+    {
+        if (ctx->location[ctx->activities[k].id] == next)
+        {
+            at[next++] = &ctx->activities[k];
+        }
+    }
+    for (int from = 0; from < n; from++)
+    {
+        for (int to = 0; to < n; to++)
+        {
+            double dist = distance_x(at[from], at[to]);
+
+            double minutes = dist / ctx->p.speed; // speed is metres per minute
+            int intervals = (int)ceil(minutes / (double)ctx->p.time_interval);
+            if (intervals < 0)
+            {
+                intervals = 0;
+            }
+            ctx->travel_intervals[from * n + to] = intervals;
+
+            // convert the energy used to a percent of the battery capacity (ie represent in SOC)
+            double distance_km = dist / 1000;
+            double energy_kWh = ctx->p.energy_consumption_rate * distance_km;
+            ctx->travel_soc[from * n + to] = energy_kWh / ctx->p.battery_capacity;
+        }
+    }
+    free(at);
+}
+
+static void get_charge_rate_and_price(SolverContext *ctx, Activity *a, double result[2])
+// need to make sure activity charge modes are parsed to ints for this to work
+// all charge rates are in % terms of battery capacity, not absolute terms
+{
+    double charge_rate = 0.0;
+    double charge_price = 0.0;
+
+    switch (a->charge_mode)
+    {
+    case 0: // not charging
+        charge_rate = 0;
+        charge_price = 0;
+        break;
+
+    case 1: // slow charging
+        charge_rate = ctx->slow_charge_rate;
+        charge_price = ctx->p.home_slow_charge_price;
+        // if (a->group == 0)
+        // {
+        //     charge_price = home_slow_charge_price;
+        // }
+        // if (a->group != 0)
+        // {
+        //     charge_price = AC_charge_price;
+        // }
+        break;
+
+    case 2: // fast charging
+        charge_rate = ctx->fast_charge_rate;
+        charge_price = ctx->p.AC_charge_price;
+        break;
+
+    case 3: // rapid charging
+        charge_rate = ctx->rapid_charge_rate;
+        charge_price = ctx->p.public_dc_charge_price;
+        break;
+
+    case 4: // free slow charging
+        charge_rate = ctx->slow_charge_rate;
+        charge_price = 0.0;
+        break;
+
+    case 5: // free fast charging
+        charge_rate = ctx->fast_charge_rate;
+        charge_price = 0.0;
+        break;
+
+    case 6: // free rapid charging
+        charge_rate = ctx->rapid_charge_rate;
+        charge_price = 0.0;
+        break;
+    }
+    result[0] = charge_rate;
+    result[1] = charge_price;
+}
+
+static double get_tou_factor(SolverContext *ctx, int time)
+{
+    // double hour = (time * time_interval) / 60; // gives the time in 24hour standard
+
+    if (time >= ctx->peak_start_interval && time < ctx->peak_end_interval)
+    {
+        return ctx->p.tou_peak_factor;
+    }
+    else if ((time >= ctx->midpeak1_start_interval && time < ctx->midpeak1_end_interval) || (time >= ctx->midpeak2_start_interval && time < ctx->midpeak2_end_interval))
+    {
+        return ctx->p.tou_midpeak_factor;
+    }
+    else
+    {
+        return ctx->p.tou_offpeak_factor;
+    }
+}
+
+/*  Fills the charging tables for the current parameters: the rate of every charge mode and, for every mode
+    and start interval, the price per kWh with its TOU factor, or the tariff loaded for the mode.
+    Charging reads these instead of calling get_charge_rate_and_price() and get_tou_factor().
+    Tariffs loaded for another horizon are dropped. Returns 0 if out of memory */
+static int build_charge_tables(SolverContext *ctx)
+{
+    int H = ctx->p.horizon;
+    if (H <= 0 || ctx->p.time_interval <= 0)
+    {
+        return 1; // set_general_parameters() not called yet
+    }
+    if (ctx->charge_price == NULL || ctx->charge_horizon != H)
+    {
+        double *price = (double *)realloc(ctx->charge_price, (size_t)N_CHARGE_MODES * (size_t)H * sizeof(double));
+        if (price == NULL)
+        {
+            return 0;
+        }
+        ctx->charge_price = price;
+        if (ctx->tariff_modes != 0)
+        {
+            fprintf(stderr, "charging tariffs dropped, the horizon changed from %d to %d\n", ctx->charge_horizon, H);
+        }
+        free(ctx->charge_tariff);
+        ctx->charge_tariff = NULL;
+        ctx->tariff_modes = 0;
+        ctx->charge_horizon = H;
+    }
+
+    for (int m = 0; m < N_CHARGE_MODES; m++)
+    {
+        Activity a;
+        memset(&a, 0, sizeof(a));
+        a.charge_mode = m;
+        double results[2];
+        get_charge_rate_and_price(ctx, &a, results);
+        ctx->charge_rate_by_mode[m] = results[0];
+        double *price = &ctx->charge_price[m * H];
+        if (ctx->tariff_modes & (1u << m))
+        {
+            memcpy(price, &ctx->charge_tariff[m * H], (size_t)H * sizeof(double));
+            continue;
+        }
+        for (int t = 0; t < H; t++)
+        {
+            price[t] = results[1] * get_tou_factor(ctx, t);
+        }
+    }
+    return 1;
+}
+
+// row of the charging tables for a's charge mode, unknown modes charge nothing like in get_charge_rate_and_price()
+static inline int charge_mode_index(const Activity *a)
+{
+    return a->charge_mode >= 0 && a->charge_mode < N_CHARGE_MODES ? a->charge_mode : 0;
+}
+
+/*  Replaces the flat price x TOU factor of a charge mode by a price per kWh for every time interval:
+    as with the TOU factors, price[t] applies to the charging of an activity started in interval t.
+    n must be the horizon. price NULL puts the mode back on its flat price.
+    The tariffs are kept until the horizon changes. Returns 0 on success, -1 otherwise */
+int ctx_set_charge_tariff(SolverContext *ctx, int charge_mode, const double *price, int n)
+{
+    if (charge_mode <= 0 || charge_mode >= N_CHARGE_MODES)
+    {
+        printf("\n set_charge_tariff: no tariff for charge mode %d", charge_mode);
+        return -1;
+    }
+    if (!build_charge_tables(ctx))
+    {
+        return -1;
+    }
+    if (price == NULL)
+    {
+        ctx->tariff_modes &= ~(1u << charge_mode);
+        return build_charge_tables(ctx) ? 0 : -1;
+    }
+    if (n != ctx->charge_horizon || n <= 0)
+    {
+        printf("\n set_charge_tariff: expected %d intervals, got n = %d", ctx->charge_horizon, n);
+        return -1;
+    }
+    if (ctx->charge_tariff == NULL)
+    {
+        ctx->charge_tariff = (double *)calloc((size_t)N_CHARGE_MODES * (size_t)n, sizeof(double));
+        if (ctx->charge_tariff == NULL)
+        {
+            return -1;
+        }
+    }
+    memcpy(&ctx->charge_tariff[charge_mode * n], price, (size_t)n * sizeof(double));
+    ctx->tariff_modes |= 1u << charge_mode;
+    return build_charge_tables(ctx) ? 0 : -1;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////// BIG FUNCTIONS ////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*  Checks the constraints of adding Activity a after activity `from` at time interval `time` that do not
+    depend on the rest of the label: time windows, time left to reach dusk, charging mode and service stations.
+    The successor lists are built from it once per activity set, see build_successor_lists().
+    Returns 0 if a can follow, otherwise the STATIC_REJECT_* reason why it never can */
+static int static_rejection(SolverContext *ctx, Activity *from, int time, Activity *a)
+{
+    // CASE 1: Continuing at SAME activity
+    if (from->id == a->id)
+    {
+        // if it is the same activity, you need the same charging state as the previous one
+        // constraint 35
+        if (a->is_charging && a->charge_mode == 0)
+        {
+            return STATIC_REJECT_OTHER;
+        }
+        // Allow continuing the activity even if the battery is full (or would overfill).
+        // Charging itself is capped in update_label_from_activity() using fmin() and
+        // is disabled when current_soc >= soc_full, so feasibility should not block
+        // staying at the activity after reaching full SOC.
+
+        if (a->is_service_station) // always have to be charging at a service station
+        {
+            if (!a->is_charging)
+            {
+                return STATIC_REJECT_OTHER;
+            }
+        }
+        return STATIC_FEASIBLE;
+    }
+
+    // Case 2: different activity from before
+    if (a->id == 0)
+    { // exclude dawn if it's not the 1st activity of the label
+        return STATIC_REJECT_OTHER;
+    }
+    if (from->id == ctx->max_num_activities - 1)
+    { // Ensuring the current activity isn't the last one
+        return STATIC_REJECT_OTHER;
+    }
+
+    int tt = travel_time(ctx, from, a);
+    // current time + travel_time for a + min duration for a + time for returning home > end of horizon
+    // Ie enough time left in the horizon to add this activity
+    if (time + tt + a->min_duration +
+            travel_time(ctx, a, &ctx->activities[ctx->max_num_activities - 1]) >=
+        ctx->p.horizon - 1)
+    {
+        return STATIC_REJECT_HORIZON;
+    }
+    // Making sure the new activity starts and ends within its allowed time window : signes changed !
+    if (time + tt < a->earliest_start)
+    {
+        return STATIC_REJECT_TIME_WINDOW;
+    }
+    // if current time + travel time to next activity is less than the latest possible start time of the next activity,
+    // not allowed
+    if (time + tt > a->latest_start)
+    {
+        return STATIC_REJECT_TIME_WINDOW;
+    }
+
+    // constraint 35
+    if (a->is_charging && a->charge_mode == 0)
+    {
+        return STATIC_REJECT_OTHER;
+    }
+    // if (a->is_charging)
+    // {
+    //     double results[2];
+    //     get_charge_rate_and_price(a, results);
+    //     double charge_rate = results[0];
+    //     // double charge_price = results[1];
+
+    //     // double delta_soc = charge_rate * time_interval / 60;
+
+    //     if (soc_after_travel + charge_rate > soc_full)
+    //     {
+    //         return 0;
+    //     } // constraint 26, but makes sure we don't pick an overzealous charge mode
+    // }
+
+    if (a->is_service_station)
+    {
+        if (!a->is_charging) // constraint 33
+        {
+            return STATIC_REJECT_OTHER;
+        }
+    }
+    return STATIC_FEASIBLE;
+}
+
+/*  Builds the successor lists: for every (activity, time interval), the activities that pass
+    static_rejection(), in increasing id order so that DP() creates labels in the same order
+    as a scan over every activity. Stored CSR style, the list of (act, h) is
+    succ_list[succ_offsets[act * horizon + h] .. succ_offsets[act * horizon + h + 1]).
+    With SOLVER_STATS, succ_rejects[(act * horizon + h) * N_STATIC_REJECT + reason - 1] counts the
+    activities left out of that list for each reason.
+    Returns 0 if out of memory */
+static int build_successor_lists(SolverContext *ctx)
+{
+    int n = ctx->max_num_activities;
+    int H = ctx->p.horizon;
+    size_t n_cells = (size_t)n * (size_t)H;
+
+    int *offsets = (int *)realloc(ctx->succ_offsets, (n_cells + 1) * sizeof(int));
+    if (offsets == NULL)
+    {
+        return 0;
+    }
+    ctx->succ_offsets = offsets;
+#if SOLVER_STATS
+    int *rejects = (int *)realloc(ctx->succ_rejects, n_cells * N_STATIC_REJECT * sizeof(int));
+    if (rejects == NULL)
+    {
+        return 0;
+    }
+    ctx->succ_rejects = rejects;
+    memset(rejects, 0, n_cells * N_STATIC_REJECT * sizeof(int));
+#endif
+
+    // first pass counts, second pass fills
+    int total = 0;
+    for (int from = 0; from < n; from++)
+    {
+        for (int h = 0; h < H; h++)
+        {
+            offsets[from * H + h] = total;
+            for (int to = 0; to < n; to++)
+            {
+                int reason = static_rejection(ctx, &ctx->activities[from], h, &ctx->activities[to]);
+                if (reason == STATIC_FEASIBLE)
+                {
+                    total++;
+                }
+#if SOLVER_STATS
+                else
+                {
+                    rejects[(from * H + h) * N_STATIC_REJECT + reason - 1]++;
+                }
+#endif
+            }
+        }
+    }
+    offsets[n_cells] = total;
+
+    if (total > ctx->succ_cap)
+    {
+        int *list = (int *)realloc(ctx->succ_list, (size_t)(total > 0 ? total : 1) * sizeof(int));
+        if (list == NULL)
+        {
+            return 0;
+        }
+        ctx->succ_list = list;
+        ctx->succ_cap = total;
+    }
+    int k = 0;
+    for (int from = 0; from < n; from++)
+    {
+        for (int h = 0; h < H; h++)
+        {
+            for (int to = 0; to < n; to++)
+            {
+                if (static_rejection(ctx, &ctx->activities[from], h, &ctx->activities[to]) == STATIC_FEASIBLE)
+                {
+                    ctx->succ_list[k++] = to;
+                }
+            }
+        }
+    }
+    ctx->succ_valid = 1;
+    return 1;
+}
+
+/*  Determines if an Activity a can be added to a sequence ending in label L.
+    It returns 1 if it's feasible and 0 if it's not.
+    Note - a is the considered activity, but does not yet have fixed duration
+    or charging participation.
     As such, most constraints apply to the considered activity, a, except for
-    duration and charging-based constraints which must be applied to L
-    */
+    duration and charging-based constraints which must be applied to L.
+    Only the checks that depend on the label are done here, a must come from the
+    successor list of L (see static_rejection) */
+
+static int is_feasible(SolverContext *ctx, Label *L, Activity *a)
+{
+    // need to check charging stuff here
+    // charge time - for new function for activity transition,
+
+    // update_SOC to cap the charging time min(act_duration, time to full)
+    // need to check the SOC can't go negative
+
+    if (L == NULL)
+    { // if no Label, 'a' cannot be added
+        return 0;
+    }
+
+    // CASE 1: Continuing at SAME activity
+    if (L->act_id == a->id)
+    { // If the current activity in L is the same as a, check the duration
+        if (L->duration + 1 > a->max_duration)
+        { // max duration
+            STAT_ADD(ctx, rejected_max_duration, 1);
+            return 0;
+        }
+        return 1;
+    }
+
+    // Case 2: different activity from before
+    // when act changes, constraints are checked AND utility gets updated
+    // only right after entering the activity: a stay row shares the back pointer of the label that entered it
+    if (L->duration == 1 && L->previous != NULL && L->previous->act_id == a->id)
+    { // is the previous activity the same as a ? pas sur de l'interet
+        STAT_ADD(ctx, rejected_other, 1);
+        return 0;
+    }
+    Activity *current = &ctx->activities[L->act_id];
+    if (L->duration < current->min_duration)
+    { // Verifying the user has remained for minimum duration of the current activity
+        STAT_ADD(ctx, rejected_min_duration, 1);
+        return 0;
+    }
+    // if we have already done this particular activity
+    if (mem_contains(L, a))
+    {
+        // printf("\n mem_contains = %d", mem_contains(L,a));
+        STAT_ADD(ctx, rejected_group_memory, 1);
+        return 0;
+    }
+
+    // SOC constraint: must be non-negative after travel
+    double soc_after_travel = L->current_soc - energy_consumed_soc(ctx, current, a);
+    if (soc_after_travel < 0)
+    {
+        STAT_ADD(ctx, rejected_soc, 1);
+        return 0;
+    }
+    return 1;
+};
+
+// function to fix all the variables
+// and check the constraints at the end of an activity
+
+/*  checks if label 1 dominates label 2 based on certain criteria, from the columns of their cell.
+    This aims to maximise the utility function
+
+    Without pruning, the number of labels explodes exponentially
+    Dominance identifies labels that are strictly worse than others and can be safely discarded
+    This is the key to computational efficiency
+
+    Both labels come from the same cell, so they already share act_id and time
+    (the time rule L1->time <= L2->time always holds).
+    0 = no dominance
+    1 = L1 dominates L2 based on the criteria */
+
+static inline int dominates(double u1, Group_set m1, double u2, Group_set m2)
+{
+    /*  S'assure que tous les group de L2 sont dans L1, sinon ca veut dire que L2 peut etre moins bien pcq elle nn'a pas encore fait un group.
+        Au contraire si L1 est meilleur alors que il n'a meme pas fait tous les groupes de L2, ca veut dire que son choice set est tjrs plus grand */
+    // Dominance should keep the label with the larger future choice set:
+    // if L1 has visited a subset of L2's groups, L1 can emulate any continuation of L2.
+    return (u1 >= u2) & ((m1 & ~m2) == 0);
+
+    // // Exact method v1
+    // if(L1->duration == L2->duration){return 2;}
+    // // if(L1->utility - duration_Ut[L1->acity][L1->duration] <= L2->utility - duration_Ut[L2->acity][L2->duration]){
+    // int group = L1->act->group;
+    // int des_dur = L1->act->des_duration;
+    // if(
+    //     L1->utility
+    //     + short_parameters[group] * time_interval * fmax(0, des_dur - L1->duration - 2)
+    //     + long_parameters[group] * time_interval * fmax(0, L1->duration - des_dur - 2)
+    //     <=
+    //     L2->utility
+    //     + short_parameters[group] * time_interval * fmax(0, des_dur - L2->duration - 2)
+    //     + long_parameters[group] * time_interval * fmax(0, L2->duration - des_dur - 2) ){
+    //     return 2;
+    // }
+};
+
+// resource keys of a label: SOC and charging cost on their epsilon grid
+static inline double soc_key(const SolverContext *ctx, double soc)
+{
+    return ctx->soc_epsilon > 0 ? floor(soc / ctx->soc_epsilon) : soc;
+}
+
+static inline double cost_key(const SolverContext *ctx, double cost)
+{
+    return ctx->cost_epsilon > 0 ? floor(cost / ctx->cost_epsilon) : cost;
+}
+
+// 1 if the resources (s1, c1) are at least as good as (s2, c2) for those dominance compares
+static inline int resources_dominate(unsigned int resources, double s1, double c1, double s2, double c2)
+{
+    return (!(resources & DOMINANCE_SOC) || s1 >= s2) & (!(resources & DOMINANCE_CHARGE_COST) || c1 <= c2);
+}
+
+/*  Beam width (ctx_set_budget): a cell holding beam_width rows makes room for a row of utility u by dropping
+    its row of lowest utility, the last one of an ordered cell. Returns 0 if the new row is no better and is
+    dropped instead */
+static int make_room_in_beam(SolverContext *ctx, L_list *cell, double u, int ordered)
+{
+    int worst = cell->n - 1;
+    for (int i = 0; !ordered && i < cell->n; i++)
+    {
+        if (cell->utility[i] < cell->utility[worst])
+        {
+            worst = i;
+        }
+    }
+    STAT_ADD(ctx, pruned_by_beam, 1);
+    ctx->solve_status |= SOLVE_BEAM;
+    if (cell->utility[worst] >= u)
+    {
+        return 0;
+    }
+    if (ordered)
+    {
+        remove_label_in_order(ctx, cell, worst);
+    }
+    else
+    {
+        remove_label(ctx, cell, worst);
+    }
+    return 1;
+}
+
+/*  insert_if_not_dominated() with dominance resources. The rows of the cell are kept by decreasing utility, so
+    the rows that can dominate L are a prefix (utility >= u) and the rows L can dominate a suffix (utility <= u),
+    both found by bisection. Within them the skyline columns narrow the scan again: key_max is nondecreasing,
+    rows before the first key_max >= k have less of the primary resource than L and cannot dominate it;
+    key_min is nondecreasing too, rows after the last key_min <= k have more and L cannot dominate them */
+static int insert_pareto(SolverContext *ctx, L_list *cell, Label *element, const Label *L)
+{
+    unsigned int resources = (unsigned int)ctx->dominance & (DOMINANCE_SOC | DOMINANCE_CHARGE_COST);
+    double u = L->utility;
+    Group_set m = L->mem;
+    double sk = soc_key(ctx, L->current_soc);
+    double ck = cost_key(ctx, L->current_charge_cost);
+    double k = resources & DOMINANCE_SOC ? sk : -ck; // primary key, larger is better
+    int n = cell->n;
+
+    // [0, q): utility > u, [q, p): utility == u, [p, n): utility < u
+    int lo = 0;
+    int hi = n;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (cell->utility[mid] > u)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    int q = lo;
+    hi = n;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (cell->utility[mid] >= u)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    int p = lo;
+
+    // rows that may dominate L: [first, p), on a tie L wins over the rows it dominates
+    lo = 0;
+    hi = p;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (cell->key_max[mid] < k)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    for (int i = lo; i < p; i++)
+    {
+        if ((cell->mem[i] & ~m) == 0 && resources_dominate(resources, cell->soc_key[i], cell->cost_key[i], sk, ck) &&
+            !(i >= q && (m & ~cell->mem[i]) == 0 && resources_dominate(resources, sk, ck, cell->soc_key[i], cell->cost_key[i])))
+        {
+            STAT_ADD(ctx, labels_dominated_incoming, 1);
+            return 0;
+        }
+    }
+
+    // rows L may dominate: [q, last]
+    lo = q;
+    hi = n;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (cell->key_min[mid] <= k)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    for (int i = lo - 1; i >= q; i--) // backwards, the rows after i keep their place
+    {
+        if ((m & ~cell->mem[i]) == 0 && resources_dominate(resources, sk, ck, cell->soc_key[i], cell->cost_key[i]))
+        {
+            remove_label_in_order(ctx, cell, i);
+            STAT_ADD(ctx, labels_dominated_evicted, 1);
+        }
+    }
+    // the last row has the lowest utility, so q stays inside the cell (u is above it)
+    if (ctx->beam_width > 0 && cell->n >= ctx->beam_width && !make_room_in_beam(ctx, cell, u, 1))
+    {
+        return 0;
+    }
+
+    if (!append_label(cell, element, L))
+    {
+        fprintf(stderr, "DP: out of memory for the bucket\n");
+        return 0;
+    }
+    mark_active(ctx, L->time, L->act_id);
+    cell->soc_key[cell->n - 1] = sk;
+    cell->cost_key[cell->n - 1] = ck;
+    move_last_label_to(cell, q);
+    n = cell->n;
+
+    // skyline: key_max changes from q on, key_min from the end back to where it stops changing
+    for (int i = q; i < n; i++)
+    {
+        double ki = resources & DOMINANCE_SOC ? cell->soc_key[i] : -cell->cost_key[i];
+        cell->key_max[i] = i > 0 && cell->key_max[i - 1] > ki ? cell->key_max[i - 1] : ki;
+    }
+    for (int i = n - 1; i >= 0; i--)
+    {
+        double ki = resources & DOMINANCE_SOC ? cell->soc_key[i] : -cell->cost_key[i];
+        double key_min = i < n - 1 && cell->key_min[i + 1] < ki ? cell->key_min[i + 1] : ki;
+        if (i < q && cell->key_min[i] == key_min)
+        {
+            break; // the rows before q and their minimum are unchanged
+        }
+        cell->key_min[i] = key_min;
+    }
+#if SOLVER_STATS
+    if (cell->n > ctx->stats.max_cell_occupancy)
+    {
+        ctx->stats.max_cell_occupancy = cell->n;
+    }
+#endif
+    return 1;
+}
+
+/*  Inserts a row for label element with state L into the cell unless a row of the cell dominates it,
+    removing the rows L dominates. On a tie the new label wins and replaces the old one.
+    The labels of a cell never dominate each other, so once a label dominated by L has been met no label
+    can dominate L anymore: a single scan over the packed columns, stopping at the first label that dominates L.
+    Returns 1 if the row was added, 0 if it was dominated */
+static int insert_if_not_dominated(SolverContext *ctx, L_list *cell, Label *element, const Label *L)
+{
+    if (ctx->dominance & (DOMINANCE_SOC | DOMINANCE_CHARGE_COST))
+    {
+        return insert_pareto(ctx, cell, element, L);
+    }
+    double u = L->utility;
+    Group_set m = L->mem;
+    int i = 0;
+    while (i < cell->n)
+    {
+        if (dominates(u, m, cell->utility[i], cell->mem[i]))
+        {
+            remove_label(ctx, cell, i); // the last row moves to i, check it next
+            STAT_ADD(ctx, labels_dominated_evicted, 1);
+        }
+        else if (dominates(cell->utility[i], cell->mem[i], u, m))
+        {
+            STAT_ADD(ctx, labels_dominated_incoming, 1);
+            return 0;
+        }
+        else
+        {
+            i++;
+        }
+    }
+    if (ctx->beam_width > 0 && cell->n >= ctx->beam_width && !make_room_in_beam(ctx, cell, u, 0))
+    {
+        return 0;
+    }
+    if (!append_label(cell, element, L))
+    {
+        fprintf(stderr, "DP: out of memory for the bucket\n");
+        return 0;
+    }
+    mark_active(ctx, L->time, L->act_id);
+#if SOLVER_STATS
+    if (cell->n > ctx->stats.max_cell_occupancy)
+    {
+        ctx->stats.max_cell_occupancy = cell->n;
+    }
+#endif
+    return 1;
+}
+
+// first entry of the frontier with utility below u (utility < u if strict, utility <= u otherwise)
+static int frontier_split(const ArrivalFrontier *f, double u, int strict)
+{
+    int lo = 0;
+    int hi = f->n;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (strict ? f->utility[mid] >= u : f->utility[mid] > u)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// 1 if an entry of the frontier dominates a label with utility u, memory m and resource keys sk, ck
+static int frontier_dominates(const ArrivalFrontier *f, unsigned int resources, double u, Group_set m, double sk, double ck)
+{
+    int p = frontier_split(f, u, 1); // the entries with utility >= u
+    for (int i = 0; i < p; i++)
+    {
+        if ((f->mem[i] & ~m) == 0 && resources_dominate(resources, f->soc_key[i], f->cost_key[i], sk, ck))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*  Adds a label no entry of the frontier dominates, dropping the entries it dominates.
+    Returns 0 if out of memory */
+static int frontier_add(ArrivalFrontier *f, unsigned int resources, double u, Group_set m, double sk, double ck)
+{
+    int q = frontier_split(f, u, 0); // the entries with utility <= u start at q
+    int w = q;
+    for (int i = q; i < f->n; i++)
+    {
+        if (!((m & ~f->mem[i]) == 0 && resources_dominate(resources, sk, ck, f->soc_key[i], f->cost_key[i])))
+        {
+            f->utility[w] = f->utility[i];
+            f->mem[w] = f->mem[i];
+            f->soc_key[w] = f->soc_key[i];
+            f->cost_key[w] = f->cost_key[i];
+            w++;
+        }
+    }
+    f->n = w;
+    if (f->n == f->cap)
+    {
+        int cap = f->cap > 0 ? 2 * f->cap : 8;
+        char *block = (char *)malloc((size_t)cap * (3 * sizeof(double) + sizeof(Group_set)));
+        if (block == NULL)
+        {
+            return 0;
+        }
+        double *utility = (double *)block;
+        double *soc = utility + cap;
+        double *cost = soc + cap;
+        Group_set *mem = (Group_set *)(cost + cap);
+        if (f->n > 0)
+        {
+            memcpy(utility, f->utility, (size_t)f->n * sizeof(double));
+            memcpy(soc, f->soc_key, (size_t)f->n * sizeof(double));
+            memcpy(cost, f->cost_key, (size_t)f->n * sizeof(double));
+            memcpy(mem, f->mem, (size_t)f->n * sizeof(Group_set));
+        }
+        free(f->utility);
+        f->utility = utility;
+        f->soc_key = soc;
+        f->cost_key = cost;
+        f->mem = mem;
+        f->cap = cap;
+    }
+    int tail = f->n - q;
+    memmove(&f->utility[q + 1], &f->utility[q], (size_t)tail * sizeof(double));
+    memmove(&f->mem[q + 1], &f->mem[q], (size_t)tail * sizeof(Group_set));
+    memmove(&f->soc_key[q + 1], &f->soc_key[q], (size_t)tail * sizeof(double));
+    memmove(&f->cost_key[q + 1], &f->cost_key[q], (size_t)tail * sizeof(double));
+    f->utility[q] = u;
+    f->mem[q] = m;
+    f->soc_key[q] = sk;
+    f->cost_key[q] = ck;
+    f->n++;
+    return 1;
+}
+
+// 1 if a label that entered activity act before the interval being expanded dominates L
+static inline int dominated_by_earlier_arrival(const SolverContext *ctx, int act, const Label *L)
+{
+    return frontier_dominates(&ctx->frontier[act], (unsigned int)ctx->dominance & (DOMINANCE_SOC | DOMINANCE_CHARGE_COST),
+                              L->utility, L->mem, soc_key(ctx, L->current_soc), cost_key(ctx, L->current_charge_cost));
+}
+
+/*  Empties the frontier of each activity for a new DP pass, allocating them if needed.
+    Returns 0 if out of memory */
+static int reset_frontiers(SolverContext *ctx)
+{
+    int n = ctx->max_num_activities;
+    if (n > ctx->frontier_n)
+    {
+        ArrivalFrontier *frontier = (ArrivalFrontier *)realloc(ctx->frontier, (size_t)n * sizeof(ArrivalFrontier));
+        if (frontier == NULL)
+        {
+            return 0;
+        }
+        memset(&frontier[ctx->frontier_n], 0, (size_t)(n - ctx->frontier_n) * sizeof(ArrivalFrontier));
+        ctx->frontier = frontier;
+        ctx->frontier_n = n;
+    }
+    for (int a = 0; a < ctx->frontier_n; a++)
+    {
+        ctx->frontier[a].n = 0;
+    }
+    return 1;
+}
+
+/*  Across-time dominance, before the cells of interval h are expanded: their labels that just entered their
+    activity are checked against the frontier of the activity, which holds the labels that entered it before h,
+    the dominated ones are removed and the others join the frontier. A label moving to a later cell is then
+    checked against the frontier as it is created (expand_row).
+    The frontiers only ever hold labels of cells that no longer change, so what is pruned does not depend on the
+    order the successors are walked in, and a kept cell of an incremental pass gets the same frontier again.
+    Stay rows are left out: they carry the utility and memory of their entry row. Returns 0 if out of memory */
+static int update_frontiers(SolverContext *ctx, int h)
+{
+    unsigned int resources = (unsigned int)ctx->dominance & (DOMINANCE_SOC | DOMINANCE_CHARGE_COST);
+    const uint64_t *active = &ctx->active[bucket_row(ctx, h) * ctx->active_words];
+    for (int w = 0; w < ctx->active_words; w++)
+    {
+        for (uint64_t bits = active[w]; bits != 0; bits &= bits - 1)
+        {
+            int act = w * 64 + lowest_bit(bits);
+            L_list *cell = bucket_cell(ctx, h, act);
+            ArrivalFrontier *f = &ctx->frontier[act];
+            int i = 0;
+            while (i < cell->n)
+            {
+                if (cell->stay[i].duration != cell->element[i]->duration) // stay row
+                {
+                    i++;
+                    continue;
+                }
+                double sk = soc_key(ctx, cell->stay[i].current_soc);
+                double ck = cost_key(ctx, cell->stay[i].current_charge_cost);
+                if (frontier_dominates(f, resources, cell->utility[i], cell->mem[i], sk, ck))
+                {
+                    remove_label(ctx, cell, i); // nothing else changes the cell from now on, its order can go
+                    STAT_ADD(ctx, labels_dominated_earlier, 1);
+                    continue;
+                }
+                if (!frontier_add(f, resources, cell->utility[i], cell->mem[i], sk, ck))
+                {
+                    return 0;
+                }
+                i++;
+            }
+        }
+    }
+    return 1;
+}
+
+/* Rebuilds in out the label that row i of cell [time][...] stands for (see StayState) */
+static void label_from_row(const L_list *cell, int i, int time, Label *out)
+{
+    const StayState *st = &cell->stay[i];
+    *out = *cell->element[i];
+    out->time = time;
+    out->duration = st->duration;
+    out->current_soc = st->current_soc;
+    out->current_charge_cost = st->current_charge_cost;
+    out->charge_duration = st->charge_duration;
+}
+
+/* Calculate the utility of a label based on its starting activity and the duration of the one that just finished */
+static double update_utility(SolverContext *ctx, Label *L)
+// make sure to check that you start a new activity in label_update before this is calculated
+// function on the basis of minutes
+// time horizons differences are multiplied to be expressed in minutes from the parameters
+
+// check if charging constrants can be used to deal with service stations instead
+// time window constraints between 7am and 11pm, not allowed outside that
+{
+    // should have an error term, but don't need a cost penalty
+    // cost of travel is associated with EV cost only, don't account for EV tax, parking etc
+    // to be listed as assumptions at beginning of paper
+
+    Activity *act = &ctx->activities[L->act_id];
+    int activity_type = act->group;
+
+    Label *previous_L = L->previous;
+    Activity *previous_act = &ctx->activities[previous_L->act_id];
+    int previous_activity_type = previous_act->group;
+
+    L->utility = previous_L->utility;
+
+    L->utility += ctx->p.asc_parameters[activity_type];
+    L->utility += ctx->p.travel_time_penalty * travel_time(ctx, previous_act, act);
+
+    // Error terms (drawn once per DP run). If std dev is 0, these arrays are NULL and add 0.
+    if (ctx->eps_participation != NULL)
+    {
+        L->utility += ctx->eps_participation[act->id];
+        L->utility += ctx->eps_travel[previous_act->id * ctx->eps_n + act->id];
+    }
+
+    // service station has no duration penalties - its only penalties come from cost of charge
+    // so only apply these below to non-home and non service station activities
+
+    // PENALTY FOR FINISHING PREVIOUS ACTIVITY (duration deviation)
+    if (previous_activity_type != 0 && !previous_act->is_service_station)
+    {
+        L->utility += ctx->p.short_parameters[previous_activity_type] * ctx->p.time_interval *
+                      fmax(0, previous_act->des_duration - previous_L->duration);
+        L->utility += ctx->p.long_parameters[previous_activity_type] * ctx->p.time_interval *
+                      fmax(0, previous_L->duration - previous_act->des_duration);
+        if (ctx->eps_duration != NULL)
+        {
+            L->utility += ctx->eps_duration[previous_act->id];
+        }
+    }
+
+    // Early/late start penalty (timing deviation)
+    if (activity_type != 0 && !act->is_service_station)
+    {
+        L->utility += ctx->p.early_parameters[activity_type] * ctx->p.time_interval *
+                      fmax(0, act->des_start_time - L->start_time);
+        L->utility += ctx->p.late_parameters[activity_type] * ctx->p.time_interval *
+                      fmax(0, L->start_time - act->des_start_time);
+        if (ctx->eps_start_time != NULL)
+        {
+            L->utility += ctx->eps_start_time[act->id];
+        }
+    }
+
+    // SOC anxiety/disutility at activity start (paper Eq. 8 uses SOC_a).
+    // Apply at the start of each non-dummy activity so SOC influences subsequent choices.
+    // (Dawn/dusk are dummy home activities; keep their utility at 0.)
+    if (act->id != 0 && act->id != ctx->max_num_activities - 1)
+    {
+        L->utility += ctx->p.theta_soc * fmax(0, ctx->p.soc_threshold - L->soc_at_activity_start);
+    }
+
+    // calculate the utility change from charging at finished activity
+    if (previous_act->is_charging)
+    {
+        if (previous_activity_type == 1)
+        {
+            L->utility += ctx->p.gamma_charge_work;
+        }
+        else if (previous_activity_type == 0)
+        {
+            L->utility += ctx->p.gamma_charge_home;
+        }
+        else
+        {
+            L->utility += ctx->p.gamma_charge_non_work;
+        }
+
+        double total_delta_soc = previous_L->current_soc - previous_L->soc_at_activity_start;
+        L->utility += ctx->p.beta_delta_soc * total_delta_soc;
+        if (previous_L->previous != NULL) // if the previous act is not empty (ie it is after dawn), need to calc the charge cost
+        // if (previous_L->charge_cost_at_activity_start > 0)
+        {
+            double activity_charge_cost = previous_L->current_charge_cost - previous_L->charge_cost_at_activity_start;
+            L->utility += ctx->p.beta_charge_cost * activity_charge_cost;
+        }
+        else
+        {
+            L->utility += ctx->p.beta_charge_cost * previous_L->current_charge_cost;
+        }
+
+        // Charging-specific error term (drawn once per DP run).
+        if (ctx->eps_charging != NULL)
+        {
+            int mode = previous_act->charge_mode;
+            if (mode < 0)
+                mode = 0;
+            if (mode > 7)
+                mode = 7;
+            L->utility += ctx->eps_charging[previous_act->id * 8 + mode];
+        }
+    }
+
+    return L->utility;
+};
+
+// only go to update utility if it is a new act
+// SOC is updated in update_label
+// if charging, calculate the remaining uncharged amount, working in 5 min interval
+// calc remaining spare capacity, if it is >0 then charge until full
+// max amount of charge possible in that interval
 
-static int is_feasible(Label *L, Activity *a)
+/*  Advances L by one time interval at its current activity, in place.
+    Only time, duration, SOC and charging change during a stay, utility and memory do not */
+static void extend_stay(SolverContext *ctx, Label *L)
 {
-    // need to check charging stuff here
-    // charge time - for new function for activity transition,
+    Activity *a = &ctx->activities[L->act_id];
+    L->time += 1; // advance by 1 time interval
+    L->duration += 1;
 
-    // update_SOC to cap the charging time min(act_duration, time to full)
-    // need to check the SOC can't go negative
+    // STEP 2: Update charging for continuing activity
+    // Only update SOC and costs here - NO utility changes
+    if (a->is_charging && (L->current_soc < ctx->p.soc_full || a->is_service_station))
+    {
+        L->charge_duration += 1;
+
+        int mode = charge_mode_index(a);
+        double charge_rate = ctx->charge_rate_by_mode[mode];
+
+        // Calculate how much we can charge in this interval
+        // Limited by remaining battery capacity
+        // double max_possible_charge = charge_rate * (time_interval / 60.0);
+        double delta_soc = fmin(ctx->p.soc_full - L->current_soc, charge_rate); // change in charging this interval
+        L->current_soc += delta_soc;
+
+        // Calculate charging cost for this interval
+        // price x TOU factor, the factor needs to be at the start of the interval
+        double charge_price = ctx->charge_price[mode * ctx->charge_horizon + L->start_time];
+        double energy_charged_kwh = delta_soc * ctx->p.battery_capacity;
+        double interval_cost = charge_price * energy_charged_kwh;
+        L->current_charge_cost += interval_cost;
+
+        // All utility changes happen only for new activities
+    }
+}
+
+// /*  Generates a new label L based on an existing label current_label and an activity a */
+static Label *update_label_from_activity(SolverContext *ctx, Label *current_label, Activity *a)
+// This function updates labels by one time interval (5 mins)
+//   1. Check if new activity first
+//   2. If new: transition to new activity (update utility, advance timestamp, reduce SOC)
+//   3. If not new: do simple time update
+//   4. Update charging regardless of new or not
+{
+    Label *new_label = ctx_alloc_label(ctx);
+    new_label->previous = current_label;
+    new_label->act_id = a->id;
+    new_label->current_charge_cost = current_label->current_charge_cost; // inherit cumulative charging cost
+
+    // STEP 1: Check if new activity
+    Activity *current_act = &ctx->activities[current_label->act_id];
+    if (a->id != current_label->act_id)
+    {
+        // Transition to new activity:
+        // - Calculate start time (current time + travel time)
+        // - Update memory
+        // - Reduce SOC for travel
+        // - Initialize time and duration
+
+        new_label->start_time = current_label->time + travel_time(ctx, current_act, a);
+        // groups of the label that are also in the DSSR memory of a, plus the group of a
+        new_label->mem = (current_label->mem & a->memory) | GROUP_BIT(a->group);
+
+        //  below to be by interval, maybe adapt across min_duration in future
+        if (a->id == ctx->max_num_activities - 1)
+        {                                                              // d'ou le saut chelou a la fin : DUSK (pas de utility pour dusk)
+            new_label->duration = ctx->p.horizon - new_label->start_time - 1; // set to 0 before
+            new_label->time = ctx->p.horizon - 1;                             // pq pas le temps actuel (pour uen 3e var de starting time)
+        }
+        else
+        {
+            new_label->duration = 1;
+            new_label->time = new_label->start_time + new_label->duration;
+        }
+
+        // Reduce SOC by travel consumption
+        double soc_consumed = energy_consumed_soc(ctx, current_act, a);
+        new_label->soc_at_activity_start = current_label->current_soc - soc_consumed;
+        new_label->current_soc = new_label->soc_at_activity_start; // initialise the soc in case of charging
+
+        // Initialize charging variables for new activity
+        new_label->charge_duration = 0;
+        new_label->charge_cost_at_activity_start = current_label->current_charge_cost;
+        // STEP 1b: Calculate charging for first interval of new activity (if charging)
+        //  This must happen before calling update_utility so that utility calculation has access to charging data
+        //  need to adapt this to deal with the situation where
+        //  charging will be completed BEFORE activity is over
+        //  - so there will be time spent idle at the charger
+        if (a->is_charging)
+        {
+            int mode = charge_mode_index(a);
+            double charge_rate = ctx->charge_rate_by_mode[mode];
+            // double max_possible_charge = charge_rate * (time_interval / 60.0);
+            double delta_soc = fmin(ctx->p.soc_full - new_label->current_soc, charge_rate);
+            new_label->current_soc += delta_soc;
+            new_label->charge_duration = 1;
+
+            // Calculate charging cost for this first interval, price x TOU factor
+            double charge_price = ctx->charge_price[mode * ctx->charge_horizon + new_label->start_time];
+            double energy_charged_kwh = delta_soc * ctx->p.battery_capacity;
+            double interval_cost = charge_price * energy_charged_kwh;
+            new_label->current_charge_cost += interval_cost;
+        }
+
+        // Update utility ONLY when moving to new activity
+        new_label->utility = update_utility(ctx, new_label);
+    }
+    else // SAME ACTIVITY - simple time update
+    {
+        // Continue at same activity - just advance by one time interval
+        // DP() keeps stays in the bucket rows instead (see stay compression), this is for one-off extensions
+        *new_label = *current_label;
+        new_label->previous = current_label;
+        extend_stay(ctx, new_label);
+    }
+
+    return new_label;
+}
+
+/*  Finds the label with the max utility value from the list.
+    Returns the label with the max utility value. */
+Label *find_best(L_list *B, int o)
+{
+    double max = -INFINITY;
+    Label *bestL = NULL;
+    for (int i = 0; i < B->n; i++)
+    {
+        if (B->utility[i] > max)
+        {
+            bestL = B->element[i];
+            max = B->utility[i];
+        }
+    }
+    if (bestL == NULL)
+    {
+        printf("%s", "\n Solution is not feasible, check activities parameters.");
+    }
+    else
+    {
+        if (o)
+        {
+            printf("\n Best solution value = %.2f \n", bestL->utility);
+            // printf("%s ", "[");
+            recursive_print(bestL);
+            // printf("%s \n", "]");
+        }
+    }
+    return bestL;
+};
+
+// 1 if a row of the cell comes from a move into its activity, those are the rows the DSSR memory acts on
+// (the dawn label is created, not moved into, see create_label)
+static int has_moved_in_row(const L_list *cell)
+{
+    for (int i = 0; i < cell->n; i++)
+    {
+        if (cell->element[i]->previous != NULL)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*  Looks for a group visited twice (home aside) in the schedule ending with L. Returns 1 if there is one,
+    with *at the label before the later visit of the group, *c_activity its activity and *group_activity
+    the group; 0 if the schedule has no cycle */
+static int find_group_cycle(const SolverContext *ctx, Label *L, Label **at, int *c_activity, int *group_activity)
+{
+    Label *p1 = L;
+    int cycle = 0;
+
+    while (p1 != NULL && cycle == 0)
+    { // iterates through the labels starting from L in the reverse direction until it reaches the beginning
+        while (p1 != NULL && (p1->act_id == ctx->max_num_activities - 1 || p1->act_id == ctx->max_num_activities - 2))
+        { // skips labels that correspond to the last activity // group == 0 ?
+            p1 = p1->previous;
+        }
+        Label *p2 = p1;
+        while (p2 != NULL && p2->act_id == p1->act_id)
+        { //  skips labels that have the same activity as p.
+            p2 = p2->previous;
+        }
+        while (p2 != NULL && cycle == 0)
+        { //  checks for a cycle by looking for a previous label with the same group as p. If found, records the activity and group,
+            // Ignore home (group==0): home is allowed to repeat and should not be treated as a cycle.
+            int group = ctx->activities[p1->act_id].group;
+            if (group != 0 && ctx->activities[p2->act_id].group == group)
+            {
+                cycle = 1;
+                *c_activity = p1->act_id;
+                *group_activity = group;
+            }
+            p2 = p2->previous;
+        }
+        p1 = p1->previous;
+    }
+    *at = p1;
+    return cycle;
+}
+
+/*  To detect cycles based on the group of activities within a sequence of labels and,
+    if a cycle is detected, update the memory of some labels in the sequence
+    "this combination has been done before" */
+int ctx_dssr(SolverContext *ctx, Label *L)
+{
+    // printf("\n DSSR");
+    Label *p1 = NULL;
+    int c_activity = 0;
+    int group_activity = 0;
+    ctx->dirty_from = ctx->p.horizon;
+
+    int cycle = find_group_cycle(ctx, L, &p1, &c_activity, &group_activity);
+    if (cycle)
+    { // ou est ce que c'est utilise de toute facon ? et pq ca marche pas pour chaque label au fur et a mesure ?
+        Label *p3 = p1;
+        while (p3 != NULL && p3->act_id == c_activity)
+        {
+            p3 = p3->previous;
+        }
+        // printf("acity >> %d \n", c_activity);
+        while (p3 != NULL && p3->act_id != c_activity)
+        {
+            // printf("intermedaire >> %d \n", p3->acity);
+            if (!(ctx->activities[p3->act_id].memory & GROUP_BIT(group_activity)))
+            {
+                // only the labels from the first one that moved into this activity in the last pass can change:
+                // every cell before is built the same way again
+                int t = ctx->activities[p3->act_id].earliest_start + 1;
+                while (ctx->bucket != NULL && ctx->bucket_window == 0 && t < ctx->dirty_from &&
+                       !has_moved_in_row(&ctx->bucket[t][p3->act_id]))
+                {
+                    t++;
+                }
+                if (t < ctx->dirty_from)
+                {
+                    ctx->dirty_from = t;
+                }
+            }
+            add_memory(ctx, p3->act_id, group_activity); // add une activite dans une liste qu'on ira checker si on va rajouetr le meme grouep ?
+            p3 = p3->previous;
+        }
+    }
+    return cycle;
+};
+
+/*  Most utility update_utility() can add when a label leaves activity a: the duration terms of a at their best
+    duration, the charging terms at their best SOC gain and cost. Error terms are exact */
+static double departure_bound(const SolverContext *ctx, const Activity *a)
+{
+    const SolverParams *p = &ctx->p;
+    double ub = 0.0;
+    int g = a->group;
+    if (g != 0 && !a->is_service_station)
+    {
+        // a duration can be as short as 0 or as long as the horizon
+        ub += fmax(0, p->short_parameters[g]) * p->time_interval * fmax(0, a->des_duration);
+        ub += fmax(0, p->long_parameters[g]) * p->time_interval * fmax(0, p->horizon - a->des_duration);
+        if (ctx->eps_duration != NULL)
+        {
+            ub += ctx->eps_duration[a->id];
+        }
+    }
+    if (a->is_charging)
+    {
+        ub += g == 1 ? p->gamma_charge_work : g == 0 ? p->gamma_charge_home : p->gamma_charge_non_work;
+        ub += fmax(0, p->beta_delta_soc) * p->soc_full; // SOC gain in [0, soc_full]
+
+        // cost of at most soc_full of battery at the cheapest and dearest price of the mode
+        const double *price = &ctx->charge_price[charge_mode_index(a) * ctx->charge_horizon];
+        double lo = 0.0;
+        double hi = 0.0;
+        for (int t = 0; t < ctx->charge_horizon; t++)
+        {
+            lo = fmin(lo, price[t]);
+            hi = fmax(hi, price[t]);
+        }
+        double energy = p->soc_full * p->battery_capacity;
+        ub += fmax(p->beta_charge_cost * lo * energy, p->beta_charge_cost * hi * energy);
+        if (ctx->eps_charging != NULL)
+        {
+            int mode = a->charge_mode < 0 ? 0 : a->charge_mode > 7 ? 7 : a->charge_mode;
+            ub += ctx->eps_charging[a->id * 8 + mode];
+        }
+    }
+    return ub;
+}
 
-    if (L == NULL)
-    { // if no Label, 'a' cannot be added
-        return 0;
+/*  Most utility update_utility() can add when a label moves from activity a to b, arriving at start:
+    everything but the SOC term is known from the move, the SOC term is taken at its best */
+static double arrival_bound(const SolverContext *ctx, const Activity *a, const Activity *b, int start)
+{
+    const SolverParams *p = &ctx->p;
+    int g = b->group;
+    double ub = p->asc_parameters[g] + p->travel_time_penalty * travel_time(ctx, a, b);
+    if (ctx->eps_participation != NULL)
+    {
+        ub += ctx->eps_participation[b->id];
+        ub += ctx->eps_travel[a->id * ctx->eps_n + b->id];
     }
-    if (L->act_id != 0 && a->id == 0)
-    { // exclude dawn if it's not the 1st activity of the label
-        return 0;
+    if (g != 0 && !b->is_service_station)
+    {
+        ub += p->early_parameters[g] * p->time_interval * fmax(0, b->des_start_time - start);
+        ub += p->late_parameters[g] * p->time_interval * fmax(0, start - b->des_start_time);
+        if (ctx->eps_start_time != NULL)
+        {
+            ub += ctx->eps_start_time[b->id];
+        }
+    }
+    if (b->id != 0 && b->id != ctx->max_num_activities - 1)
+    {
+        ub += fmax(0, p->theta_soc) * fmax(0, p->soc_threshold); // SOC on arrival is >= 0
     }
+    return ub;
+}
 
-    // CASE 1: Continuing at SAME activity
-    if (L->act_id == a->id)
-    { // If the current activity in L is the same as a, check the duration
-        if (L->duration + 1 > a->max_duration)
-        { // max duration
+/*  Fills completion_bound[act * horizon + h] with the most utility a label at act can gain before dusk when it
+    leaves act at time h or later, over the moves of the successor lists, from the last interval back.
+    Min durations are kept (a label entering b at t cannot leave before t + min_duration - 1), SOC, max durations
+    and DSSR memory are relaxed, so no schedule can gain more: -INFINITY if none reaches dusk.
+    Depends on the error terms, rebuilt each time they are drawn. Returns 0 if out of memory */
+static int build_completion_bounds(SolverContext *ctx)
+{
+    int n = ctx->max_num_activities;
+    int H = ctx->p.horizon;
+    int dusk = n - 1;
+    size_t n_cells = (size_t)n * (size_t)H;
+    if (n_cells + (size_t)n > ctx->bound_cap)
+    {
+        double *bound = (double *)realloc(ctx->completion_bound, (n_cells + (size_t)n) * sizeof(double));
+        if (bound == NULL)
+        {
             return 0;
         }
-        // if it is the same activity, you need the same charging state as the previous one
-        if (a->is_charging)
+        ctx->completion_bound = bound;
+        ctx->bound_cap = n_cells + (size_t)n;
+    }
+    double *R = ctx->completion_bound;
+    double *leave = R + n_cells; // departure_bound() of each activity
+    for (int act = 0; act < n; act++)
+    {
+        leave[act] = departure_bound(ctx, &ctx->activities[act]);
+        R[act * H + H - 1] = act == dusk ? 0.0 : -INFINITY; // labels of the last interval are not expanded
+    }
+    for (int h = H - 2; h >= 0; h--)
+    {
+        for (int act = 0; act < n; act++)
         {
-            // constraint 35
-            if (a->charge_mode == 0)
+            if (act == dusk)
             {
-                return 0;
+                R[act * H + h] = 0.0;
+                continue;
             }
+            Activity *a = &ctx->activities[act];
+            double best = R[act * H + h + 1]; // leave later
+            const int *succ = &ctx->succ_list[ctx->succ_offsets[act * H + h]];
+            int n_succ = ctx->succ_offsets[act * H + h + 1] - ctx->succ_offsets[act * H + h];
+            for (int k = 0; k < n_succ; k++)
+            {
+                int b = succ[k];
+                if (b == act)
+                {
+                    continue;
+                }
+                int tt = travel_time(ctx, a, &ctx->activities[b]);
+                double after; // bound of the label entering b
+                if (b == dusk)
+                {
+                    after = 0.0;
+                }
+                else
+                {
+                    int min_duration = ctx->activities[b].min_duration;
+                    int t = h + tt + 1 + (min_duration > 1 ? min_duration - 1 : 0); // > h
+                    after = t < H ? R[b * H + t] : -INFINITY;
+                }
+                if (after == -INFINITY)
+                {
+                    continue;
+                }
+                best = fmax(best, leave[act] + arrival_bound(ctx, a, &ctx->activities[b], h + tt) + after);
+            }
+            R[act * H + h] = best;
+        }
+    }
+    return 1;
+}
 
-            // if (L->previous != NULL && L->act->charge_mode != a->charge_mode)
-            // {
-            //     return 0;
-            // } // check continuity of charge mode, only from second activity
+// 1 if a label of activity act at time with this duration and utility cannot end above the incumbent
+static inline int below_incumbent(const SolverContext *ctx, int act, int time, int duration, double utility)
+{
+    int min_duration = ctx->activities[act].min_duration;
+    int t = time + (duration < min_duration ? min_duration - duration : 0); // earliest departure
+    if (act == ctx->max_num_activities - 1)
+    {
+        t = time;
+    }
+    if (t >= ctx->p.horizon)
+    {
+        return 1;
+    }
+    // the slack keeps labels whose bound is tight, where rounding could put them just below
+    double completion = utility + ctx->completion_bound[act * ctx->p.horizon + t];
+    return completion < ctx->incumbent - 1e-9 * (1.0 + fabs(ctx->incumbent));
+}
 
-            // check constraint 26:
-            double results[2];
-            get_charge_rate_and_price(a, results);
-            double charge_rate = results[0]; // this is the change in SOC for the time interval
-            // double charge_price = results[1];
+// hands a label back to the pool it was taken from, the context's or an expansion thread's
+static void release_label_to(SolverContext *ctx, Pool *pool, Label *L)
+{
+    ctx->live_labels--;
+    pool_release(pool, L);
+}
 
-            // double delta_soc = charge_rate * time_interval / 60;
-            // Allow continuing the activity even if the battery is full (or would overfill).
-            // Charging itself is capped in update_label_from_activity() using fmin() and
-            // is disabled when current_soc >= soc_full, so feasibility should not block
-            // staying at the activity after reaching full SOC.
+/*  Successors of row li of cell [h][...]: one more interval at the activity, or a move to each feasible
+    successor, written to out in successor order. Only cells at min_time or later receive labels, see dp_from().
+    Nothing is inserted, so the rows of one interval can be generated in any order (see expand_step).
+    Returns the number of candidates, at most the number of activities */
+static int generate_row(SolverContext *ctx, const L_list *cell, int li, int h, int min_time, Candidate *out)
+{
+    int n = 0;
+    int dusk = ctx->max_num_activities - 1;
+
+    // L is the state of the row: the label that entered the activity, advanced to h if it stayed
+    Label L;
+    label_from_row(cell, li, h, &L);
+
+    // only the activities that can statically follow L at this time
+    const int *succ = &ctx->succ_list[ctx->succ_offsets[L.act_id * ctx->p.horizon + h]];
+    int n_succ = ctx->succ_offsets[L.act_id * ctx->p.horizon + h + 1] -
+                 ctx->succ_offsets[L.act_id * ctx->p.horizon + h];
+#if SOLVER_STATS
+    if (min_time == 0) // a row expanded again by dp_from() was counted by its first expansion
+    {
+        const int *rejects = &ctx->succ_rejects[(L.act_id * ctx->p.horizon + h) * N_STATIC_REJECT];
+        ctx->stats.rejected_time_window += rejects[STATIC_REJECT_TIME_WINDOW - 1];
+        ctx->stats.rejected_horizon += rejects[STATIC_REJECT_HORIZON - 1];
+        ctx->stats.rejected_other += rejects[STATIC_REJECT_OTHER - 1];
+    }
+#endif
 
-            // if (L->charge_duration <= 0)
-            // {
-            //     return 0;
-            // } //constraint 31, do NOT need this here because we only check on activity a
-        }
+    for (int k = 0; k < n_succ; k++)
+    { // for all the successor activities
+        int a1 = succ[k];
 
-        if (a->is_service_station) // always have to be charging at a service station
+        if (a1 == L.act_id)
         {
-            if (!a->is_charging)
+            // stay one more interval: only a row in the next cell, no new Label
+            if (h + 1 < min_time || !is_feasible(ctx, &L, &ctx->activities[a1]))
             {
-                return 0;
+                continue;
             }
+            out[n].next = L;
+            out[n].moved = NULL;
+            extend_stay(ctx, &out[n].next);
+            n++;
+            continue;
         }
-        return 1;
-    }
-
-    // Case 2: different activity from before
 
-    if (L->act_id != a->id)
-    // when act changes, constraints are checked AND utility gets updated
-    { // If act of L isn't the same as a, do some checks
-        if (L->previous != NULL && L->previous->act_id == a->id)
-        { // is the previous activity the same as a ? pas sur de l'interet
-            return 0;
-        }
-        if (L->act_id == max_num_activities - 1)
-        { // Ensuring the current activity isn't the last one
-            return 0;
-        }
-        if (L->duration < L->act->min_duration)
-        { // Verifying the user has remained for minimum duration of the current activity
-            return 0;
+        int target = a1 == dusk ? ctx->p.horizon - 1 : h + travel_time(ctx, &ctx->activities[L.act_id], &ctx->activities[a1]) + 1;
+        if (target < min_time || !is_feasible(ctx, &L, &ctx->activities[a1]))
+        { // if activity is not feasible, pass directly to the next activity
+            continue;
         }
 
-        int tt = travel_time(L->act, a);
-        // current time + travel_time for a + min duration for a + time for returning home > end of horizon
-        // Ie enough time left in the horizon to add this activity
-        if (L->time + tt + a->min_duration +
-                travel_time(a, &activities[max_num_activities - 1]) >=
-            horizon - 1)
+        // what would the label look like after this activity? Its previous is set once it is inserted
+        out[n].moved = update_label_from_activity(ctx, &L, &ctx->activities[a1]);
+        n++;
+    } // end for a1
+    return n;
+}
+
+/*  Inserts the candidates of row li of cell [h][...] in order. The labels of the moves come from pool,
+    the dropped ones go back to it */
+static void commit_row(SolverContext *ctx, const L_list *cell, int li, int h, Candidate *c, int n, Pool *pool)
+{
+    int dusk = ctx->max_num_activities - 1;
+    Label *entry = cell->element[li];
+    // back pointer of the labels leaving from this row: the entry label itself, or a copy of the row's state
+    // made on the first transition that survives (previous = entry->previous, the stay is skipped)
+    Label *departure = entry->time == h ? entry : NULL;
+
+    for (int k = 0; k < n; k++)
+    {
+        if (c[k].moved == NULL)
         {
-            return 0;
+            Label *next = &c[k].next;
+            insert_if_not_dominated(ctx, bucket_cell(ctx, next->time, next->act_id), entry, next);
+            continue;
         }
-        // Making sure the new activity starts and ends within its allowed time window : signes changed !
-        if (L->time + tt < a->earliest_start)
+
+        Label *L1 = c[k].moved;
+        int a1 = L1->act_id;
+        if ((ctx->dominance & DOMINANCE_ACROSS_TIME) && dominated_by_earlier_arrival(ctx, a1, L1))
         {
-            return 0;
+            STAT_ADD(ctx, labels_dominated_earlier, 1);
+            release_label_to(ctx, pool, L1);
+            continue;
         }
-        // if current time + travel time to next activity is less than the latest possible start time of the next activity,
-        // not allowed
-        if (L->time + tt > a->latest_start)
+        if (ctx->closing && a1 != dusk)
         {
-            return 0;
+            STAT_ADD(ctx, pruned_by_label_cap, 1);
+            release_label_to(ctx, pool, L1);
+            continue;
         }
-        // if we have already done this particular activity
-        if (mem_contains(L, a))
+
+        // But : garder le minimum de L_list pour le temps au nouveau label et l'activite a1
+        // aim: keep only the labels of the cell that no other label dominates
+        if (!insert_if_not_dominated(ctx, bucket_cell(ctx, L1->time, a1), L1, L1))
         {
-            // printf("\n mem_contains = %d", mem_contains(L,a));
-            return 0;
+            // L1 is dominated by a label in the bucket and discarded
+            release_label_to(ctx, pool, L1);
+            continue;
         }
-
-        // SOC constraint: must be non-negative after travel
-        double soc_after_travel = L->current_soc - energy_consumed_soc(L->act, a);
-        if (soc_after_travel < 0)
+        if (departure == NULL)
         {
-            return 0;
+            departure = ctx_alloc_label(ctx);
+            label_from_row(cell, li, h, departure);
         }
-
-        // constraint 35
-        if (a->is_charging && a->charge_mode == 0)
+        L1->previous = departure;
+        if (a1 == dusk && L1->utility > ctx->incumbent)
         {
-            return 0;
+            ctx->incumbent = L1->utility; // dusk rows are only ever replaced by better ones
         }
-        // if (a->is_charging)
-        // {
-        //     double results[2];
-        //     get_charge_rate_and_price(a, results);
-        //     double charge_rate = results[0];
-        //     // double charge_price = results[1];
+    }
+}
+
+/*  Expands row li of cell [h][...]: one more interval at the activity, or a move to each feasible successor.
+    Only cells at min_time or later receive labels, see dp_from(). Returns the number of labels generated */
+static long expand_row(SolverContext *ctx, L_list *cell, int li, int h, int min_time)
+{
+    int n = generate_row(ctx, cell, li, h, min_time, ctx->candidates);
+    commit_row(ctx, cell, li, h, ctx->candidates, n, &ctx->label_pool);
+    return n;
+}
 
-        //     // double delta_soc = charge_rate * time_interval / 60;
+/*  Expansion threads (ctx_set_expansion_threads): the rows of one interval only insert into later cells, so
+    their successors can be generated in parallel. Each thread takes a contiguous range of the interval's rows,
+    in the order of the serial sweep, and generates them on a copy of the context with its own label pool and
+    counters. The main thread then commits the rows one by one in that order, bounds, dominance and back pointers
+    included: the bucket ends up exactly as the serial sweep builds it */
 
-        //     if (soc_after_travel + charge_rate > soc_full)
-        //     {
-        //         return 0;
-        //     } // constraint 26, but makes sure we don't pick an overzealous charge mode
-        // }
+#define EXPAND_MIN_ROWS 64 // intervals with fewer rows are expanded serially
+
+typedef struct ExpandRow
+{
+    L_list *cell;
+    int li;
+    int first; // first candidate in the thread's buffer
+    int n;     // candidates, -1 if the row is left to the main thread (below the incumbent, out of memory)
+} ExpandRow;
 
-        if (a->is_service_station)
+typedef struct ExpandTeam ExpandTeam;
+
+typedef struct ExpandWorker
+{
+    ExpandTeam *team;
+    SolverContext *ctx; // context the rows are generated on: the solving one for the main thread, else view
+    SolverContext view;
+    Pool *pool;         // pool of the labels it makes
+    int from;           // rows [from, to) of the interval
+    int to;
+    ExpandRow *rows;
+    int rows_cap;
+    Candidate *candidates;
+    int n_candidates;
+    int candidates_cap;
+    pthread_t thread;
+} ExpandWorker;
+
+struct ExpandTeam
+{
+    SolverContext *ctx;
+    ExpandWorker *workers; // [0] is the main thread
+    int n_workers;
+    pthread_mutex_t lock;
+    pthread_cond_t wake; // step changed or quit
+    pthread_cond_t idle; // pending reached 0
+    long step;
+    int pending; // threads still generating the current step
+    int quit;
+
+    // the interval being expanded: its cells holding rows, in sweep order
+    int h;
+    int min_time;
+    L_list **cells;
+    int *cell_first; // first row of each cell, cell_first[n_cells] rows in all
+    int n_cells;
+};
 
+/* Generates the rows [from, to) of the interval into the worker's buffers */
+static void generate_rows(ExpandWorker *w)
+{
+    ExpandTeam *team = w->team;
+    SolverContext *ctx = w->ctx;
+    int out_of_memory = 0;
+    int c = 0;
+    w->n_candidates = 0;
+    for (int r = w->from; r < w->to; r++)
+    {
+        while (team->cell_first[c + 1] <= r)
+        {
+            c++;
+        }
+        ExpandRow *row = &w->rows[r - w->from];
+        row->cell = team->cells[c];
+        row->li = r - team->cell_first[c];
+        row->first = w->n_candidates;
+        row->n = -1;
+        int act = row->cell->element[row->li]->act_id;
+        // the incumbent only rises, the main thread drops the row again
+        if (out_of_memory || (ctx->bounding && below_incumbent(ctx, act, team->h, row->cell->stay[row->li].duration,
+                                                              row->cell->utility[row->li])))
         {
-            if (!a->is_charging) // constraint 33
+            continue;
+        }
+        if (w->n_candidates + ctx->max_num_activities > w->candidates_cap)
+        {
+            int cap = 2 * w->candidates_cap + ctx->max_num_activities;
+            Candidate *candidates = (Candidate *)realloc(w->candidates, (size_t)cap * sizeof(Candidate));
+            if (candidates == NULL)
             {
-                return 0;
+                out_of_memory = 1;
+                continue;
             }
+            w->candidates = candidates;
+            w->candidates_cap = cap;
         }
-        return 1;
+        row->n = generate_row(ctx, row->cell, row->li, team->h, team->min_time, &w->candidates[w->n_candidates]);
+        w->n_candidates += row->n;
     }
-};
+}
 
-// function to fix all the variables
-// and check the constraints at the end of an activity
+static void *expand_thread(void *arg)
+{
+    ExpandWorker *w = (ExpandWorker *)arg;
+    ExpandTeam *team = w->team;
+    long seen = 0;
+    for (;;)
+    {
+        pthread_mutex_lock(&team->lock);
+        while (team->step == seen && !team->quit)
+        {
+            pthread_cond_wait(&team->wake, &team->lock);
+        }
+        if (team->quit)
+        {
+            pthread_mutex_unlock(&team->lock);
+            return NULL;
+        }
+        seen = team->step;
+        pthread_mutex_unlock(&team->lock);
 
-/*  checks if Label L1 dominates Label L2 based on certain criteria.
-    This aims to maximise the utility function
+        generate_rows(w);
 
-    Without pruning, the number of labels explodes exponentially
-    Dominance identifies labels that are strictly worse than others and can be safely discarded
-    This is the key to computational efficiency
+        pthread_mutex_lock(&team->lock);
+        if (--team->pending == 0)
+        {
+            pthread_cond_signal(&team->idle);
+        }
+        pthread_mutex_unlock(&team->lock);
+    }
+}
 
-    0 = no dominance
-    1 = L1 dominates by default because L2 is NULL
-    2 = L1 dominates L2 based on the criteria */
+static void stop_expand_team(ExpandTeam *team)
+{
+    if (team == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&team->lock);
+    team->quit = 1;
+    pthread_cond_broadcast(&team->wake);
+    pthread_mutex_unlock(&team->lock);
+    for (int w = 0; w < team->n_workers; w++)
+    {
+        if (w > 0)
+        {
+            pthread_join(team->workers[w].thread, NULL);
+        }
+        free(team->workers[w].rows);
+        free(team->workers[w].candidates);
+    }
+    pthread_mutex_destroy(&team->lock);
+    pthread_cond_destroy(&team->wake);
+    pthread_cond_destroy(&team->idle);
+    free(team->workers);
+    free(team->cells);
+    free(team->cell_first);
+    free(team);
+}
 
-static int dominates(Label *L1, Label *L2)
+/*  Starts ctx->expansion_threads - 1 threads besides the caller for a DP pass, their label pools are kept in
+    the context with the bucket. NULL if not a single thread could be started: the pass is then serial */
+static ExpandTeam *start_expand_team(SolverContext *ctx)
 {
-    if (L1 == NULL)
+    int n = ctx->expansion_threads;
+    if (ctx->n_expand_pools < n - 1)
     {
-        return 0;
+        Pool *pools = (Pool *)realloc(ctx->expand_pools, (size_t)(n - 1) * sizeof(Pool));
+        if (pools == NULL)
+        {
+            return NULL;
+        }
+        for (int i = ctx->n_expand_pools; i < n - 1; i++)
+        {
+            pool_init(&pools[i], sizeof(Label), 4096);
+        }
+        ctx->expand_pools = pools;
+        ctx->n_expand_pools = n - 1;
     }
-    if (L2 == NULL)
+    ExpandTeam *team = (ExpandTeam *)calloc(1, sizeof(ExpandTeam));
+    if (team == NULL)
     {
-        return 1;
+        return NULL;
     }
-    if (L1->act_id != L2->act_id)
+    team->ctx = ctx;
+    team->workers = (ExpandWorker *)calloc((size_t)n, sizeof(ExpandWorker));
+    team->cells = (L_list **)malloc((size_t)ctx->max_num_activities * sizeof(L_list *));
+    team->cell_first = (int *)malloc((size_t)(ctx->max_num_activities + 1) * sizeof(int));
+    pthread_mutex_init(&team->lock, NULL);
+    pthread_cond_init(&team->wake, NULL);
+    pthread_cond_init(&team->idle, NULL);
+    if (team->workers == NULL || team->cells == NULL || team->cell_first == NULL)
     {
-        return 0;
+        stop_expand_team(team);
+        return NULL;
     }
+    team->workers[0].team = team;
+    team->workers[0].ctx = ctx;
+    team->workers[0].pool = &ctx->label_pool;
+    team->n_workers = 1;
+    for (int w = 1; w < n; w++)
+    {
+        ExpandWorker *worker = &team->workers[w];
+        worker->team = team;
+        worker->ctx = &worker->view;
+        worker->pool = &ctx->expand_pools[w - 1];
+        if (pthread_create(&worker->thread, NULL, expand_thread, worker) != 0)
+        {
+            break;
+        }
+        team->n_workers++;
+    }
+    if (team->n_workers == 1)
+    {
+        stop_expand_team(team);
+        return NULL;
+    }
+    return team;
+}
 
-    if (L1->utility >= L2->utility)
-    { // L1 a une meilleure utility que L2
-
-        // if(L1->time <= L2->time){
-        //     return 2;
-        // }
+/*  Expands the rows of interval h on the team (see ExpandTeam). Returns the number of labels generated,
+    -1 if the interval is left to the serial sweep (few rows, out of memory) */
+static long expand_step(ExpandTeam *team, int h, int min_time)
+{
+    SolverContext *ctx = team->ctx;
+    const uint64_t *active = &ctx->active[bucket_row(ctx, h) * ctx->active_words];
+    int n_rows = 0;
+    team->n_cells = 0;
+    for (int w = 0; w < ctx->active_words; w++)
+    {
+        for (uint64_t bits = active[w]; bits != 0; bits &= bits - 1)
+        {
+            L_list *cell = bucket_cell(ctx, h, w * 64 + lowest_bit(bits));
+            team->cells[team->n_cells] = cell;
+            team->cell_first[team->n_cells++] = n_rows;
+            n_rows += cell->n;
+        }
+    }
+    team->cell_first[team->n_cells] = n_rows;
+    if (n_rows < EXPAND_MIN_ROWS)
+    {
+        return -1;
+    }
 
-        /*  S'assure que tous les group de L2 sont dans L1, sinon ca veut dire que L2 peut etre moins bien pcq elle nn'a pas encore fait un group.
-            Au contraire si L1 est meilleur alors que il n'a meme pas fait tous les groupes de L2, ca veut dire que son choice set est tjrs plus grand */
-        // Dominance should keep the label with the larger future choice set:
-        // if L1 has visited a subset of L2's groups, L1 can emulate any continuation of L2.
-        if (dom_mem_contains(L1, L2))
+    team->h = h;
+    team->min_time = min_time;
+    for (int w = 0; w < team->n_workers; w++)
+    {
+        ExpandWorker *worker = &team->workers[w];
+        worker->from = (int)((long)n_rows * w / team->n_workers);
+        worker->to = (int)((long)n_rows * (w + 1) / team->n_workers);
+        if (worker->to - worker->from > worker->rows_cap)
+        {
+            int cap = worker->to - worker->from;
+            ExpandRow *rows = (ExpandRow *)realloc(worker->rows, (size_t)cap * sizeof(ExpandRow));
+            if (rows == NULL)
+            {
+                return -1;
+            }
+            worker->rows = rows;
+            worker->rows_cap = cap;
+        }
+        if (w > 0)
         {
+            // the interval's state for the thread, on its own pool and counters
+            worker->view = *ctx;
+            worker->view.label_pool = *worker->pool;
+            worker->view.live_labels = 0;
+            memset(&worker->view.stats, 0, sizeof(worker->view.stats));
+        }
+    }
+
+    pthread_mutex_lock(&team->lock);
+    team->step++;
+    team->pending = team->n_workers - 1;
+    pthread_cond_broadcast(&team->wake);
+    pthread_mutex_unlock(&team->lock);
+    generate_rows(&team->workers[0]);
+    pthread_mutex_lock(&team->lock);
+    while (team->pending > 0)
+    {
+        pthread_cond_wait(&team->idle, &team->lock);
+    }
+    pthread_mutex_unlock(&team->lock);
+
+    for (int w = 1; w < team->n_workers; w++)
+    {
+        ExpandWorker *worker = &team->workers[w];
+        const SolverStats *st = &worker->view.stats;
+        *worker->pool = worker->view.label_pool;
+        ctx->live_labels += worker->view.live_labels;
+        ctx->stats.rejected_time_window += st->rejected_time_window;
+        ctx->stats.rejected_horizon += st->rejected_horizon;
+        ctx->stats.rejected_soc += st->rejected_soc;
+        ctx->stats.rejected_group_memory += st->rejected_group_memory;
+        ctx->stats.rejected_min_duration += st->rejected_min_duration;
+        ctx->stats.rejected_max_duration += st->rejected_max_duration;
+        ctx->stats.rejected_other += st->rejected_other;
+    }
+#if SOLVER_STATS
+    if (ctx->live_labels > ctx->stats.peak_live_labels)
+    {
+        ctx->stats.peak_live_labels = ctx->live_labels;
+    }
+#endif
 
-            // Exact method v2
-            if (L1->time <= L2->time
-                // && L1->current_soc >= L2->current_soc
-            )
+    // commit in sweep order, the checks of the serial sweep against its incumbent at that point
+    long generated = 0;
+    for (int w = 0; w < team->n_workers; w++)
+    {
+        ExpandWorker *worker = &team->workers[w];
+        for (int r = 0; r < worker->to - worker->from; r++)
+        {
+            ExpandRow *row = &worker->rows[r];
+            Candidate *c = row->n > 0 ? &worker->candidates[row->first] : NULL;
+            int act = row->cell->element[row->li]->act_id;
+            if (ctx->bounding &&
+                below_incumbent(ctx, act, h, row->cell->stay[row->li].duration, row->cell->utility[row->li]))
+            {
+                STAT_ADD(ctx, pruned_by_bound, 1);
+                for (int k = 0; k < row->n; k++)
+                {
+                    if (c[k].moved != NULL)
+                    {
+                        release_label_to(ctx, worker->pool, c[k].moved);
+                    }
+                }
+                continue;
+            }
+            if (row->n < 0)
             {
-                return 2;
+                generated += expand_row(ctx, row->cell, row->li, h, min_time);
+                continue;
             }
+            commit_row(ctx, row->cell, row->li, h, c, row->n, worker->pool);
+            generated += row->n;
+        }
+    }
+    return generated;
+}
 
-            // // Exact method v1
-            // if(L1->duration == L2->duration){return 2;}
-            // // if(L1->utility - duration_Ut[L1->acity][L1->duration] <= L2->utility - duration_Ut[L2->acity][L2->duration]){
-            // int group = L1->act->group;
-            // int des_dur = L1->act->des_duration;
-            // if(
-            //     L1->utility
-            //     + short_parameters[group] * time_interval * fmax(0, des_dur - L1->duration - 2)
-            //     + long_parameters[group] * time_interval * fmax(0, L1->duration - des_dur - 2)
-            //     <=
-            //     L2->utility
-            //     + short_parameters[group] * time_interval * fmax(0, des_dur - L2->duration - 2)
-            //     + long_parameters[group] * time_interval * fmax(0, L2->duration - des_dur - 2) ){
-            //     return 2;
-            // }
+// elapsed seconds from an arbitrary origin, for wall clock timings
+static double wall_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+// number of rows in the cells of bucket rows [from, to), the times themselves on the dense grid
+static long count_rows(const SolverContext *ctx, int from, int to)
+{
+    long n = 0;
+    for (int h = from; h < to; h++)
+    {
+        for (int act_index = 0; act_index < ctx->max_num_activities; act_index++)
+        {
+            n += ctx->bucket[h][act_index].n;
         }
     }
-    return 0;
-};
+    return n;
+}
 
-/* Calculate the utility of a label based on its starting activity and the duration of the one that just finished */
-static double update_utility(Label *L)
-// make sure to check that you start a new activity in label_update before this is calculated
-// function on the basis of minutes
-// time horizons differences are multiplied to be expressed in minutes from the parameters
+// appends the work of a DP pass to the stats of the solve, dropped if out of memory
+static void record_dp_pass(SolverContext *ctx, int t0, long generated, long kept, double seconds, double wall)
+{
+    STAT_ADD(ctx, labels_created, generated);
+    if (ctx->n_iteration_stats == ctx->iteration_stats_cap)
+    {
+        int cap = ctx->iteration_stats_cap > 0 ? 2 * ctx->iteration_stats_cap : 16;
+        DSSRIterationStats *stats = (DSSRIterationStats *)realloc(ctx->iteration_stats, (size_t)cap * sizeof(DSSRIterationStats));
+        if (stats == NULL)
+        {
+            return;
+        }
+        ctx->iteration_stats = stats;
+        ctx->iteration_stats_cap = cap;
+    }
+    DSSRIterationStats *it = &ctx->iteration_stats[ctx->n_iteration_stats++];
+    it->from_time = t0;
+    it->labels_generated = generated;
+    it->rows_kept = kept;
+    it->rows_at_end = count_rows(ctx, 0, ctx->bucket_rows);
+    it->time = seconds;
+    it->wall_time = wall;
+}
 
-// check if charging constrants can be used to deal with service stations instead
-// time window constraints between 7am and 11pm, not allowed outside that
+/*  DP pass that keeps every cell before time t0 and rebuilds the cells from t0 on.
+    No label before t0 moved into an activity whose memory changed (see ctx_dssr), so those cells
+    are exactly what a full pass would build again, as long as the error terms and the initial SOC are
+    the same (ctx->reuse_draws). Rows before t0 are expanded again into the cells from t0 on only.
+    t0 <= dawn's first interval is a full pass, the bucket must then be empty. A sliding bucket only
+    does full passes */
+static void dp_from(SolverContext *ctx, int t0)
 {
-    // should have an error term, but don't need a cost penalty
-    // cost of travel is associated with EV cost only, don't account for EV tax, parking etc
-    // to be listed as assumptions at beginning of paper
+    clock_t start_time = clock();
+    double start_wall = wall_seconds();
+    long generated = 0;
 
-    int activity_type = L->act->group;
-    Activity *act = L->act;
+    if (!ctx->succ_valid && !build_successor_lists(ctx))
+    {
+        fprintf(stderr, "DP: out of memory for the successor lists\n");
+        return;
+    }
+    if (ctx->candidates_cap < ctx->max_num_activities)
+    {
+        Candidate *candidates = (Candidate *)realloc(ctx->candidates, (size_t)ctx->max_num_activities * sizeof(Candidate));
+        if (candidates == NULL)
+        {
+            fprintf(stderr, "DP: out of memory for the successors of a row\n");
+            return;
+        }
+        ctx->candidates = candidates;
+        ctx->candidates_cap = ctx->max_num_activities;
+    }
 
-    Label *previous_L = L->previous;
-    Activity *previous_act = previous_L->act;
-    int previous_activity_type = previous_act->group;
+    if (ctx->bucket == NULL)
+    {
+        printf(" BUCKET IS NULL %d", 0);
+    }
 
-    L->utility = previous_L->utility;
+    int first = ctx->activities[0].min_duration; // time of the dawn label
+    long kept = 0;
+    ctx->closing = 0;
+    // the rows kept before t0 give the same dusk labels again below, the incumbent is rebuilt with them
+    ctx->incumbent = -INFINITY;
+    if (t0 <= first)
+    {
+        t0 = 0;
+        if (!ctx->reuse_draws)
+        {
+            draw_utility_error_terms_for_dp(ctx);
+            // without error terms the bounds of the first pass hold for the whole solve
+            if (ctx->bounding && (!ctx->bounds_ready || ctx->eps_participation != NULL))
+            {
+                ctx->bounds_ready = build_completion_bounds(ctx);
+                if (!ctx->bounds_ready)
+                {
+                    fprintf(stderr, "DP: out of memory for the completion bounds, bounding off\n");
+                    ctx->bounding = 0;
+                }
+            }
+        }
+        Label *ll = create_label(ctx, &ctx->activities[0]); // Initialise label with Dawn as first activity
+        append_label(bucket_cell(ctx, ll->time, 0), ll, ll); // store this label in the first position bucket structure
+        mark_active(ctx, ll->time, 0);
+        if (!ctx->reuse_draws)
+        {
+            ctx->draw_id++; // the next pass that draws gets new error terms and initial SOC
+        }
+        first = ll->time;
+    }
+    else
+    {
+        kept = count_rows(ctx, 0, t0);
+        // forget the cells from t0 on, their entry labels are referenced by nothing else.
+        // Latest first: a stay row reads the label of its entry row, which is in an earlier cell
+        for (int h = ctx->p.horizon - 1; h >= t0; h--)
+        {
+            for (int act_index = 0; act_index < ctx->max_num_activities; act_index++)
+            {
+                L_list *cell = &ctx->bucket[h][act_index];
+                while (cell->n > 0)
+                {
+                    remove_label(ctx, cell, cell->n - 1);
+                }
+            }
+            memset(&ctx->active[h * ctx->active_words], 0, (size_t)ctx->active_words * sizeof(uint64_t));
+        }
+    }
 
-    L->utility += asc_parameters[activity_type];
-    L->utility += travel_time_penalty * travel_time(previous_act, act);
+    if ((ctx->dominance & DOMINANCE_ACROSS_TIME) && !reset_frontiers(ctx))
+    {
+        fprintf(stderr, "DP: out of memory for the arrival frontiers, dominance across time off\n");
+        ctx->dominance &= ~DOMINANCE_ACROSS_TIME;
+    }
+    ExpandTeam *team = ctx->expansion_threads > 1 ? start_expand_team(ctx) : NULL;
 
-    // Error terms (drawn once per DP run). If std dev is 0, these arrays are NULL and add 0.
-    if (eps_participation != NULL)
+    for (int h = first; h < ctx->p.horizon - 1; h++) // for all time intervals from 0 to 288 (horizon = 289, the number of 5 min intervals in a day)
+    {
+        int min_time = h < t0 ? t0 : 0; // kept cells already have every label coming from before t0
+        // budgets, checked between intervals: the expansion threads then build the same bucket as the serial sweep
+        if (ctx->deadline_at > 0.0 && wall_seconds() >= ctx->deadline_at)
+        {
+            ctx->solve_status |= SOLVE_DEADLINE;
+            break;
+        }
+        if (ctx->max_live_labels > 0 && !ctx->closing && ctx->live_labels >= ctx->max_live_labels)
+        {
+            ctx->closing = 1;
+            ctx->solve_status |= SOLVE_LABEL_CAP;
+        }
+        if ((ctx->dominance & DOMINANCE_ACROSS_TIME) && !update_frontiers(ctx, h))
+        {
+            fprintf(stderr, "DP: out of memory for the arrival frontiers, dominance across time off\n");
+            ctx->dominance &= ~DOMINANCE_ACROSS_TIME;
+        }
+        // only the cells holding rows, in activity order
+        uint64_t *active = &ctx->active[bucket_row(ctx, h) * ctx->active_words];
+        long step_generated = team != NULL ? expand_step(team, h, min_time) : -1;
+        if (step_generated >= 0)
+        {
+            generated += step_generated;
+        }
+        else
+        {
+            for (int w = 0; w < ctx->active_words; w++)
+            {
+                for (uint64_t bits = active[w]; bits != 0; bits &= bits - 1)
+                {
+                    int act_index = w * 64 + lowest_bit(bits);
+                    // get all labels at state (h, act_index)
+                    // labels only ever go to later cells, so this one does not change while it is walked
+                    L_list *cell = bucket_cell(ctx, h, act_index);
+
+                    for (int li = 0; li < cell->n; li++) // for each label in the cell
+                    {
+                        // the incumbent may have risen since the row was inserted, none of its labels could beat it
+                        if (ctx->bounding && below_incumbent(ctx, act_index, h, cell->stay[li].duration, cell->utility[li]))
+                        {
+                            STAT_ADD(ctx, pruned_by_bound, 1);
+                            continue;
+                        }
+                        generated += expand_row(ctx, cell, li, h, min_time);
+                    } // end for li
+                } // end for a0
+            }
+        }
+        if (ctx->bucket_window > 0)
+        {
+            // the ring row goes to time h + bucket_window, nothing refers to the rows of h any more.
+            // Their labels are kept: the later labels point back to them
+            for (int w = 0; w < ctx->active_words; w++)
+            {
+                for (uint64_t bits = active[w]; bits != 0; bits &= bits - 1)
+                {
+                    bucket_cell(ctx, h, w * 64 + lowest_bit(bits))->n = 0;
+                }
+                active[w] = 0;
+            }
+        }
+    } // end for h
+    stop_expand_team(team);
+
+    record_dp_pass(ctx, t0, generated, kept, (double)(clock() - start_time) / CLOCKS_PER_SEC,
+                   wall_seconds() - start_wall);
+}
+
+/*  Ring length of a sliding bucket: a label at h goes at most to h + 1 + the longest travel time before dusk.
+    0 (the dense grid) if the ring would not be shorter than the horizon */
+static int sliding_window(const SolverContext *ctx)
+{
+    int longest = 0;
+    for (int i = 0; i < ctx->travel_n * ctx->travel_n; i++)
     {
-        L->utility += eps_participation[act->id];
-        L->utility += eps_travel[previous_act->id * eps_n + act->id];
+        longest = ctx->travel_intervals[i] > longest ? ctx->travel_intervals[i] : longest;
     }
+    int window = longest + 2;
+    return window + 1 < ctx->p.horizon ? window : 0;
+}
 
-    // service station has no duration penalties - its only penalties come from cost of charge
-    // so only apply these below to non-home and non service station activities
+/* Dynamic Programming */
+void ctx_dp(SolverContext *ctx)
+{
+    dp_from(ctx, 0);
+};
 
-    // PENALTY FOR FINISHING PREVIOUS ACTIVITY (duration deviation)
-    if (previous_activity_type != 0 && !previous_act->is_service_station)
+// the row of highest utility of the dusk cell whose schedule has no group cycle, NULL if none
+static Label *best_without_cycle(const SolverContext *ctx, const L_list *dusk)
+{
+    Label *best = NULL;
+    double max = -INFINITY;
+    for (int i = 0; i < dusk->n; i++)
     {
-        L->utility += short_parameters[previous_activity_type] * time_interval *
-                      fmax(0, previous_act->des_duration - previous_L->duration);
-        L->utility += long_parameters[previous_activity_type] * time_interval *
-                      fmax(0, previous_L->duration - previous_act->des_duration);
-        if (eps_duration != NULL)
+        Label *at;
+        int act, group;
+        if (dusk->utility[i] > max && !find_group_cycle(ctx, dusk->element[i], &at, &act, &group))
         {
-            L->utility += eps_duration[previous_act->id];
+            best = dusk->element[i];
+            max = dusk->utility[i];
         }
     }
+    return best;
+}
 
-    // Early/late start penalty (timing deviation)
-    if (activity_type != 0 && !act->is_service_station)
+/*  Under a deadline, before a pass releases the labels of the last one: copies the best schedule without
+    group cycle of the dusk cell if it beats the one kept from the earlier passes, so the solve can still
+    return it when the deadline cuts the next passes. The copy keeps the back pointers within itself */
+static void keep_schedule(SolverContext *ctx, const L_list *dusk)
+{
+    Label *best = best_without_cycle(ctx, dusk);
+    if (best == NULL ||
+        (ctx->n_kept_schedule > 0 && best->utility <= ctx->kept_schedule[ctx->n_kept_schedule - 1].utility))
     {
-        L->utility += early_parameters[activity_type] * time_interval *
-                      fmax(0, act->des_start_time - L->start_time);
-        L->utility += late_parameters[activity_type] * time_interval *
-                      fmax(0, L->start_time - act->des_start_time);
-        if (eps_start_time != NULL)
+        return;
+    }
+    int n = 0;
+    for (Label *L = best; L != NULL; L = L->previous)
+    {
+        n++;
+    }
+    if (n > ctx->kept_schedule_cap)
+    {
+        Label *grown = (Label *)realloc(ctx->kept_schedule, (size_t)n * sizeof(Label));
+        if (grown == NULL)
         {
-            L->utility += eps_start_time[act->id];
+            return; // the previous copy is kept
         }
+        ctx->kept_schedule = grown;
+        ctx->kept_schedule_cap = n;
+    }
+    // dawn first, the dusk label last
+    int i = n - 1;
+    for (Label *L = best; L != NULL; L = L->previous, i--)
+    {
+        ctx->kept_schedule[i] = *L;
+        ctx->kept_schedule[i].previous = i > 0 ? &ctx->kept_schedule[i - 1] : NULL;
     }
+    ctx->n_kept_schedule = n;
+}
 
-    // SOC anxiety/disutility at activity start (paper Eq. 8 uses SOC_a).
-    // Apply at the start of each non-dummy activity so SOC influences subsequent choices.
-    // (Dawn/dusk are dummy home activities; keep their utility at 0.)
-    if (act->id != 0 && act->id != max_num_activities - 1)
+/*  Runs the whole algorithm on a context: DP, then DP again with the DSSR memory until the best
+    schedule has no cycle. The bucket is kept in the context and reused by the next solve.
+    Returns 0 if a schedule was found (ctx_get_final_schedule()), -1 otherwise */
+int ctx_solve(SolverContext *ctx)
+{
+    clock_t start_time, end_time;
+    start_time = clock();
+    double start_wall = wall_seconds();
+
+    ctx->DSSR_count = 0;
+    ctx->final_schedule = NULL;
+    ctx->n_iteration_stats = 0;
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+    ctx->live_labels = 0; // the bucket is reset below
+    ctx->reuse_draws = 0;
+    ctx->bounds_ready = 0; // activities or parameters may have changed
+    ctx->solve_status = SOLVE_OPTIMAL;
+    ctx->n_kept_schedule = 0;
+    ctx->deadline_at = ctx->deadline > 0.0 ? start_wall + ctx->deadline : 0.0;
+    if (ctx->activities == NULL || ctx->max_num_activities <= 0 || ctx->p.horizon <= 1 || ctx->travel_intervals == NULL ||
+        ctx->charge_price == NULL)
+    {
+        printf("%s", "\n ctx_solve: parameters or activities not set");
+        return -1;
+    }
+    if (ctx->p.horizon > LABEL_FIELD_MAX || ctx->max_num_activities > LABEL_FIELD_MAX)
     {
-        L->utility += theta_soc * fmax(0, soc_threshold - L->soc_at_activity_start);
+        printf("\n ctx_solve: horizon and activity count must be at most %d", LABEL_FIELD_MAX);
+        return -1;
     }
 
-    // calculate the utility change from charging at finished activity
-    if (previous_act->is_charging)
+    // it's populating or updating the "bucket" with feasible solutions or labels
+    // bucket = pour chaque time horizon et pour chaque activite, voici un schedule ?
+    int window = ctx->sliding_bucket ? sliding_window(ctx) : 0;
+    int rows = window > 0 ? window + 1 : ctx->p.horizon;
+    if (ctx->bucket != NULL && (ctx->bucket_rows != rows || ctx->bucket_window != window ||
+                                ctx->bucket_cols != ctx->max_num_activities))
     {
-        if (previous_activity_type == 1)
-        {
-            L->utility += gamma_charge_work;
-        }
-        else if (previous_activity_type == 0)
+        ctx_free_bucket(ctx);
+    }
+    if (ctx->bucket == NULL)
+    {
+        ctx_create_bucket(ctx, rows, ctx->max_num_activities);
+        ctx->bucket_window = window;
+    }
+    else
+    {
+        ctx_reset_bucket(ctx);
+    }
+    ctx_dp(ctx);
+    ctx->reuse_draws = ctx->incremental_dssr;
+
+    // It's presumably the final set of solutions or labels that the algorithm is interested in
+    L_list *li = bucket_cell(ctx, ctx->p.horizon - 1, ctx->max_num_activities - 1); // la liste de label ou la journee est finie par la derniere activitee DUSK
+
+    while (!(ctx->solve_status & SOLVE_DEADLINE) && ctx_dssr(ctx, find_best(li, 0)))
+    { // detect cycles in the current best solution
+        if (ctx->deadline_at > 0.0 && wall_seconds() >= ctx->deadline_at)
         {
-            L->utility += gamma_charge_home;
+            ctx->solve_status |= SOLVE_DEADLINE; // the best schedule of this pass rather than another pass
+            break;
         }
-        else
+        if (ctx->deadline_at > 0.0)
         {
-            L->utility += gamma_charge_non_work;
+            keep_schedule(ctx, li); // the next pass may be cut before it reaches dusk
         }
-
-        double total_delta_soc = previous_L->current_soc - previous_L->soc_at_activity_start;
-        L->utility += beta_delta_soc * total_delta_soc;
-        if (previous_L->previous != NULL) // if the previous act is not empty (ie it is after dawn), need to calc the charge cost
-        // if (previous_L->charge_cost_at_activity_start > 0)
+        if (ctx->incremental_dssr)
         {
-            double activity_charge_cost = previous_L->current_charge_cost - previous_L->charge_cost_at_activity_start;
-            L->utility += beta_charge_cost * activity_charge_cost;
+            if (ctx->dirty_from >= ctx->p.horizon)
+            {
+                break; // the memory did not change, another pass would find the same schedule
+            }
+            if (ctx->dirty_from <= ctx->activities[0].min_duration || ctx->bucket_window > 0)
+            {
+                ctx_reset_bucket(ctx);
+                dp_from(ctx, 0); // the draws of the first pass are kept
+            }
+            else
+            {
+                dp_from(ctx, ctx->dirty_from);
+            }
         }
         else
         {
-            L->utility += beta_charge_cost * previous_L->current_charge_cost;
+            ctx_reset_bucket(ctx); // labels go back to their pools in O(1), the grid is kept
+            ctx_dp(ctx);
         }
+        ctx->DSSR_count++;
+    };
+    ctx->reuse_draws = 0;
 
-        // Charging-specific error term (drawn once per DP run).
-        if (eps_charging != NULL)
+    if (ctx->solve_status & SOLVE_DEADLINE)
+    {
+        // the passes left the group cycles of their best schedules: never return one of those. A cut pass
+        // often reaches dusk with a few poor rows only, the kept schedule of an earlier pass can beat them
+        Label *cut = best_without_cycle(ctx, li);
+        Label *kept = ctx->n_kept_schedule > 0 ? &ctx->kept_schedule[ctx->n_kept_schedule - 1] : NULL;
+        ctx->final_schedule = kept != NULL && (cut == NULL || kept->utility > cut->utility) ? kept : cut;
+        if (ctx->final_schedule == NULL)
         {
-            int mode = previous_act->charge_mode;
-            if (mode < 0)
-                mode = 0;
-            if (mode > 7)
-                mode = 7;
-            L->utility += eps_charging[previous_act->id * 8 + mode];
+            ctx->solve_status |= SOLVE_NO_SCHEDULE;
         }
     }
+    else
+    {
+        ctx->final_schedule = find_best(li, 0);
+    }
+    end_time = clock();
+    ctx->total_time = (double)(end_time - start_time) / CLOCKS_PER_SEC;
+    ctx->stats.wall_time = wall_seconds() - start_wall;
+    return ctx->final_schedule != NULL ? 0 : -1;
+}
 
-    return L->utility;
-};
-
-// only go to update utility if it is a new act
-// SOC is updated in update_label
-// if charging, calculate the remaining uncharged amount, working in 5 min interval
-// calc remaining spare capacity, if it is >0 then charge until full
-// max amount of charge possible in that interval
-
-// /*  Generates a new label L based on an existing label current_label and an activity a */
-static Label *update_label_from_activity(Label *current_label, Activity *a)
-// This function updates labels by one time interval (5 mins)
-//   1. Check if new activity first
-//   2. If new: transition to new activity (update utility, advance timestamp, reduce SOC)
-//   3. If not new: do simple time update
-//   4. Update charging regardless of new or not
+/*  Writes the visits of the last schedule found into out, in chronological order.
+    A visit is the run of labels with the same activity and start time, its row is taken from the last one.
+    At most cap rows are written, the return value is the number of visits (0 if no schedule),
+    so a call with cap = 0 gives the size to allocate. */
+int ctx_export_schedule(const SolverContext *ctx, ScheduleRow *out, int cap)
 {
-    Label *new_label = malloc(sizeof(Label));
-    new_label->previous = current_label;
-    new_label->act = a;
-    new_label->act_id = a->id;
-    new_label->deviation_start = current_label->deviation_start;
-    new_label->deviation_dur = current_label->deviation_dur;
-    new_label->current_charge_cost = current_label->current_charge_cost; // inherit cumulative charging cost
-
-    // STEP 1: Check if new activity
-    if (a->id != current_label->act_id)
+    int n_rows = 0;
+    for (Label *L = ctx->final_schedule; L != NULL; L = L->previous)
     {
-        // Transition to new activity:
-        // - Calculate start time (current time + travel time)
-        // - Update memory
-        // - Reduce SOC for travel
-        // - Initialize time and duration
-
-        new_label->start_time = current_label->time + travel_time(current_label->act, a);
-        new_label->mem = unionLinkedLists(current_label->mem, a->memory, a->group);
-
-        //  below to be by interval, maybe adapt across min_duration in future
-        if (a->id == max_num_activities - 1)
-        {                                                              // d'ou le saut chelou a la fin : DUSK (pas de utility pour dusk)
-            new_label->duration = horizon - new_label->start_time - 1; // set to 0 before
-            new_label->time = horizon - 1;                             // pq pas le temps actuel (pour uen 3e var de starting time)
-        }
-        else
+        // walking backwards, the first label of a visit met is its last interval
+        if (L->previous == NULL || L->previous->act_id != L->act_id || L->previous->start_time != L->start_time)
         {
-            new_label->duration = 1;
-            new_label->time = new_label->start_time + new_label->duration;
+            n_rows++;
         }
+    }
 
-        // Reduce SOC by travel consumption
-        double soc_consumed = energy_consumed_soc(current_label->act, a);
-        new_label->soc_at_activity_start = current_label->current_soc - soc_consumed;
-        new_label->current_soc = new_label->soc_at_activity_start; // initialise the soc in case of charging
-
-        // Initialize charging variables for new activity
-        new_label->charge_duration = 0;
-        new_label->delta_soc = 0;
-        new_label->charge_cost_at_activity_start = current_label->current_charge_cost;
-        // STEP 1b: Calculate charging for first interval of new activity (if charging)
-        //  This must happen before calling update_utility so that utility calculation has access to charging data
-        //  need to adapt this to deal with the situation where
-        //  charging will be completed BEFORE activity is over
-        //  - so there will be time spent idle at the charger
-        if (a->is_charging)
+    int row = n_rows;
+    Label *last = NULL; // last label of the visit being walked
+    for (Label *L = ctx->final_schedule; L != NULL; L = L->previous)
+    {
+        if (last == NULL)
         {
-            double results[2];
-            get_charge_rate_and_price(a, results);
-            double charge_rate = results[0];
-            double charge_price = results[1];
-            // double max_possible_charge = charge_rate * (time_interval / 60.0);
-            new_label->delta_soc = fmin(soc_full - new_label->current_soc, charge_rate);
-            new_label->current_soc += new_label->delta_soc;
-            new_label->charge_duration = 1;
-
-            // Calculate charging cost for this first interval
-            double tou_factor = get_tou_factor(new_label->start_time);
-            double energy_charged_kwh = new_label->delta_soc * battery_capacity;
-            double interval_cost = charge_price * tou_factor * energy_charged_kwh;
-            new_label->current_charge_cost += interval_cost;
+            last = L;
         }
-
-        // Update utility ONLY when moving to new activity
-        new_label->utility = update_utility(new_label);
-
-        // Calculate deviation penalties for activity transitions
-        // **SERVICE STATION HANDLING**: No deviation penalties
-        if (!a->is_service_station && a->group != 0)
+        if (L->previous == NULL || L->previous->act_id != L->act_id || L->previous->start_time != L->start_time)
         {
-            new_label->deviation_start += abs(new_label->start_time - a->des_start_time);
+            row--;
+            if (row < cap)
+            {
+                ScheduleRow *r = &out[row];
+                r->act_id = last->act_id;
+                r->start_time = last->start_time;
+                r->duration = last->duration;
+                r->charge_duration = last->charge_duration;
+                r->soc_start = last->soc_at_activity_start;
+                r->soc_end = last->current_soc;
+                r->charge_cost = last->current_charge_cost;
+                r->utility = last->utility;
+            }
+            last = NULL;
         }
+    }
+    return n_rows;
+}
 
-        if (!current_label->act->is_service_station && current_label->act->group != 0)
-        {
-            new_label->deviation_dur += abs(current_label->duration - current_label->act->des_duration);
-        }
+/*  Solves n_days consecutive days on one context: the dusk SOC of a day is the fixed dawn SOC of the next,
+    the bucket, the pools and, for days sharing an activity array, the travel tables and successor lists
+    are kept across days. initial_soc is the dawn SOC of the first day, < 0 to draw it as ctx_solve() does.
+    The random draws continue from day to day, set the seed once before the run.
+    A day without a schedule keeps its dawn SOC for the next day.
+    results is filled in with arrays owned by the caller, see free_multiday_result().
+    Returns the number of days with a schedule, -1 if out of memory or the activities could not be set */
+int ctx_solve_multiday(SolverContext *ctx, const Day *days, int n_days, double initial_soc, MultiDayResult *results)
+{
+    memset(results, 0, sizeof(*results));
+    if (n_days <= 0)
+    {
+        return 0;
     }
-    else // SAME ACTIVITY - simple time update
+    results->days = (DayResult *)calloc((size_t)n_days, sizeof(DayResult));
+    if (results->days == NULL)
     {
-        // Continue at same activity - just advance by one time interval
-        new_label->start_time = current_label->start_time;
-        new_label->time = current_label->time + 1; // advance by 1 time interval
-        new_label->duration = current_label->duration + 1;
-        new_label->mem = copyLinkedList(current_label->mem);
-
-        // Inherit SOC and charging cost (will be updated below if charging)
-        // no decrease in SOC possible because no travel involved
-        new_label->current_soc = current_label->current_soc;
-        new_label->soc_at_activity_start = current_label->soc_at_activity_start;
-        new_label->charge_duration = current_label->charge_duration;
-        new_label->delta_soc = 0;                                                                // change in charging per interval
-        new_label->charge_cost_at_activity_start = current_label->charge_cost_at_activity_start; // inherit this state
-
-        // Utility stays the same - no update for continuing activity
-        new_label->utility = current_label->utility;
-
-        // STEP 2: Update charging for continuing activity
-        // Only update SOC and costs here - NO utility changes
-        if (a->is_charging && (new_label->current_soc < soc_full || a->is_service_station))
-        {
-            new_label->charge_duration += 1;
-
-            double results[2];
-            get_charge_rate_and_price(a, results);
-            double charge_rate = results[0];
-            double charge_price = results[1];
-
-            // Calculate how much we can charge in this interval
-            // Limited by remaining battery capacity
-            // double max_possible_charge = charge_rate * (time_interval / 60.0);
-            new_label->delta_soc = fmin(soc_full - new_label->current_soc, charge_rate);
-            new_label->current_soc += new_label->delta_soc;
-
-            // Calculate charging cost for this interval
-            double tou_factor = get_tou_factor(new_label->start_time); // needs to be at the start of the interval
-            double energy_charged_kwh = new_label->delta_soc * battery_capacity;
-            double interval_cost = charge_price * tou_factor * energy_charged_kwh;
-            new_label->current_charge_cost += interval_cost;
-
-            // All utility changes happen only for new activities
-        }
+        return -1;
     }
+    results->n_days = n_days;
+    int rows_cap = 0;
 
-    return new_label;
-}
+    // the caller's SOC setting is restored at the end
+    int was_fixed = ctx->fixed_initial_soc_enabled;
+    double fixed_value = ctx->fixed_initial_soc_value;
+    if (initial_soc >= 0.0)
+    {
+        ctx_set_fixed_initial_soc(ctx, initial_soc);
+    }
+    else
+    {
+        ctx_clear_fixed_initial_soc(ctx);
+    }
 
-/*  Finds the label with the max utility value from the list.
-    Returns the label with the max utility value. */
-Label *find_best(L_list *B, int o)
-{
-    double max = -INFINITY;
-    Label *bestL = NULL;
-    L_list *li = B;
-    while (li != NULL)
+    int n_solved = 0;
+    for (int d = 0; d < n_days; d++)
     {
-        // printf("%s", "\n Hello there");
-        if (li->element != NULL)
+        DayResult *day = &results->days[d];
+        day->status = -1;
+        day->first_row = results->n_rows;
+        if (d > 0 && days[d].activities == days[d - 1].activities && days[d].n_activities == ctx->max_num_activities)
+        {
+            // same set as the day before: only the DSSR memory changed, the tables still hold
+            memcpy(ctx->activities, days[d].activities, (size_t)days[d].n_activities * sizeof(Activity));
+        }
+        else if (ctx_set_activities(ctx, days[d].activities, days[d].n_activities) != 0)
+        {
+            n_solved = -1;
+            break;
+        }
+
+        if (ctx_solve(ctx) == 0)
         {
-            if (li->element->utility > max)
+            int n_rows = ctx_export_schedule(ctx, NULL, 0);
+            if (results->n_rows + n_rows > rows_cap)
             {
-                bestL = li->element;
-                max = bestL->utility;
+                int cap = rows_cap > 0 ? 2 * rows_cap : 16;
+                while (cap < results->n_rows + n_rows)
+                {
+                    cap *= 2;
+                }
+                ScheduleRow *rows = (ScheduleRow *)realloc(results->rows, (size_t)cap * sizeof(ScheduleRow));
+                if (rows == NULL)
+                {
+                    n_solved = -1;
+                    break;
+                }
+                results->rows = rows;
+                rows_cap = cap;
             }
+            day->n_rows = ctx_export_schedule(ctx, results->rows + results->n_rows, n_rows);
+            results->n_rows += day->n_rows;
+            day->utility = ctx->final_schedule->utility;
+            day->final_soc = ctx->final_schedule->current_soc;
+            day->status = 0;
+            n_solved++;
         }
-        li = li->next;
+        else
+        {
+            day->final_soc = ctx->initial_soc;
+        }
+        day->DSSR_count = ctx->DSSR_count;
+        day->initial_soc = ctx->initial_soc;
+        day->total_time = ctx->total_time;
+        ctx_set_fixed_initial_soc(ctx, day->final_soc);
     }
-    if (bestL == NULL)
+
+    if (was_fixed)
     {
-        printf("%s", "\n Solution is not feasible, check activities parameters.");
+        ctx_set_fixed_initial_soc(ctx, fixed_value);
     }
     else
     {
-        if (o)
-        {
-            printf("\n Best solution value = %.2f \n", bestL->utility);
-            // printf("%s ", "[");
-            recursive_print(bestL);
-            // printf("%s \n", "]");
-        }
+        ctx_clear_fixed_initial_soc(ctx);
     }
-    return bestL;
-};
+    return n_solved;
+}
 
-/*  To detect cycles based on the group of activities within a sequence of labels and,
-    if a cycle is detected, update the memory of some labels in the sequence
-    "this combination has been done before" */
-int DSSR(Label *L)
+/*  Activities of ctx on intervals factor times longer: windows and duration limits widened to whole coarse
+    intervals, desired times rounded. NULL if out of memory */
+static Activity *coarse_activities(const SolverContext *ctx, int factor)
 {
-    // printf("\n DSSR");
-    Label *p1 = L;
-    int cycle = 0;
-    int c_activity = 0;
-    int group_activity = 0;
+    int n = ctx->max_num_activities;
+    Activity *acts = (Activity *)malloc((size_t)n * sizeof(Activity));
+    if (acts == NULL)
+    {
+        return NULL;
+    }
+    memcpy(acts, ctx->activities, (size_t)n * sizeof(Activity));
+    for (int i = 0; i < n; i++)
+    {
+        Activity *a = &acts[i];
+        a->earliest_start = a->earliest_start / factor;
+        a->latest_start = (a->latest_start + factor - 1) / factor;
+        int min_duration = a->min_duration / factor;
+        a->min_duration = min_duration == 0 && a->min_duration > 0 ? 1 : min_duration;
+        a->max_duration = (a->max_duration + factor - 1) / factor;
+        a->des_duration = (a->des_duration + factor / 2) / factor;
+        a->des_start_time = (a->des_start_time + factor / 2) / factor;
+    }
+    return acts;
+}
 
-    while (p1 != NULL && cycle == 0)
-    { // iterates through the labels starting from L in the reverse direction until it reaches the beginning
-        while (p1 != NULL && (p1->act_id == max_num_activities - 1 || p1->act_id == max_num_activities - 2))
-        { // skips labels that correspond to the last activity // group == 0 ?
-            p1 = p1->previous;
-        }
-        Label *p2 = p1;
-        while (p2 != NULL && p2->act_id == p1->act_id)
-        { //  skips labels that have the same activity as p.
-            p2 = p2->previous;
-        }
-        while (p2 != NULL && cycle == 0)
-        { //  checks for a cycle by looking for a previous label with the same group as p. If found, records the activity and group,
-            // Ignore home (group==0): home is allowed to repeat and should not be treated as a cycle.
-            // if (p2->act->group == p1->act->group)
-            if (p1->act->group != 0 && p2->act->group == p1->act->group)
+/*  Context for the coarse stage of ctx_solve_coarse_to_fine(): the activities, skim and tariffs of ctx at
+    time_interval * factor, with its settings and random state, so that its first pass draws the error terms
+    and the initial SOC the fine solve draws. The travel penalty is per interval, it is scaled too.
+    NULL if out of memory */
+static SolverContext *create_coarse_context(const SolverContext *ctx, int factor)
+{
+    SolverContext *coarse = ctx_create();
+    if (coarse == NULL)
+    {
+        return NULL;
+    }
+    SolverParams p = ctx->p;
+    p.horizon = (ctx->p.horizon + factor - 1) / factor;
+    p.time_interval = ctx->p.time_interval * factor;
+    p.travel_time_penalty = ctx->p.travel_time_penalty * factor;
+    ctx_set_params(coarse, &p);
+
+    int n = ctx->max_num_activities;
+    Activity *acts = coarse_activities(ctx, factor);
+    int ok = acts != NULL && ctx_set_activities(coarse, acts, n) == 0;
+    free(acts);
+    if (ok && ctx->travel_skim_loaded)
+    {
+        // the skim again by activity, from the location tables
+        int *tt = (int *)malloc((size_t)n * (size_t)n * sizeof(int));
+        double *soc = (double *)malloc((size_t)n * (size_t)n * sizeof(double));
+        ok = tt != NULL && soc != NULL;
+        for (int i = 0; ok && i < n; i++)
+        {
+            for (int j = 0; j < n; j++)
             {
-                cycle = 1;
-                c_activity = p1->act_id;
-                group_activity = p1->act->group;
+                int k = ctx->location[i] * ctx->travel_n + ctx->location[j];
+                tt[i * n + j] = (ctx->travel_intervals[k] + factor - 1) / factor;
+                soc[i * n + j] = ctx->travel_soc[k];
             }
-            p2 = p2->previous;
         }
-        p1 = p1->previous;
+        ok = ok && ctx_set_travel_skim(coarse, tt, soc, n) == 0;
+        free(tt);
+        free(soc);
     }
-    if (cycle)
-    { // ou est ce que c'est utilise de toute facon ? et pq ca marche pas pour chaque label au fur et a mesure ?
-        Label *p3 = p1;
-        while (p3 != NULL && p3->act_id == c_activity)
+    for (int m = 1; ok && m < N_CHARGE_MODES; m++)
+    {
+        if (!(ctx->tariff_modes & (1u << m)))
         {
-            p3 = p3->previous;
+            continue;
         }
-        // printf("acity >> %d \n", c_activity);
-        while (p3 != NULL && p3->act_id != c_activity)
+        // the price of a coarse interval is the one of its first fine interval
+        int h = coarse->charge_horizon;
+        double *price = (double *)malloc((size_t)h * sizeof(double));
+        ok = price != NULL;
+        for (int t = 0; ok && t < h; t++)
         {
-            // printf("intermedaire >> %d \n", p3->acity);
-            add_memory(p3->act_id, group_activity); // add une activite dans une liste qu'on ira checker si on va rajouetr le meme grouep ?
-            p3 = p3->previous;
+            int fine = t * factor < ctx->charge_horizon ? t * factor : ctx->charge_horizon - 1;
+            price[t] = ctx->charge_tariff[m * ctx->charge_horizon + fine];
         }
+        ok = ok && ctx_set_charge_tariff(coarse, m, price, h) == 0;
+        free(price);
     }
-    return cycle;
-};
-
-/* Dynamic Programming */
-void DP()
-{
-    draw_utility_error_terms_for_dp();
-
-    if (bucket == NULL)
+    if (!ok)
     {
-        printf(" BUCKET IS NULL %d", 0);
+        ctx_destroy(coarse);
+        return NULL;
     }
 
-    Label *ll = create_label(&activities[0]); // Initialise label with Dawn as first activity
-    bucket[ll->time][0].element = ll;         // store this label in the first position bucket structure
+    ctx_copy_settings(coarse, ctx);
+    coarse->fixed_initial_soc_enabled = ctx->fixed_initial_soc_enabled;
+    coarse->fixed_initial_soc_value = ctx->fixed_initial_soc_value;
+    coarse->seed = ctx->seed;
+    coarse->rng_seeded = ctx->rng_seeded;
+    memcpy(coarse->rng_state, ctx->rng_state, sizeof(coarse->rng_state));
+    coarse->draw_id = ctx->draw_id;
+    coarse->expansion_threads = ctx->expansion_threads;
+    return coarse;
+}
 
-    for (int h = ll->time; h < horizon - 1; h++) // for all time intervals from 0 to 288 (horizon = 289, the number of 5 min intervals in a day)
+/*  Coarse-to-fine solve: the day is first solved on intervals factor times longer, then again at the
+    context's own interval with only the activities of the coarse schedule, each allowed to start within
+    corridor intervals of its coarse start (inside its own window). Much fewer labels than ctx_solve(),
+    the schedule can be worse: the best one may leave the corridor. The windows of the context are restored
+    afterwards. If the coarse stage finds no schedule, or the corridor none, the full solve is run instead.
+    Results and return value as ctx_solve(), total_time and wall_time cover both stages */
+int ctx_solve_coarse_to_fine(SolverContext *ctx, int factor, int corridor)
+{
+    if (factor <= 1)
+    {
+        return ctx_solve(ctx);
+    }
+    clock_t start_time = clock();
+    double start_wall = wall_seconds();
+
+    // the coarse schedule
+    ScheduleRow *rows = NULL;
+    int n_rows = 0;
+    long coarse_labels = 0;
+    SolverContext *coarse = ctx->activities != NULL && ctx->max_num_activities > 0 && ctx->travel_intervals != NULL
+                                ? create_coarse_context(ctx, factor)
+                                : NULL;
+    int coarse_status = coarse != NULL ? ctx_solve(coarse) : -1;
+    coarse_labels = coarse != NULL ? coarse->stats.labels_created : 0;
+    if (coarse_status == 0)
+    {
+        n_rows = ctx_export_schedule(coarse, NULL, 0);
+        rows = (ScheduleRow *)malloc((size_t)n_rows * sizeof(ScheduleRow));
+        n_rows = rows != NULL ? ctx_export_schedule(coarse, rows, n_rows) : 0;
+    }
+    ctx_destroy(coarse);
+
+    int n = ctx->max_num_activities;
+    int *windows = n_rows > 0 ? (int *)malloc(2 * (size_t)n * sizeof(int)) : NULL;
+    int status = -1;
+    unsigned short rng_state[3];
+    memcpy(rng_state, ctx->rng_state, sizeof(rng_state));
+    int rng_seeded = ctx->rng_seeded;
+    unsigned int draw_id = ctx->draw_id;
+    if (windows != NULL)
     {
-        for (int act_index = 0; act_index < max_num_activities; act_index++) // for each activity in max_num_activities
+        unshare_tables(ctx); // the successor lists are rebuilt for the corridor
+        for (int i = 1; i < n - 1; i++)
         {
-            L_list *list = &bucket[h][act_index]; // create a linked list node,
-            // get all labels at state (h, act_index)
-            // create a linked list from the bucket entry at [h][act_index]
-
-            while (list != NULL) // for each label in the cell i.e. in the linked list
+            Activity *a = &ctx->activities[i];
+            windows[2 * i] = a->earliest_start;
+            windows[2 * i + 1] = a->latest_start;
+            int visited = 0;
+            int lo = ctx->p.horizon, hi = -1;
+            for (int r = 0; r < n_rows; r++)
+            {
+                if (rows[r].act_id == i)
+                {
+                    int s = rows[r].start_time * factor;
+                    visited = 1;
+                    lo = s - corridor < lo ? s - corridor : lo;
+                    hi = s + factor - 1 + corridor > hi ? s + factor - 1 + corridor : hi;
+                }
+            }
+            lo = lo > a->earliest_start ? lo : a->earliest_start;
+            hi = hi < a->latest_start ? hi : a->latest_start;
+            if (!visited)
+            {
+                a->latest_start = -1; // not in the coarse schedule
+            }
+            else if (lo <= hi)
             {
-                // int myBool = list!=NULL;
-                // printf("myBool: %s\n", myBool ? "true" : "false");
+                a->earliest_start = lo;
+                a->latest_start = hi;
+            } // else the coarse start rounded out of the window, the whole window is kept
+        }
+        ctx->succ_valid = 0;
+        status = ctx_solve(ctx);
+        ctx->solve_status |= status == 0 ? SOLVE_CORRIDOR : 0;
+        for (int i = 1; i < n - 1; i++)
+        {
+            ctx->activities[i].earliest_start = windows[2 * i];
+            ctx->activities[i].latest_start = windows[2 * i + 1];
+        }
+        ctx->succ_valid = 0;
+    }
+    free(windows);
+    free(rows);
+
+    if (status != 0)
+    {
+        // as if the corridor had not been tried: same draws as ctx_solve()
+        memcpy(ctx->rng_state, rng_state, sizeof(rng_state));
+        ctx->rng_seeded = rng_seeded;
+        ctx->draw_id = draw_id;
+        status = ctx_solve(ctx);
+    }
+    ctx->stats.labels_created += coarse_labels; // both stages
+    ctx->total_time = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+    ctx->stats.wall_time = wall_seconds() - start_wall;
+    return status;
+}
 
-                Label *L = list->element; // for the current label in the l_list
+/* Frees the arrays filled in by solve_multiday() */
+void free_multiday_result(MultiDayResult *results)
+{
+    free(results->days);
+    free(results->rows);
+    memset(results, 0, sizeof(*results));
+}
 
-                for (int a1 = 0; a1 < max_num_activities; a1++)
-                { // for all the activities
+// The steps of the algorithm on the global context
+void DP(void)
+{
+    ctx_dp(global_context());
+}
 
-                    if (is_feasible(L, &activities[a1]))
-                    { // if activity is not feasible, pass directly to the next activity
+int DSSR(Label *L)
+{
+    return ctx_dssr(global_context(), L);
+}
 
-                        Label *L1 = update_label_from_activity(L, &activities[a1]); // what would the label look like after this activity?
+/*  Multi-day run on the global context, see ctx_solve_multiday(). Like main(), the global parameters
+    are picked up first and the globals describe the last day afterwards */
+int solve_multiday(const Day *days, int n_days, double initial_soc_day1, MultiDayResult *results)
+{
+    SolverContext *ctx = global_context();
+
+    SolverParams p;
+    get_general_parameters(&p);
+    ctx_set_params(ctx, &p);
+
+    int n_solved = ctx_solve_multiday(ctx, days, n_days, initial_soc_day1, results);
+
+    activities = ctx->activities;
+    max_num_activities = ctx->max_num_activities;
+    final_schedule = ctx->final_schedule;
+    DSSR_count = ctx->DSSR_count;
+    total_time = ctx->total_time;
+    initial_soc = ctx->initial_soc;
+    bucket = ctx->bucket;
+    return n_solved;
+}
 
-                        // But : garder le minimum de L_list pour le temps au nouveau label et l'activite a1
-                        // aim: keen the minimum value from L_list
-                        // checks the min value in the linked list and retains that one
-                        int dom = 0;
-                        L_list *list_1 = &bucket[L1->time][a1];
-                        L_list *list_2 = &bucket[L1->time][a1];
+/*  Coarse-to-fine solve on the global context, see ctx_solve_coarse_to_fine(). Like main(), the global
+    parameters are picked up first and the results are copied into the globals */
+int solve_coarse_to_fine(int factor, int corridor)
+{
+    SolverContext *ctx = global_context();
 
-                        while (list_1 != NULL)
-                        {
+    SolverParams p;
+    get_general_parameters(&p);
+    ctx_set_params(ctx, &p);
 
-                            list_2 = list_1;
-
-                            // If a label in the bucket is dominated by L1, this label is removed from the list (bucket)
-                            if (dominates(L1, list_1->element))
-                            {
-                                // printf("\n Dominance \n");
-                                list_1 = remove_label(list_1);
-                            }
-                            // If L1 is dominated by a label in the bucket, no further comparason is needed for L1 and it's discarded
-                            else
-                            {
-                                if (dominates(list_1->element, L1))
-                                {
-                                    // printf("\n Dominance \n");
-                                    free(L1);
-                                    dom = 1; // (dom = 1) => bucket domine L1
-                                    break;   // exit the while
-                                }
-                                list_1 = list_1->next; // pour evaluer la prochaine L_list
-                            };
-                        }
+    int status = ctx_solve_coarse_to_fine(ctx, factor, corridor);
 
-                        // si L1 n'est domine par aucun des label de la list du bucket, il faut l'y rajouter
-                        if (!dom)
-                        {
-                            if (list_2->element == NULL)
-                            {
-                                list_2->element = L1;
-                            }
-                            else
-                            { // juste rajoute un label a la fin d'une Label_list
-                                L_list *Ln = malloc(sizeof(L_list));
-                                Ln->element = L1;
-                                list_2->next = Ln;
-                                Ln->next = NULL;
-                                Ln->previous = list_2;
-                            }
-                        } // end if not dominance
-                    } // end if feasible
-                } // end for a1
-                list = list->next; // passe au prochain label de la liste L_label
-            } // end while
-        } // end for a0
-    } // end for h
-};
+    final_schedule = ctx->final_schedule;
+    DSSR_count = ctx->DSSR_count;
+    total_time = ctx->total_time;
+    initial_soc = ctx->initial_soc;
+    bucket = ctx->bucket;
+    return status;
+}
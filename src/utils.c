@@ -1,11 +1,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <time.h>
 #include <stdbool.h>
 #include "scheduling.h"
 #include "utils.h"
+#include "context.h"
 
 void recursive_print(Label *L)
 {
@@ -15,7 +17,7 @@ void recursive_print(Label *L)
         {
             recursive_print(L->previous);
         }
-        printf("(act = %d, type/group_no = %d, start = %d, duration = %d, time = %d), ", L->act_id, L->act->group, L->start_time, L->duration, L->time);
+        printf("(act = %d, start = %d, duration = %d, time = %d), ", L->act_id, L->start_time, L->duration, L->time);
     }
 };
 
@@ -24,263 +26,252 @@ void recursive_print(Label *L)
 //////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 /* initializes a two-dimensional dynamic array named bucket of size a by b. Each element of this array is of type L_list */
-void create_bucket(int a, int b)
+void ctx_create_bucket(SolverContext *ctx, int a, int b)
 {
     // It allocates memory for a number of pointers to L_list
     // allocating memory for pointers, not for the actual L_list objects
     // (L_list**) is a type cast, which tells compiler to treat the returned pointer from malloc() as a pointer to a pointer to L_list
-    bucket = (L_list **)malloc(a * sizeof(L_list *));
+    ctx->bucket = (L_list **)malloc(a * sizeof(L_list *));
     for (int i = 0; i < a; i++)
     {
-        bucket[i] = (L_list *)malloc(b * sizeof(L_list)); // For each of those pointers, it allocates memory for b L_list objects
-        for (int j = 0; j < b; j++)
-        { // It then initializes the properties of each L_list to NULL.
-            bucket[i][j].element = NULL;
-            bucket[i][j].previous = NULL;
-            bucket[i][j].next = NULL;
-        }
+        ctx->bucket[i] = (L_list *)calloc(b, sizeof(L_list)); // For each of those pointers, it allocates memory for b empty cells
     }
+    ctx->bucket_rows = a;
+    ctx->bucket_cols = b;
+    ctx->bucket_window = 0; // ctx_solve() sets it for a sliding bucket
+    ctx->active_words = (b + 63) / 64;
+    ctx->active = (uint64_t *)calloc((size_t)a * (size_t)ctx->active_words, sizeof(uint64_t));
 };
 
-/* recursively free memory associated with a given Group_mem and all its successors */
-// Note: This function is internal to utils.c only
-static void delete_group(Group_mem *L)
+/*  empties every cell of the bucket for the next DSSR pass, keeping the grid and the rows of each cell.
+    Labels all go back to their pool at once, the schedule found last goes with them */
+void ctx_reset_bucket(SolverContext *ctx)
 {
-    if (L != NULL)
+    ctx->final_schedule = NULL;
+    for (int i = 0; i < ctx->bucket_rows; i++)
     {
-        if (L->next != NULL)
+        for (int j = 0; j < ctx->bucket_cols; j++)
         {
-            delete_group(L->next);
+            ctx->bucket[i][j].n = 0;
         }
-        free(L);
     }
+    memset(ctx->active, 0, (size_t)ctx->bucket_rows * (size_t)ctx->active_words * sizeof(uint64_t));
+    pool_reset(&ctx->label_pool);
+    for (int i = 0; i < ctx->n_expand_pools; i++)
+    {
+        pool_reset(&ctx->expand_pools[i]);
+    }
+    ctx->live_labels = 0;
 };
 
-/* frees memory associated with a given L_list and all of its successors */
-// Note: This function is internal to utils.c only
-static void delete_list(L_list *L)
+/*  frees up the memory occupied by the bucket
+    the labels are not freed one by one, their pool is reset and kept for the next person */
+void ctx_free_bucket(SolverContext *ctx)
 {
-    if (L->next != NULL)
-    { // After reaching the last L_list in the list, it begins freeing memory.
-        delete_list(L->next);
+    if (ctx->bucket == NULL)
+    {
+        return;
     }
-    // checks if the L_list has a Label (L->element) associated with it. If so, it frees the memory of any Group_mem of the Label too
-    if (L->element != NULL)
+    for (int i = 0; i < ctx->bucket_rows; i++)
     {
-        if (L->element->mem != NULL)
+        for (int j = 0; j < ctx->bucket_cols; j++)
         {
-            delete_group(L->element->mem);
+            free(ctx->bucket[i][j].utility);
         }
-        free(L->element);
-        L->element = NULL;
+        free(ctx->bucket[i]);
+        ctx->bucket[i] = NULL;
+    }
+    free(ctx->bucket);
+    ctx->bucket = NULL;
+    free(ctx->active);
+    ctx->active = NULL;
+    ctx->final_schedule = NULL; // its labels were in the pool
+    ctx->bucket_rows = 0;
+    ctx->bucket_cols = 0;
+    ctx->bucket_window = 0;
+    pool_reset(&ctx->label_pool);
+    for (int i = 0; i < ctx->n_expand_pools; i++)
+    {
+        pool_reset(&ctx->expand_pools[i]);
     }
+    ctx->live_labels = 0;
 };
 
-/*  frees up the memory occupied by the bucket
-   first free the memory of every L_list componenent, then of the bucket itself */
-void free_bucket()
+/* returns an uninitialised Label from the label pool */
+Label *ctx_alloc_label(SolverContext *ctx)
 {
-    for (int i = 0; i < horizon; i++)
+    ctx->live_labels++; // also the label cap of ctx_set_budget()
+#if SOLVER_STATS
+    if (ctx->live_labels > ctx->stats.peak_live_labels)
     {
-        for (int j = 0; j < max_num_activities; j++)
-        {
-            L_list *L = &bucket[i][j];
-            delete_list(L);
-            // &bucket[i][j] == NULL;
-            bucket[i][j].element = NULL;
-        }
-        free(bucket[i]);
-        bucket[i] = NULL;
+        ctx->stats.peak_live_labels = ctx->live_labels;
     }
-    free(bucket);
-    bucket = NULL;
+#endif
+    return (Label *)pool_alloc(&ctx->label_pool);
 };
 
-Group_mem *createNode(int data)
+/* hands a label that is no longer referenced back to the label pool */
+void ctx_release_label(SolverContext *ctx, Label *L)
 {
-    /* Purpose: Allocates memory for and initializes a new Group_mem node with provided data */
-    Group_mem *newNode = (Group_mem *)malloc(sizeof(Group_mem));
-    newNode->g = data;
-    newNode->next = NULL;
-    newNode->previous = NULL;
-    return newNode;
+    ctx->live_labels--;
+    pool_release(&ctx->label_pool, L);
 };
 
-/* Function to copy a linked list */
-Group_mem *copyLinkedList(Group_mem *head)
+// Same on the global context, the global bucket pointer follows the context's one
+void create_bucket(int a, int b)
 {
-    if (head == NULL)
-    {
-        return NULL;
-    }
-
-    // Create a new list head
-    Group_mem *newHead = createNode(head->g);
-    Group_mem *newCurr = newHead;
-    Group_mem *curr = head->next;
-
-    // Copy the remaining nodes
-    while (curr != NULL)
-    {
-        Group_mem *newNode = createNode(curr->g);
-        newCurr->next = newNode;
-        newNode->previous = newCurr;
-        newCurr = newCurr->next;
-        curr = curr->next;
-    }
-    return newHead;
+    ctx_create_bucket(global_context(), a, b);
+    bucket = global_context()->bucket;
 };
 
-/*  Creates a new linked list that contains nodes representing the union of head1 and head2
-    plus an additional node with g as pipi.*/
-// updates the memory when you start a new activity
-// static int group_mem_contains_value(Group_mem *head, int value)
-// {
-//     Group_mem *curr = head;
-//     while (curr != NULL)
-//     {
-//         if (curr->g == value)
-//         {
-//             return 1;
-//         }
-//         curr = curr->next;
-//     }
-//     return 0;
-// }
+// get_final_schedule() gives NULL afterwards, export_schedule() first to keep the schedule
+void reset_bucket(void)
+{
+    ctx_reset_bucket(global_context());
+    final_schedule = NULL;
+};
 
-// static void group_mem_append_unique(Group_mem **head, Group_mem **tail, int value)
-// {
-//     if (group_mem_contains_value(*head, value))
-//     {
-//         return;
-//     }
-//     Group_mem *node = createNode(value);
-//     if (*head == NULL)
-//     {
-//         *head = node;
-//         *tail = node;
-//         return;
-//     }
-//     (*tail)->next = node;
-//     node->previous = *tail;
-//     *tail = node;
-// }
+void free_bucket(void)
+{
+    ctx_free_bucket(global_context());
+    bucket = NULL;
+    final_schedule = NULL;
+};
 
-/*  Creates a new linked list that contains nodes representing the union of head1 and head2
-    plus an additional node with g as pipi.*/
-Group_mem *unionLinkedLists(Group_mem *head1, Group_mem *head2, int pipi)
-{ // head2 is null, so we could simplify the function a lot
-    int pp = 0;
-    if (head1 == NULL || head2 == NULL)
-    {
-        Group_mem *newNode = createNode(pipi);
-        return newNode;
-    }
-    Group_mem *newHead = NULL;
-    Group_mem *newTail = NULL;
-    Group_mem *curr1 = head1;
+/* gives the pool slabs of the global context back to the system, e.g. at the end of a batch */
+void destroy_pools(void)
+{
+    pool_destroy(&global_context()->label_pool);
+};
 
-    while (curr1 != NULL)
+/*  Grows the rows of a cell to hold at least cap labels, the columns share one block:
+    utility, stay and the resource columns first (8 byte aligned), then element, then mem. Returns 0 if out of memory */
+static int grow_cell(L_list *cell, int cap)
+{
+    size_t utility_bytes = (size_t)cap * sizeof(double);
+    size_t stay_bytes = (size_t)cap * sizeof(StayState);
+    size_t element_bytes = (size_t)cap * sizeof(Label *);
+    char *block = (char *)malloc(5 * utility_bytes + stay_bytes + element_bytes + (size_t)cap * sizeof(Group_set));
+    if (block == NULL)
     {
-        Group_mem *curr2 = head2;
-
-        while (curr2 != NULL)
-        {
-
-            if (curr1->g == curr2->g)
-            {
-                Group_mem *newNode = createNode(curr1->g);
-                if (newHead == NULL)
-                {
-                    newHead = newNode;
-                    newTail = newNode;
-                }
-                else
-                {
-                    newTail->next = newNode;
-                    newNode->previous = newTail;
-                    newTail = newTail->next;
-                }
-                break; // Move to the next element in the first list
-            }
-            curr2 = curr2->next;
-        }
-        curr1 = curr1->next;
+        return 0;
     }
-    if (newHead == NULL)
+    double *utility = (double *)block;
+    StayState *stay = (StayState *)(block + utility_bytes);
+    double *keys = (double *)(block + utility_bytes + stay_bytes); // soc_key, cost_key, key_max, key_min
+    Label **element = (Label **)(block + 5 * utility_bytes + stay_bytes);
+    Group_set *mem = (Group_set *)(block + 5 * utility_bytes + stay_bytes + element_bytes);
+    if (cell->n > 0)
     {
-        newHead = createNode(pipi);
-        newTail = newHead;
+        memcpy(utility, cell->utility, (size_t)cell->n * sizeof(double));
+        memcpy(stay, cell->stay, (size_t)cell->n * sizeof(StayState));
+        memcpy(keys, cell->soc_key, (size_t)cell->n * sizeof(double));
+        memcpy(keys + cap, cell->cost_key, (size_t)cell->n * sizeof(double));
+        memcpy(keys + 2 * cap, cell->key_max, (size_t)cell->n * sizeof(double));
+        memcpy(keys + 3 * cap, cell->key_min, (size_t)cell->n * sizeof(double));
+        memcpy(element, cell->element, (size_t)cell->n * sizeof(Label *));
+        memcpy(mem, cell->mem, (size_t)cell->n * sizeof(Group_set));
     }
-    else
+    free(cell->utility);
+    cell->utility = utility;
+    cell->stay = stay;
+    cell->soc_key = keys;
+    cell->cost_key = keys + cap;
+    cell->key_max = keys + 2 * cap;
+    cell->key_min = keys + 3 * cap;
+    cell->element = element;
+    cell->mem = mem;
+    cell->cap = cap;
+    return 1;
+}
+
+/*  Adds a row for label element as the last row of the cell, state gives the stay columns:
+    the element itself for a label that just entered its activity, the state reached so far for a stay.
+    The resource columns are left to the caller. Returns 0 if out of memory */
+int append_label(L_list *cell, Label *element, const Label *state)
+{
+    if (cell->n == cell->cap && !grow_cell(cell, cell->cap > 0 ? 2 * cell->cap : 4))
     {
-        newTail->next = createNode(pipi);
-        newTail->next->previous = newTail;
+        return 0;
     }
-    return newHead;
+    int i = cell->n++;
+    cell->utility[i] = state->utility;
+    cell->mem[i] = state->mem;
+    cell->element[i] = element;
+    cell->stay[i].current_soc = state->current_soc;
+    cell->stay[i].current_charge_cost = state->current_charge_cost;
+    cell->stay[i].duration = state->duration;
+    cell->stay[i].charge_duration = state->charge_duration;
+    return 1;
 };
 
-/* Removes the label from the provided list of label and adjusts the connections of adjacent labels. */
-L_list *remove_label(L_list *L)
+/*  Rows are only removed before their cell is expanded, so the label of an entry row is referenced by
+    nothing else and goes back to the pool. The label of a stay row is shared with earlier rows and is kept */
+static void release_row(SolverContext *ctx, L_list *cell, int i)
 {
-    free(L->element);
-    L->element = NULL;
-    L_list *L_re;
-    if (L->previous != NULL && L->next != NULL)
-    {
-        L->previous->next = L->next;
-        L->next->previous = L->previous;
-        L_re = L->next;
-        free(L);
-        return L_re;
-    }
-    if (L->previous != NULL && L->next == NULL)
-    {
-        L->previous->next = NULL;
-        L_re = NULL;
-        free(L);
-        return L_re;
-    }
-    if (L->previous == NULL && L->next != NULL)
-    {
-        if (L->next->next != NULL)
-        {
-            L->next->next->previous = L;
-        }
-        L_re = L->next;
-        L->element = L_re->element;
-        L->next = L->next->next;
-        free(L_re);
-        return L; // return L which has taken the values of L->next.
-    }
-    if (L->previous == NULL && L->next == NULL)
+    if (cell->stay[i].duration == cell->element[i]->duration)
     {
-        return NULL;
+        ctx_release_label(ctx, cell->element[i]); // entry row
     }
+}
+
+/* Removes row i from the cell, the last row takes its place */
+void remove_label(SolverContext *ctx, L_list *cell, int i)
+{
+    release_row(ctx, cell, i);
+    int last = --cell->n;
+    cell->utility[i] = cell->utility[last];
+    cell->mem[i] = cell->mem[last];
+    cell->element[i] = cell->element[last];
+    cell->stay[i] = cell->stay[last];
 };
 
-/* Adds memory (a Group_mem node) to an activity in the global activities array */
-void add_memory(int at, int c)
+// moves rows [from, from + count) of the cell to start at row to, skyline columns excluded
+static void move_rows(L_list *cell, int to, int from, int count)
 {
-    if (activities[at].memory == NULL)
-    { // If the specified activity (indexed by at) doesn't already have memory, it initializes its memory with c.
-        activities[at].memory = malloc(sizeof(Group_mem));
-        activities[at].memory->g = c;
-        activities[at].memory->previous = NULL;
-        activities[at].memory->next = NULL;
-    }
-    else
-    { // O/w, finds the last node in the existing memory list and adds a new Group_mem node with g set to c at the end of the list.
-        Group_mem *pp = activities[at].memory;
-        while (pp->next != NULL)
-        {
-            pp = pp->next;
-        }
-        pp->next = malloc(sizeof(Group_mem));
-        pp->next->g = c;
-        pp->next->previous = pp;
-        pp->next->next = NULL;
+    memmove(&cell->utility[to], &cell->utility[from], (size_t)count * sizeof(double));
+    memmove(&cell->mem[to], &cell->mem[from], (size_t)count * sizeof(Group_set));
+    memmove(&cell->element[to], &cell->element[from], (size_t)count * sizeof(Label *));
+    memmove(&cell->stay[to], &cell->stay[from], (size_t)count * sizeof(StayState));
+    memmove(&cell->soc_key[to], &cell->soc_key[from], (size_t)count * sizeof(double));
+    memmove(&cell->cost_key[to], &cell->cost_key[from], (size_t)count * sizeof(double));
+}
+
+/* Removes row i from the cell keeping the order of the others, the later rows move up by one */
+void remove_label_in_order(SolverContext *ctx, L_list *cell, int i)
+{
+    release_row(ctx, cell, i);
+    cell->n--;
+    move_rows(cell, i, i + 1, cell->n - i);
+}
+
+/* Moves the last row of the cell to row i, rows i .. n - 2 move down by one */
+void move_last_label_to(L_list *cell, int i)
+{
+    int last = cell->n - 1;
+    if (i >= last)
+    {
+        return;
     }
+    double utility = cell->utility[last];
+    Group_set mem = cell->mem[last];
+    Label *element = cell->element[last];
+    StayState stay = cell->stay[last];
+    double soc_key = cell->soc_key[last];
+    double cost_key = cell->cost_key[last];
+    move_rows(cell, i + 1, i, last - i);
+    cell->utility[i] = utility;
+    cell->mem[i] = mem;
+    cell->element[i] = element;
+    cell->stay[i] = stay;
+    cell->soc_key[i] = soc_key;
+    cell->cost_key[i] = cost_key;
+}
+
+/* Adds group c to the memory of activity at in the activities of the context */
+void add_memory(SolverContext *ctx, int at, int c)
+{
+    ctx->activities[at].memory |= GROUP_BIT(c);
 };
 
 /* checks if the activity_type of activity a is already done during the label L
@@ -289,7 +280,7 @@ void add_memory(int at, int c)
     au final meme pas utilise !
     si on le met en fonction, tout group meme devient inutile ??
     modifier la fonction et faire un print de s'ils sont differents seulement !!*/
-int contains(Label *L, Activity *a)
+int contains(const Activity *activities, Label *L, Activity *a)
 {
     if (a->group == 0)
     {
@@ -297,8 +288,8 @@ int contains(Label *L, Activity *a)
     }
     while (L != NULL)
     {
-        if ((L->act->group == a->group) && (L->act->id != a->id))
-        {             // L->act->id = L->acity
+        if ((activities[L->act_id].group == a->group) && (L->act_id != a->id))
+        {
             return 1; // If there's a match, the function returns 1 (true)
         }
         L = L->previous;
@@ -314,68 +305,36 @@ int mem_contains(Label *L, Activity *a)
     {
         return 0;
     }
-    Group_mem *gg = L->mem; // see if the group memory in Label matches the activity_type of a.
-    while (gg != NULL)
-    {
-        if (gg->g == a->group)
-        {
-            return 1;
-        } // Returns 1 if there is a match
-        gg = gg->next;
-    }
-    return 0;
+    return (L->mem & GROUP_BIT(a->group)) != 0;
 };
 
 /*  Determines if every group in the memory of Label L1 is also contained in the memory of Label L2
     Return 1 if True */
 int dom_mem_contains(Label *L1, Label *L2)
 {
-    // if(a->group == 0){return 0;}
-    Group_mem *gg = L1->mem;
-
-    while (gg != NULL)
-    { // For every Group_mem in L1->mem
-        Group_mem *gg2 = L2->mem;
-        int contain = 0;
-
-        while (gg2 != NULL)
-        { // For every Group_mem in L2->mem
-            if (gg->g == gg2->g)
-            {
-                contain = 1;
-            }
-            gg2 = gg2->next;
-        }
-
-        // If a particular Group_mem from L1->mem is not in L2->mem, the function returns 0 (false)
-        if (!contain)
-        {
-            return 0;
-        }
-        gg = gg->next;
-    }
-    // If all Group_mem in L1->mem are found in L2->mem, it returns 1 (true)
-    return 1;
+    return (L1->mem & ~L2->mem) == 0;
 };
 
-// seeds the random number generator for drand48()
-void seed_random(unsigned int seed)
+// seeds an erand48() state, the draws that follow are the ones drand48() gives after srand48(seed)
+void seed_random(unsigned short state[3], unsigned int seed)
 {
-    srand48(seed);
+    state[0] = 0x330E;
+    state[1] = (unsigned short)(seed & 0xFFFF);
+    state[2] = (unsigned short)(seed >> 16);
 }
 
 // generates a random number from a normal distribution using Box-Muller transform
-double normal_random(double mean, double std_dev)
+double normal_random(unsigned short state[3], double mean, double std_dev)
 {
     double r1;
     double r2;
 
     // Ensure r1 is never exactly 0 to avoid log(0) = -infinity
     do {
-        r1 = drand48();
+        r1 = erand48(state);
     } while (r1 == 0.0);
 
-    r2 = drand48();
+    r2 = erand48(state);
 
     // Box-Muller transform: convert uniform to standard normal
     double x = sqrt(-2.0 * log(r1)) * cos(2.0 * M_PI * r2);
@@ -383,3 +342,59 @@ double normal_random(double mean, double std_dev)
     // Scale and shift to desired mean and std_dev
     return mean + std_dev * x;
 }
+
+/*  Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3"): out is a function of the
+    counter and the key only, so any draw can be made on its own, in any order and on any thread */
+void philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4])
+{
+    uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+    uint32_t k0 = key[0], k1 = key[1];
+    for (int round = 0; round < 10; round++)
+    {
+        uint64_t p0 = (uint64_t)0xD2511F53u * c0;
+        uint64_t p1 = (uint64_t)0xCD9E8D57u * c2;
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t)p1;
+        c3 = (uint32_t)p0;
+        c0 = n0;
+        c2 = n2;
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+/*  Fills out with the normal draws first .. first + n - 1 of (key, draw, purpose).
+    Draw j comes from Philox block j / 2: its two uniforms give both Box-Muller variates, cos for even j
+    and sin for odd j, so a draw does not depend on how the terms are split into calls */
+void philox_normals(const uint32_t key[2], uint32_t draw, uint32_t purpose, uint32_t first, double *out, int n,
+                    double mean, double std_dev)
+{
+    const double two_pi = 2.0 * M_PI;
+    const double unit = 1.0 / 9007199254740992.0; // 2^-53
+    int i = 0;
+    while (i < n)
+    {
+        uint32_t j = first + (uint32_t)i;
+        uint32_t counter[4] = {j / 2, draw, purpose, 0};
+        uint32_t x[4];
+        philox4x32(counter, key, x);
+        // 53 bit uniforms, 1 - u1 in (0, 1] for the log
+        double u1 = (double)((((uint64_t)x[0] << 32) | x[1]) >> 11) * unit;
+        double u2 = (double)((((uint64_t)x[2] << 32) | x[3]) >> 11) * unit;
+        double r = std_dev * sqrt(-2.0 * log(1.0 - u1));
+        if ((j & 1) == 0)
+        {
+            out[i++] = mean + r * cos(two_pi * u2);
+            if (i == n)
+            {
+                break;
+            }
+        }
+        out[i++] = mean + r * sin(two_pi * u2);
+    }
+}
@@ -0,0 +1,122 @@
+"""
+Reader of the binary schedule dumps written by solve_population_to_file() (format in
+include/schedule_writer.h). The file is memory mapped and the columns are memoryviews into it,
+nothing is parsed or copied until a column is used.
+
+    from schedule_dump import read_schedule_dump
+    with read_schedule_dump("dump.evs") as dump:
+        for batch in dump.batches:
+            batch.person, batch.utility, batch.rows["act_id"], ...   # memoryviews
+        df = dump.to_dataframe()                                        # pandas, one line per row
+"""
+
+import mmap
+import struct
+import sys
+
+PERSON_COLUMNS = [("person", "I"), ("status", "i"), ("dssr_count", "i"), ("first_row", "I"),
+                  ("n_rows", "I"), ("utility", "d"), ("initial_soc", "d")]
+ROW_COLUMNS = [("act_id", "i"), ("start_time", "i"), ("duration", "i"), ("charge_duration", "i"),
+               ("soc_start", "d"), ("soc_end", "d"), ("charge_cost", "d"), ("utility", "d")]
+BATCH_HEADER_SIZE = 24
+
+
+def _padded(n, size):
+    return (n * size + 7) & ~7
+
+
+class Batch:
+    """The persons of one batch: person columns as attributes, row columns in rows"""
+
+    def __init__(self, view, offset):
+        self.person_count, self.row_count, self.size = struct.unpack_from("=IIQ", view, offset + 8)
+        pos = offset + BATCH_HEADER_SIZE
+        for name, code in PERSON_COLUMNS:
+            size = struct.calcsize(code)
+            setattr(self, name, view[pos:pos + self.person_count * size].cast(code))
+            pos += _padded(self.person_count, size)
+        self.rows = {}
+        for name, code in ROW_COLUMNS:
+            size = struct.calcsize(code)
+            self.rows[name] = view[pos:pos + self.row_count * size].cast(code)
+            pos += _padded(self.row_count, size)
+
+    def release(self):
+        for name, _ in PERSON_COLUMNS:
+            getattr(self, name).release()
+        for col in self.rows.values():
+            col.release()
+
+
+class ScheduleDump:
+    def __init__(self, path):
+        self._file = open(path, "rb")
+        self._map = mmap.mmap(self._file.fileno(), 0, access=mmap.ACCESS_READ)
+        self._view = memoryview(self._map)
+        view = self._view
+        if bytes(view[:8]) != b"EVSCHED1":
+            raise ValueError(f"{path}: not a schedule dump")
+        self.version, byte_order = struct.unpack_from("=II", view, 8)
+        if byte_order != 0x01020304:
+            raise ValueError(f"{path}: written with another byte order")
+
+        # the index if the writer finished, else walk the batches
+        self.complete = len(view) >= 16 + 16 and bytes(view[-8:]) == b"EVSCHEND"
+        if self.complete:
+            (index,) = struct.unpack_from("=Q", view, len(view) - 16)
+            n_batches, self.n_persons, self.n_rows = struct.unpack_from("=QQQ", view, index + 8)
+            offsets = struct.unpack_from(f"={n_batches}Q", view, index + 32)
+        else:
+            offsets = []
+            pos = 16
+            while pos + BATCH_HEADER_SIZE <= len(view) and bytes(view[pos:pos + 8]) == b"EVSBATCH":
+                (size,) = struct.unpack_from("=Q", view, pos + 16)
+                if pos + size > len(view):
+                    break  # cut short while it was written
+                offsets.append(pos)
+                pos += size
+        self.batches = [Batch(view, offset) for offset in offsets]
+        if not self.complete:
+            self.n_persons = sum(b.person_count for b in self.batches)
+            self.n_rows = sum(b.row_count for b in self.batches)
+
+    def to_dataframe(self):
+        """One line per row with the id of its person, persons in id order"""
+        import pandas as pd
+
+        frames = []
+        for b in self.batches:
+            person = [0] * b.row_count
+            for k in range(b.person_count):
+                first = b.first_row[k]
+                person[first:first + b.n_rows[k]] = [b.person[k]] * b.n_rows[k]
+            frame = pd.DataFrame({name: col.tolist() for name, col in b.rows.items()})
+            frame.insert(0, "person", person)
+            frames.append(frame)
+        if not frames:
+            return pd.DataFrame(columns=["person"] + [name for name, _ in ROW_COLUMNS])
+        return pd.concat(frames, ignore_index=True).sort_values("person", kind="stable", ignore_index=True)
+
+    def close(self):
+        for b in self.batches:
+            b.release()
+        self.batches = []
+        self._view.release()
+        self._map.close()
+        self._file.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+
+def read_schedule_dump(path):
+    return ScheduleDump(path)
+
+
+if __name__ == "__main__":
+    with read_schedule_dump(sys.argv[1]) as dump:
+        state = "complete" if dump.complete else "not finished"
+        print(f"{sys.argv[1]}: {dump.n_persons} persons, {dump.n_rows} rows in {len(dump.batches)} batches ({state})")
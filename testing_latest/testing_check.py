@@ -1,5 +1,6 @@
 import pandas as pd
-from ctypes import Structure, c_int, c_double, POINTER, CDLL, c_char
+import numpy as np
+from ctypes import Structure, c_int, c_short, c_uint, c_double, POINTER, CDLL, c_char
 import subprocess
 import os
 import time
@@ -51,17 +52,6 @@ group_to_type = {
 }
 
 
-class Group_mem(Structure):
-    pass
-
-
-Group_mem._fields_ = [
-    ("g", c_int),
-    ("previous", POINTER(Group_mem)),
-    ("next", POINTER(Group_mem)),
-]
-
-
 class Activity(Structure):
     pass
 
@@ -75,7 +65,7 @@ Activity._fields_ = [
     ("x", c_double),
     ("y", c_double),
     ("group", c_int),
-    ("memory", POINTER(Group_mem)),
+    ("memory", c_uint),  # Group_set bitset, bit g <=> group g
     ("des_duration", c_int),
     ("des_start_time", c_int),
     ("charge_mode", c_int),
@@ -89,35 +79,62 @@ class Label(Structure):
 
 
 Label._fields_ = [
-    ("act_id", c_int),
-    ("time", c_int),
-    ("start_time", c_int),
-    ("duration", c_int),
-    ("deviation_start", c_int),
-    ("deviation_dur", c_int),
+    ("utility", c_double),
     ("soc_at_activity_start", c_double),
     ("current_soc", c_double),
-    ("delta_soc", c_double),
-    ("charge_duration", c_int),
     ("charge_cost_at_activity_start", c_double),
     ("current_charge_cost", c_double),
-    ("utility", c_double),
-    ("mem", POINTER(Group_mem)),
     ("previous", POINTER(Label)),
-    ("act", POINTER(Activity)),
+    ("mem", c_uint),
+    ("act_id", c_short),
+    ("time", c_short),
+    ("start_time", c_short),
+    ("duration", c_short),
+    ("charge_duration", c_short),
 ]
 
 
+class StayState(Structure):
+    _fields_ = [
+        ("current_soc", c_double),
+        ("current_charge_cost", c_double),
+        ("duration", c_int),
+        ("charge_duration", c_int),
+    ]
+
+
 class L_list(Structure):
     pass
 
 
 L_list._fields_ = [
-    ("element", POINTER(Label)),
-    ("previous", POINTER(L_list)),
-    ("next", POINTER(L_list)),
+    ("n", c_int),
+    ("cap", c_int),
+    ("utility", POINTER(c_double)),
+    ("mem", POINTER(c_uint)),
+    ("element", POINTER(POINTER(Label))),
+    ("stay", POINTER(StayState)),
+    ("soc_key", POINTER(c_double)),
+    ("cost_key", POINTER(c_double)),
+    ("key_max", POINTER(c_double)),
+    ("key_min", POINTER(c_double)),
 ]
 
+
+class ScheduleRow(Structure):
+    """One visit of the optimal schedule, as written by export_schedule() in the C code."""
+
+    _fields_ = [
+        ("act_id", c_int),
+        ("start_time", c_int),  # in intervals
+        ("duration", c_int),  # in intervals
+        ("charge_duration", c_int),  # in intervals
+        ("soc_start", c_double),
+        ("soc_end", c_double),
+        ("charge_cost", c_double),  # cumulative
+        ("utility", c_double),  # cumulative
+    ]
+
 # ===== C Compilation =====
 
 
@@ -137,6 +154,11 @@ def compile_code():
         os.path.join(src_dir, "scheduling.c"),
         os.path.join(src_dir, "utils.c"),
         os.path.join(src_dir, "main.c"),
+        os.path.join(src_dir, "arena.c"),
+        os.path.join(src_dir, "population.c"),
+        os.path.join(src_dir, "activity_csv.c"),
+        os.path.join(src_dir, "cli.c"),
+        os.path.join(src_dir, "schedule_writer.c"),
     ]
 
     # Check if recompilation is needed
@@ -183,7 +205,7 @@ def compile_code():
             output_lib,
         ]
         + sources
-        + ["-lm"]
+        + ["-lm", "-pthread"]
     )
 
     print(f"Compiling C code: {' '.join(compile_command)}")
@@ -249,8 +271,8 @@ def initialise_and_personalise_activities(df):
             else 0
         )
 
-        # Memory (will be initialized by C code)
-        activities_array[act_id].memory = None
+        # Memory (will be filled in by DSSR in the C code)
+        activities_array[act_id].memory = 0
 
     print(f"Initialized {len(df)} activities (array size: {max_num_activities})")
     print(f"  - Dawn: id=0, Dusk: id={max_num_activities - 1}")
@@ -369,6 +391,54 @@ def run_dp(lib, activities_array, max_num_activities, params):
     return best_label, total_time
 
 
+def export_schedule(lib):
+    """
+    Copy the last schedule out of the solver in one call.
+
+    Returns a NumPy structured array with the ScheduleRow fields, one row per visit.
+    It owns its memory, so free_bucket() can be called right away.
+    """
+    lib.export_schedule.argtypes = [POINTER(ScheduleRow), c_int]
+    lib.export_schedule.restype = c_int
+    n_rows = lib.export_schedule(None, 0)
+    rows = (ScheduleRow * n_rows)()
+    lib.export_schedule(rows, n_rows)
+    return np.ctypeslib.as_array(rows)
+
+
+def schedule_frame(rows, activities_array, activities_df=None):
+    """The rows of export_schedule() as the DataFrame extract_schedule() builds."""
+    schedule = []
+    for row in rows:
+        activity = activities_array[row["act_id"]]
+        if activities_df is not None and "act_type" in activities_df.columns:
+            act_type_row = activities_df[activities_df["id"] == row["act_id"]]
+            if not act_type_row.empty:
+                act_type = act_type_row.iloc[0]["act_type"]
+            else:
+                act_type = "home" if activity.group == 0 else f"group_{activity.group}"
+        else:
+            act_type = "home" if activity.group == 0 else f"group_{activity.group}"
+        schedule.append(
+            {
+                "act_id": int(row["act_id"]),
+                "act_type": act_type,
+                "start_time": row["start_time"] * TIME_INTERVAL / 60,  # Convert to hours
+                "duration": int(row["duration"]),
+                "soc_start": float(row["soc_start"]),
+                "soc_end": float(row["soc_end"]),
+                "is_charging": activity.is_charging,
+                "charge_mode": activity.charge_mode,
+                "charge_duration": row["charge_duration"] * TIME_INTERVAL / 60,  # hours
+                "charge_cost": float(row["charge_cost"]),
+                "utility": float(row["utility"]),
+                "x": activity.x,
+                "y": activity.y,
+            }
+        )
+    return pd.DataFrame(schedule)
+
+
 def extract_schedule(best_label, activities_array, activities_df=None):
     """
     Extract the schedule from the best label.
@@ -523,8 +593,9 @@ def main():
     best_label, total_time = run_dp(lib, activities_array, max_num_activities, params)
 
     if best_label:
-        # Extract and display schedule (pass activities_df for better display names)
-        schedule_df = extract_schedule(best_label, activities_array, activities_df)
+        # Copy the schedule out and let the solver memory go (pass activities_df for better display names)
+        schedule_df = schedule_frame(export_schedule(lib), activities_array, activities_df)
+        lib.free_bucket()
 
         print("\n" + "=" * 60)
         print("OPTIMAL SCHEDULE")
@@ -551,7 +622,8 @@ def main():
         print(f"Total utility: {schedule_df['utility'].iloc[-1]:.2f}")
 
     # Cleanup
-    lib.free_bucket()
+    if not best_label:
+        lib.free_bucket()
     print("\n" + "=" * 60)
     print("Test complete!")
     print("=" * 60)